@@ -21,6 +21,7 @@
 #define BYTE_STREAM_HPP_
 
 #include <cstdlib>
+#include <cstring>
 #include <string>
 #include <vector>
 
@@ -59,9 +60,12 @@ private:
 		}
 		if(swap)
 			swap_endian(data);
-		var = 0;
+
+		// combine big-endian bytes unsigned, so wide types shift correctly
+		unsigned long long bits = 0;
 		for(unsigned int i = 0; i < width; ++i)
-			var |= (data.at(i) << (8 * ((width - 1) - i)));
+			bits = (bits << 8) | data.at(i);
+		var = (T) bits;
 		return SUCCESS;
 	}
 
@@ -81,7 +85,16 @@ private:
 		}
 		if(swap)
 			swap_endian(data);
-		var = atof((char *) data.data());
+
+		// reinterpret big-endian IEEE 754 bits
+		unsigned long long bits = 0;
+		for(unsigned int i = 0; i < sizeof(T); ++i)
+			bits = (bits << 8) | data.at(i);
+		if(sizeof(T) == sizeof(unsigned int)) {
+			unsigned int word = (unsigned int) bits;
+			memcpy(&var, &word, sizeof(T));
+		} else
+			memcpy(&var, &bits, sizeof(T));
 		return SUCCESS;
 	}
 
@@ -0,0 +1,393 @@
+/*
+ * chunk_index.cpp
+ * Copyright (C) 2012 David Jolly
+ * ----------------------
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <boost/filesystem.hpp>
+#include <cstring>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include "chunk_index.hpp"
+#include "region_file.hpp"
+#include "world.hpp"
+
+/*
+ * Chunk index constructor
+ */
+chunk_index::chunk_index(const std::string &dir) : count(0) {
+	build(dir);
+}
+
+/*
+ * Build an index from every region header in a directory
+ */
+void chunk_index::build(const std::string &dir) {
+	this->dir = dir;
+	regions.clear();
+	count = 0;
+	refresh();
+}
+
+/*
+ * Returns true if a chunk at a given chunk x, z coord is present
+ */
+bool chunk_index::contains(int x, int z) {
+	std::map<long long, region_entry>::iterator iter = regions.find(key(world::region_coord(x), world::region_coord(z)));
+
+	// check region, then chunk bit
+	if(iter == regions.end())
+		return false;
+	return (iter->second.rows[world::local_coord(z, region_dim::CHUNK_WIDTH)] >> world::local_coord(x, region_dim::CHUNK_WIDTH)) & 1;
+}
+
+/*
+ * Returns the bounding box of all present chunks (false if the index is empty)
+ */
+bool chunk_index::get_bounds(int &min_x, int &min_z, int &max_x, int &max_z) {
+	bool found = false;
+	int base_x, base_z, row_min, row_max;
+	unsigned int columns;
+	std::map<long long, region_entry>::iterator iter;
+
+	// merge each region's occupied rows & columns
+	for(iter = regions.begin(); iter != regions.end(); ++iter) {
+		if(!iter->second.count)
+			continue;
+		columns = 0;
+		row_min = -1;
+		row_max = -1;
+		for(unsigned int z = 0; z < region_dim::CHUNK_WIDTH; ++z)
+			if(iter->second.rows[z]) {
+				columns |= iter->second.rows[z];
+				if(row_min < 0)
+					row_min = z;
+				row_max = z;
+			}
+		base_x = key_x(iter->first) * region_dim::CHUNK_WIDTH;
+		base_z = key_z(iter->first) * region_dim::CHUNK_WIDTH;
+		if(!found
+				|| base_x + __builtin_ctz(columns) < min_x)
+			min_x = base_x + __builtin_ctz(columns);
+		if(!found
+				|| base_x + 31 - __builtin_clz(columns) > max_x)
+			max_x = base_x + 31 - __builtin_clz(columns);
+		if(!found
+				|| base_z + row_min < min_z)
+			min_z = base_z + row_min;
+		if(!found
+				|| base_z + row_max > max_z)
+			max_z = base_z + row_max;
+		found = true;
+	}
+	return found;
+}
+
+/*
+ * Returns a chunk's header timestamp at a given chunk x, z coord (0 if not present)
+ */
+unsigned int chunk_index::get_modified(int x, int z) {
+	std::map<long long, region_entry>::iterator iter = regions.find(key(world::region_coord(x), world::region_coord(z)));
+
+	// check region
+	if(iter == regions.end())
+		return 0;
+	return iter->second.modified[world::local_coord(z, region_dim::CHUNK_WIDTH) * region_dim::CHUNK_WIDTH
+			+ world::local_coord(x, region_dim::CHUNK_WIDTH)];
+}
+
+/*
+ * Load an index from file (returns false if the file is missing or invalid)
+ */
+bool chunk_index::load(const std::string &path) {
+	int x, z;
+	region_entry entry;
+	std::vector<char> name;
+	unsigned long long size;
+	unsigned int magic, version, length, region_count;
+	std::ifstream file(path.c_str(), std::ios::in | std::ios::binary);
+
+	// check file & header (the index is a host byte order cache file, its
+	// directory name no longer than the rest of the file)
+	if(!file.is_open())
+		return false;
+	file.seekg(0, std::ios::end);
+	size = file.tellg();
+	file.seekg(0, std::ios::beg);
+	file.read((char *) &magic, sizeof(magic));
+	file.read((char *) &version, sizeof(version));
+	file.read((char *) &length, sizeof(length));
+	if(!file.good()
+			|| magic != MAGIC
+			|| version != VERSION
+			|| length > size - sizeof(magic) - sizeof(version) - sizeof(length))
+		return false;
+	name.resize(length);
+	file.read(name.data(), length);
+	file.read((char *) &region_count, sizeof(region_count));
+	if(!file.good())
+		return false;
+
+	// read regions into a fresh index
+	dir.assign(name.begin(), name.end());
+	regions.clear();
+	count = 0;
+	for(unsigned int i = 0; i < region_count; ++i) {
+		file.read((char *) &x, sizeof(x));
+		file.read((char *) &z, sizeof(z));
+		file.read((char *) &entry.file_time, sizeof(entry.file_time));
+		file.read((char *) entry.rows, sizeof(entry.rows));
+		file.read((char *) entry.modified, sizeof(entry.modified));
+		if(!file.good()) {
+			regions.clear();
+			count = 0;
+			return false;
+		}
+		entry.count = 0;
+		for(unsigned int j = 0; j < region_dim::CHUNK_WIDTH; ++j)
+			entry.count += __builtin_popcount(entry.rows[j]);
+		count += entry.count;
+		regions[key(x, z)] = entry;
+	}
+	return true;
+}
+
+/*
+ * Collect or count present chunks in an inclusive chunk coord rectangle
+ */
+unsigned int chunk_index::query(int min_x, int min_z, int max_x, int max_z, std::vector<coord> *chunks) {
+	long long area;
+	unsigned int found = 0, mask, bits;
+	int reg_min_x, reg_min_z, reg_max_x, reg_max_z, reg_x, reg_z, base_x, base_z, local_min_x, local_min_z, local_max_x, local_max_z;
+	std::vector<std::map<long long, region_entry>::iterator> hits;
+	std::map<long long, region_entry>::iterator iter;
+
+	// check for an empty rectangle
+	if(min_x > max_x
+			|| min_z > max_z)
+		return 0;
+	reg_min_x = world::region_coord(min_x);
+	reg_min_z = world::region_coord(min_z);
+	reg_max_x = world::region_coord(max_x);
+	reg_max_z = world::region_coord(max_z);
+
+	// probe each covered region for small rectangles, otherwise scan the indexed regions
+	area = ((long long) reg_max_x - reg_min_x + 1) * ((long long) reg_max_z - reg_min_z + 1);
+	if(area <= (long long) regions.size()) {
+		for(reg_z = reg_min_z; reg_z <= reg_max_z; ++reg_z)
+			for(reg_x = reg_min_x; reg_x <= reg_max_x; ++reg_x)
+				if((iter = regions.find(key(reg_x, reg_z))) != regions.end())
+					hits.push_back(iter);
+	} else
+		for(iter = regions.begin(); iter != regions.end(); ++iter)
+			if(key_x(iter->first) >= reg_min_x && key_x(iter->first) <= reg_max_x
+					&& key_z(iter->first) >= reg_min_z && key_z(iter->first) <= reg_max_z)
+				hits.push_back(iter);
+
+	// mask each region's rows against the rectangle
+	for(unsigned int i = 0; i < hits.size(); ++i) {
+		region_entry &entry = hits.at(i)->second;
+		if(!entry.count)
+			continue;
+		base_x = key_x(hits.at(i)->first) * region_dim::CHUNK_WIDTH;
+		base_z = key_z(hits.at(i)->first) * region_dim::CHUNK_WIDTH;
+		local_min_x = std::max(min_x - base_x, 0);
+		local_min_z = std::max(min_z - base_z, 0);
+		local_max_x = std::min(max_x - base_x, (int) region_dim::CHUNK_WIDTH - 1);
+		local_max_z = std::min(max_z - base_z, (int) region_dim::CHUNK_WIDTH - 1);
+		mask = row_mask(local_min_x, local_max_x);
+		for(int z = local_min_z; z <= local_max_z; ++z) {
+			bits = entry.rows[z] & mask;
+			if(!chunks) {
+				found += __builtin_popcount(bits);
+				continue;
+			}
+			for(; bits; bits &= bits - 1) {
+				chunks->push_back(coord(base_x + __builtin_ctz(bits), base_z + z));
+				++found;
+			}
+		}
+	}
+	return found;
+}
+
+/*
+ * Collect present chunks within a chunk radius of a given chunk x, z coord
+ */
+unsigned int chunk_index::query_radius(int x, int z, unsigned int radius, std::vector<coord> &chunks) {
+	long long dx, dz, limit = (long long) radius * radius;
+	size_t start = chunks.size(), pos = start, kept = start;
+
+	// collect the bounding square, then keep chunks within the circle
+	query(x - (int) radius, z - (int) radius, x + (int) radius, z + (int) radius, &chunks);
+	for(; pos < chunks.size(); ++pos) {
+		dx = chunks.at(pos).first - x;
+		dz = chunks.at(pos).second - z;
+		if(dx * dx + dz * dz <= limit)
+			chunks.at(kept++) = chunks.at(pos);
+	}
+	chunks.resize(kept);
+	return kept - start;
+}
+
+/*
+ * Re-read region headers whose files changed since the last build or refresh,
+ * returning the number of chunks added, removed or modified
+ */
+unsigned int chunk_index::refresh(void) {
+	int x, z;
+	long long file_time;
+	unsigned int changed = 0;
+	std::string path;
+	std::ifstream file;
+	region_header header;
+	std::set<long long> seen;
+	std::map<long long, region_entry>::iterator iter;
+
+	// check if region directory exists
+	if(!boost::filesystem::is_directory(dir))
+		throw std::runtime_error("Directory does not exist");
+
+	// re-read only the headers of region files modified since they were indexed
+	boost::filesystem::directory_iterator end, dir_iter(dir);
+	for(; dir_iter != end; ++dir_iter) {
+		path = dir_iter->path().string();
+		if(boost::filesystem::is_directory(*dir_iter)
+				|| !region_file::is_region_file(path, x, z))
+			continue;
+		file_time = boost::filesystem::last_write_time(dir_iter->path());
+		iter = regions.find(key(x, z));
+		if(iter != regions.end()
+				&& iter->second.file_time == file_time) {
+			seen.insert(iter->first);
+			continue;
+		}
+		file.clear();
+		file.open(path.c_str(), std::ios::in | std::ios::binary);
+		if(!file.is_open()
+				|| !header.read_data(file)) {
+			file.close();
+			continue;
+		}
+		file.close();
+		if(iter == regions.end()) {
+			iter = regions.insert(std::pair<long long, region_entry>(key(x, z), region_entry())).first;
+			memset(&iter->second, 0, sizeof(region_entry));
+		}
+		changed += update_region(iter->second, header);
+		iter->second.file_time = file_time;
+		seen.insert(iter->first);
+	}
+
+	// drop regions whose files were removed or became unreadable
+	for(iter = regions.begin(); iter != regions.end();)
+		if(!seen.count(iter->first)) {
+			changed += iter->second.count;
+			count -= iter->second.count;
+			regions.erase(iter++);
+		} else
+			++iter;
+	return changed;
+}
+
+/*
+ * Returns a bit mask covering local chunk x coords [min, max]
+ */
+unsigned int chunk_index::row_mask(unsigned int min, unsigned int max) {
+	unsigned int mask = (max >= region_dim::CHUNK_WIDTH - 1) ? 0xffffffff : (1u << (max + 1)) - 1;
+
+	// clear bits below the minimum
+	return mask & ~((1u << min) - 1);
+}
+
+/*
+ * Save an index to file
+ */
+void chunk_index::save(const std::string &path) {
+	int x, z;
+	unsigned int magic = MAGIC, version = VERSION, length = dir.size(), region_count = regions.size();
+	std::map<long long, region_entry>::iterator iter;
+	std::ofstream file(path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+
+	// check file
+	if(!file.is_open())
+		throw std::runtime_error("Failed to open output file");
+
+	// write header, directory & regions
+	file.write((char *) &magic, sizeof(magic));
+	file.write((char *) &version, sizeof(version));
+	file.write((char *) &length, sizeof(length));
+	file.write(dir.data(), length);
+	file.write((char *) &region_count, sizeof(region_count));
+	for(iter = regions.begin(); iter != regions.end(); ++iter) {
+		x = key_x(iter->first);
+		z = key_z(iter->first);
+		file.write((char *) &x, sizeof(x));
+		file.write((char *) &z, sizeof(z));
+		file.write((char *) &iter->second.file_time, sizeof(iter->second.file_time));
+		file.write((char *) iter->second.rows, sizeof(iter->second.rows));
+		file.write((char *) iter->second.modified, sizeof(iter->second.modified));
+	}
+	if(!file.good())
+		throw std::runtime_error("Failed to write index file");
+	file.close();
+}
+
+/*
+ * Returns a string representation of a chunk index
+ */
+std::string chunk_index::to_string(void) {
+	std::stringstream ss;
+
+	// form string representation
+	ss << "Path: " << dir << ", regions: " << regions.size() << ", chunks: " << count;
+	return ss.str();
+}
+
+/*
+ * Update a region entry from its header, returning the number of changed chunks
+ */
+unsigned int chunk_index::update_region(region_entry &entry, region_header &header) {
+	bool present, was_present;
+	unsigned int changed = 0, x, z;
+
+	// diff each chunk's presence & timestamp against the indexed state
+	count -= entry.count;
+	entry.count = 0;
+	for(unsigned int i = 0; i < region_dim::CHUNK_COUNT; ++i) {
+		chunk_info &info = header.get_info_at(i);
+		x = i % region_dim::CHUNK_WIDTH;
+		z = i / region_dim::CHUNK_WIDTH;
+		present = !info.empty() && info.get_sector_count();
+		was_present = (entry.rows[z] >> x) & 1;
+		if(present != was_present
+				|| (present && info.get_modified() != entry.modified[i]))
+			++changed;
+		if(present) {
+			entry.rows[z] |= 1u << x;
+			entry.modified[i] = info.get_modified();
+			++entry.count;
+		} else {
+			entry.rows[z] &= ~(1u << x);
+			entry.modified[i] = 0;
+		}
+	}
+	count += entry.count;
+	return changed;
+}
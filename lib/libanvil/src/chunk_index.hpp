@@ -0,0 +1,198 @@
+/*
+ * chunk_index.hpp
+ * Copyright (C) 2012 David Jolly
+ * ----------------------
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CHUNK_INDEX_HPP_
+#define CHUNK_INDEX_HPP_
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+#include "region_dim.hpp"
+#include "region_header.hpp"
+
+class chunk_index {
+public:
+
+	/*
+	 * Chunk coord (x, z)
+	 */
+	typedef std::pair<int, int> coord;
+
+private:
+
+	/*
+	 * Index file magic & version
+	 */
+	static const unsigned int MAGIC = 0x43494458;
+	static const unsigned int VERSION = 1;
+
+	/*
+	 * Per-region presence bitmap (one row word per chunk z, one bit per
+	 * chunk x) & header timestamps
+	 */
+	class region_entry {
+	public:
+		unsigned int rows[region_dim::CHUNK_WIDTH];
+		unsigned int modified[region_dim::CHUNK_COUNT];
+		long long file_time;
+		unsigned int count;
+	};
+
+	/*
+	 * Indexed region directory
+	 */
+	std::string dir;
+
+	/*
+	 * Indexed regions, keyed by region coord
+	 */
+	std::map<long long, region_entry> regions;
+
+	/*
+	 * Present chunk count
+	 */
+	unsigned int count;
+
+	/*
+	 * Chunk index constructor (non-copyable)
+	 */
+	chunk_index(const chunk_index &other);
+
+	/*
+	 * Chunk index assignment operator (non-copyable)
+	 */
+	chunk_index &operator=(const chunk_index &other);
+
+	/*
+	 * Returns a region map key from a region coord
+	 */
+	static long long key(int x, int z) { return (long long) (((unsigned long long) (unsigned int) x << 32) | (unsigned int) z); }
+
+	/*
+	 * Returns a region coord from a region map key
+	 */
+	static int key_x(long long key) { return (int) (key >> 32); }
+	static int key_z(long long key) { return (int) (unsigned int) key; }
+
+	/*
+	 * Returns a bit mask covering local chunk x coords [min, max]
+	 */
+	static unsigned int row_mask(unsigned int min, unsigned int max);
+
+	/*
+	 * Collect or count present chunks in an inclusive chunk coord rectangle
+	 */
+	unsigned int query(int min_x, int min_z, int max_x, int max_z, std::vector<coord> *chunks);
+
+	/*
+	 * Update a region entry from its header, returning the number of changed chunks
+	 */
+	unsigned int update_region(region_entry &entry, region_header &header);
+
+public:
+
+	/*
+	 * Chunk index constructor
+	 */
+	chunk_index(void) : count(0) { return; }
+
+	/*
+	 * Chunk index constructor
+	 */
+	chunk_index(const std::string &dir);
+
+	/*
+	 * Chunk index destructor
+	 */
+	virtual ~chunk_index(void) { return; }
+
+	/*
+	 * Build an index from every region header in a directory
+	 */
+	void build(const std::string &dir);
+
+	/*
+	 * Returns true if a chunk at a given chunk x, z coord is present
+	 */
+	bool contains(int x, int z);
+
+	/*
+	 * Returns the number of present chunks in an inclusive chunk coord rectangle
+	 */
+	unsigned int count_rect(int min_x, int min_z, int max_x, int max_z) { return query(min_x, min_z, max_x, max_z, NULL); }
+
+	/*
+	 * Returns the bounding box of all present chunks (false if the index is empty)
+	 */
+	bool get_bounds(int &min_x, int &min_z, int &max_x, int &max_z);
+
+	/*
+	 * Returns a chunk index's present chunk count
+	 */
+	unsigned int get_count(void) { return count; }
+
+	/*
+	 * Returns an indexed directory
+	 */
+	const std::string &get_dir(void) { return dir; }
+
+	/*
+	 * Returns a chunk's header timestamp at a given chunk x, z coord (0 if not present)
+	 */
+	unsigned int get_modified(int x, int z);
+
+	/*
+	 * Returns a chunk index's region count
+	 */
+	size_t get_region_count(void) { return regions.size(); }
+
+	/*
+	 * Load an index from file (returns false if the file is missing or invalid)
+	 */
+	bool load(const std::string &path);
+
+	/*
+	 * Collect present chunks within a chunk radius of a given chunk x, z coord
+	 */
+	unsigned int query_radius(int x, int z, unsigned int radius, std::vector<coord> &chunks);
+
+	/*
+	 * Collect present chunks in an inclusive chunk coord rectangle
+	 */
+	unsigned int query_rect(int min_x, int min_z, int max_x, int max_z, std::vector<coord> &chunks) { return query(min_x, min_z, max_x, max_z, &chunks); }
+
+	/*
+	 * Re-read region headers whose files changed since the last build or refresh,
+	 * returning the number of chunks added, removed or modified
+	 */
+	unsigned int refresh(void);
+
+	/*
+	 * Save an index to file
+	 */
+	void save(const std::string &path);
+
+	/*
+	 * Returns a string representation of a chunk index
+	 */
+	std::string to_string(void);
+};
+
+#endif
@@ -97,6 +97,16 @@ public:
 	 */
 	unsigned int get_offset(void) { return offset; }
 
+	/*
+	 * Return a chunk's first sector (raw header offsets only)
+	 */
+	unsigned int get_sector(void) { return offset >> 8; }
+
+	/*
+	 * Return a chunk's sector count (raw header offsets only)
+	 */
+	unsigned int get_sector_count(void) { return offset & 0xff; }
+
 	/*
 	 * Return a chunk's compression type
 	 */
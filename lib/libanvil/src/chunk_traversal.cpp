@@ -0,0 +1,194 @@
+/*
+ * chunk_traversal.cpp
+ * Copyright (C) 2012 David Jolly
+ * ----------------------
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <fstream>
+#include <stdexcept>
+#include <thread>
+#include "chunk_traversal.hpp"
+#include "decode_context.hpp"
+#include "region_dim.hpp"
+#include "region_file.hpp"
+#include "region_file_reader.hpp"
+#include "region_header.hpp"
+
+/*
+ * Chunk traversal destructor
+ */
+chunk_traversal::~chunk_traversal(void) {
+	for(unsigned int i = 0; i < queues.size(); ++i)
+		delete queues.at(i);
+}
+
+/*
+ * Collect chunk tasks from every region header in a directory
+ */
+void chunk_traversal::collect(const std::string &dir, std::vector<task> &tasks) {
+	task tsk;
+	int x, z;
+	std::ifstream file;
+	region_header header;
+	std::vector<std::string> files;
+
+	// collect region files in a stable order
+	region_file::list_region_files(dir, files);
+
+	// read each header, keeping chunks within the requested bounds
+	for(unsigned int i = 0; i < files.size(); ++i) {
+		region_file::is_region_file(files.at(i), x, z);
+		if(opt.bounded
+				&& (x * (int) region_dim::CHUNK_WIDTH > opt.max_x
+				|| (x + 1) * (int) region_dim::CHUNK_WIDTH <= opt.min_x
+				|| z * (int) region_dim::CHUNK_WIDTH > opt.max_z
+				|| (z + 1) * (int) region_dim::CHUNK_WIDTH <= opt.min_z))
+			continue;
+		file.clear();
+		file.open(files.at(i).c_str(), std::ios::in | std::ios::binary);
+		if(!file.is_open()
+				|| !header.read_data(file)) {
+			file.close();
+			visitor.error(x * region_dim::CHUNK_WIDTH, z * region_dim::CHUNK_WIDTH, "Failed to read region header", 0);
+			continue;
+		}
+		file.close();
+		paths.push_back(files.at(i));
+		for(unsigned int j = 0; j < region_dim::CHUNK_COUNT; ++j) {
+			chunk_info &info = header.get_info_at(j);
+			if(info.empty()
+					|| !info.get_sector_count())
+				continue;
+			tsk.region = paths.size() - 1;
+			tsk.sector = info.get_sector();
+			tsk.count = info.get_sector_count();
+			tsk.modified = info.get_modified();
+			tsk.x = x * region_dim::CHUNK_WIDTH + (j % region_dim::CHUNK_WIDTH);
+			tsk.z = z * region_dim::CHUNK_WIDTH + (j / region_dim::CHUNK_WIDTH);
+			if(tsk.modified < opt.min_modified
+					|| tsk.modified > opt.max_modified
+					|| (opt.bounded
+					&& (tsk.x < opt.min_x || tsk.x > opt.max_x
+					|| tsk.z < opt.min_z || tsk.z > opt.max_z)))
+				continue;
+			tasks.push_back(tsk);
+		}
+	}
+}
+
+/*
+ * Visit every chunk in a region file directory in parallel, returning
+ * the number of chunks visited
+ */
+unsigned int chunk_traversal::for_each_chunk(const std::string &dir, chunk_visitor &visitor, const options &opt) {
+	size_t pos = 0, span;
+	unsigned int threads;
+	std::vector<task> tasks;
+	std::vector<std::thread> workers;
+	chunk_traversal trav(visitor, opt);
+
+	// collect work
+	trav.collect(dir, tasks);
+	if(tasks.empty())
+		return 0;
+
+	// deal contiguous runs to each worker, so neighboring chunks share a file
+	threads = region_file::get_thread_count(opt.threads, tasks.size());
+	for(unsigned int i = 0; i < threads; ++i) {
+		trav.queues.push_back(new task_queue);
+		span = (tasks.size() - pos) / (threads - i);
+		trav.queues.back()->tasks.assign(tasks.begin() + pos, tasks.begin() + pos + span);
+		pos += span;
+	}
+
+	// run workers (the calling thread acts as worker zero)
+	for(unsigned int i = 1; i < threads; ++i)
+		workers.push_back(std::thread(&chunk_traversal::run, &trav, i));
+	trav.run(0);
+	for(unsigned int i = 0; i < workers.size(); ++i)
+		workers.at(i).join();
+	return trav.visited;
+}
+
+/*
+ * Pop a task from a worker's own queue, stealing from others when empty
+ */
+bool chunk_traversal::next(unsigned int worker, task &tsk) {
+	size_t half;
+	task_queue *own = queues.at(worker), *victim;
+
+	// pop from the front of our own queue
+	own->lock.lock();
+	if(!own->tasks.empty()) {
+		tsk = own->tasks.front();
+		own->tasks.pop_front();
+		own->lock.unlock();
+		return true;
+	}
+	own->lock.unlock();
+
+	// steal the back half of another worker's queue (no new tasks are ever
+	// produced, so finding every queue empty means the traversal is done)
+	for(unsigned int i = 1; i < queues.size(); ++i) {
+		victim = queues.at((worker + i) % queues.size());
+		victim->lock.lock();
+		if(victim->tasks.empty()) {
+			victim->lock.unlock();
+			continue;
+		}
+		half = (victim->tasks.size() + 1) / 2;
+		std::deque<task> stolen(victim->tasks.end() - half, victim->tasks.end());
+		victim->tasks.erase(victim->tasks.end() - half, victim->tasks.end());
+		victim->lock.unlock();
+		tsk = stolen.front();
+		stolen.pop_front();
+		own->lock.lock();
+		own->tasks.insert(own->tasks.end(), stolen.begin(), stolen.end());
+		own->lock.unlock();
+		return true;
+	}
+	return false;
+}
+
+/*
+ * Worker thread entry point
+ */
+void chunk_traversal::run(unsigned int worker) {
+	task tsk;
+	chunk_tag tag;
+	unsigned int count = 0;
+	decode_context context;
+	const std::set<std::string> *projection = opt.projection.empty() ? NULL : &opt.projection;
+
+	// decode & visit chunks until no work remains
+	while(next(worker, tsk)) {
+		try {
+			std::vector<char> &data = context.read_chunk(paths.at(tsk.region), tsk.sector, tsk.count);
+			region_file_reader::parse_chunk_tag(data, tag, projection);
+			visitor.visit(tsk.x, tsk.z, tag, tsk.modified, worker);
+			++count;
+		} catch(std::exception &exc) {
+			visitor.error(tsk.x, tsk.z, exc.what(), worker);
+		}
+		tag.clean_root();
+		tag = chunk_tag();
+	}
+
+	// record visited chunks
+	visited_lock.lock();
+	visited += count;
+	visited_lock.unlock();
+}
@@ -0,0 +1,167 @@
+/*
+ * chunk_traversal.hpp
+ * Copyright (C) 2012 David Jolly
+ * ----------------------
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CHUNK_TRAVERSAL_HPP_
+#define CHUNK_TRAVERSAL_HPP_
+
+#include <climits>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+#include "chunk_visitor.hpp"
+
+class chunk_traversal {
+public:
+
+	/*
+	 * Traversal options
+	 */
+	class options {
+	public:
+
+		/*
+		 * Worker thread count (0 uses the hardware concurrency)
+		 */
+		unsigned int threads;
+
+		/*
+		 * Leaf tag names to parse (empty parses every tag)
+		 */
+		std::set<std::string> projection;
+
+		/*
+		 * Inclusive chunk coord bounds (only used when bounded)
+		 */
+		bool bounded;
+		int min_x, min_z, max_x, max_z;
+
+		/*
+		 * Inclusive header timestamp bounds
+		 */
+		unsigned int min_modified, max_modified;
+
+		/*
+		 * Options constructor
+		 */
+		options(void) : threads(0), bounded(false), min_x(0), min_z(0), max_x(0), max_z(0), min_modified(0), max_modified(UINT_MAX) { return; }
+
+		/*
+		 * Restrict traversal to an inclusive chunk coord rectangle
+		 */
+		void set_bounds(int min_x, int min_z, int max_x, int max_z) {
+			bounded = true;
+			this->min_x = min_x;
+			this->min_z = min_z;
+			this->max_x = max_x;
+			this->max_z = max_z;
+		}
+
+		/*
+		 * Restrict traversal to chunks modified within an inclusive range
+		 */
+		void set_modified(unsigned int min_modified, unsigned int max_modified) {
+			this->min_modified = min_modified;
+			this->max_modified = max_modified;
+		}
+	};
+
+private:
+
+	/*
+	 * Chunk work item
+	 */
+	class task {
+	public:
+		unsigned int region, sector, count, modified;
+		int x, z;
+	};
+
+	/*
+	 * Per-worker task queue (owner pops the front, thieves take the back)
+	 */
+	class task_queue {
+	public:
+		std::deque<task> tasks;
+		std::mutex lock;
+	};
+
+	/*
+	 * Traversal region file paths
+	 */
+	std::vector<std::string> paths;
+
+	/*
+	 * Worker task queues
+	 */
+	std::vector<task_queue *> queues;
+
+	/*
+	 * Traversal visitor & options
+	 */
+	chunk_visitor &visitor;
+	const options &opt;
+
+	/*
+	 * Visited chunk count
+	 */
+	unsigned int visited;
+	std::mutex visited_lock;
+
+	/*
+	 * Chunk traversal constructor
+	 */
+	chunk_traversal(chunk_visitor &visitor, const options &opt) : visitor(visitor), opt(opt), visited(0) { return; }
+
+	/*
+	 * Chunk traversal destructor
+	 */
+	~chunk_traversal(void);
+
+	/*
+	 * Collect chunk tasks from every region header in a directory
+	 */
+	void collect(const std::string &dir, std::vector<task> &tasks);
+
+	/*
+	 * Pop a task from a worker's own queue, stealing from others when empty
+	 */
+	bool next(unsigned int worker, task &tsk);
+
+	/*
+	 * Worker thread entry point
+	 */
+	void run(unsigned int worker);
+
+public:
+
+	/*
+	 * Visit every chunk in a region file directory in parallel, returning
+	 * the number of chunks visited
+	 */
+	static unsigned int for_each_chunk(const std::string &dir, chunk_visitor &visitor, const options &opt);
+
+	/*
+	 * Visit every chunk in a region file directory in parallel (default options)
+	 */
+	static unsigned int for_each_chunk(const std::string &dir, chunk_visitor &visitor) { return for_each_chunk(dir, visitor, options()); }
+};
+
+#endif
@@ -0,0 +1,47 @@
+/*
+ * chunk_visitor.hpp
+ * Copyright (C) 2012 David Jolly
+ * ----------------------
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CHUNK_VISITOR_HPP_
+#define CHUNK_VISITOR_HPP_
+
+#include <string>
+#include "chunk_tag.hpp"
+
+class chunk_visitor {
+public:
+
+	/*
+	 * Chunk visitor destructor
+	 */
+	virtual ~chunk_visitor(void) { return; }
+
+	/*
+	 * Called for a chunk that failed to read, inflate or parse
+	 * (called concurrently from worker threads)
+	 */
+	virtual void error(int /* x */, int /* z */, const std::string & /* what */, unsigned int /* worker */) { return; }
+
+	/*
+	 * Called for each chunk at a given chunk x, z coord; the tag is released
+	 * once visit returns (called concurrently from worker threads)
+	 */
+	virtual void visit(int x, int z, chunk_tag &tag, unsigned int modified, unsigned int worker) = 0;
+};
+
+#endif
@@ -0,0 +1,219 @@
+/*
+ * compact_chunk.cpp
+ * Copyright (C) 2012 David Jolly
+ * ----------------------
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <sstream>
+#include <stdexcept>
+#include "compact_chunk.hpp"
+#include "tag/byte_tag.hpp"
+#include "tag/byte_array_tag.hpp"
+#include "tag/compound_tag.hpp"
+#include "tag/int_array_tag.hpp"
+#include "tag/list_tag.hpp"
+
+/*
+ * Compact chunk constructor
+ */
+compact_chunk::compact_chunk(const compact_chunk &other) : biomes(other.biomes), heights(other.heights), section_count(other.section_count) {
+
+	// assign attributes
+	for(unsigned int i = 0; i < region_dim::SECTION_COUNT; ++i)
+		sections[i] = other.sections[i];
+}
+
+/*
+ * Compact chunk assignment operator
+ */
+compact_chunk &compact_chunk::operator=(const compact_chunk &other) {
+
+	// check for self
+	if(this == &other)
+		return *this;
+
+	// assign attributes
+	biomes = other.biomes;
+	heights = other.heights;
+	for(unsigned int i = 0; i < region_dim::SECTION_COUNT; ++i)
+		sections[i] = other.sections[i];
+	section_count = other.section_count;
+	return *this;
+}
+
+/*
+ * Compact chunk equals operator
+ */
+bool compact_chunk::operator==(const compact_chunk &other) {
+
+	// check for self
+	if(this == &other)
+		return true;
+
+	// check attributes
+	if(biomes != other.biomes
+			|| heights != other.heights
+			|| section_count != other.section_count)
+		return false;
+	for(unsigned int i = 0; i < section_count; ++i)
+		if(sections[i] != other.sections[i])
+			return false;
+	return true;
+}
+
+/*
+ * Returns a biome value at a given b coord
+ */
+char compact_chunk::get_biome_at(unsigned int b_x, unsigned int b_z) const {
+	unsigned int b_pos = b_z * region_dim::BLOCK_WIDTH + b_x;
+
+	// check coordinates
+	if(b_pos >= region_dim::BLOCK_COUNT)
+		throw std::out_of_range("coordinates out-of-range");
+	if(biomes.empty())
+		return 0;
+	return biomes[b_pos];
+}
+
+/*
+ * Returns a block value at a given b coord
+ */
+int compact_chunk::get_block_at(unsigned int b_x, unsigned int b_y, unsigned int b_z) const {
+	unsigned int sect = b_y / region_dim::BLOCK_WIDTH;
+
+	// check coordinates
+	if(b_x >= region_dim::BLOCK_WIDTH
+			|| b_z >= region_dim::BLOCK_WIDTH
+			|| b_y >= region_dim::BLOCK_HEIGHT)
+		throw std::out_of_range("coordinates out-of-range");
+
+	// return an air block above the highest section
+	if(sect >= section_count)
+		return 0;
+	return sections[sect].at(b_x, b_y % region_dim::BLOCK_WIDTH, b_z);
+}
+
+/*
+ * Unpack a compact chunk's blocks (missing sections are filled with air)
+ */
+void compact_chunk::get_blocks(std::vector<int> &blocks) const {
+	blocks.clear();
+	blocks.reserve(section_count * region_dim::SECTION_BLOCK_COUNT);
+	for(unsigned int i = 0; i < section_count; ++i)
+		sections[i].unpack(blocks);
+}
+
+/*
+ * Returns a height value at a given b coord
+ */
+int compact_chunk::get_height_at(unsigned int b_x, unsigned int b_z) const {
+	unsigned int b_pos = b_z * region_dim::BLOCK_WIDTH + b_x;
+
+	// check coordinates
+	if(b_pos >= region_dim::BLOCK_COUNT)
+		throw std::out_of_range("coordinates out-of-range");
+	if(heights.empty())
+		return 0;
+	return heights[b_pos];
+}
+
+/*
+ * Returns a compact chunk's in-memory size in bytes
+ */
+size_t compact_chunk::get_size(void) const {
+	size_t size = sizeof(*this) + biomes.capacity() + heights.capacity() * sizeof(unsigned short);
+
+	// palette sections are stored inline, only count their heap data
+	for(unsigned int i = 0; i < region_dim::SECTION_COUNT; ++i)
+		size += sections[i].get_size() - sizeof(palette_section);
+	return size;
+}
+
+/*
+ * Pack a compact chunk from a chunk tag
+ */
+void compact_chunk::pack(chunk_tag &tag) {
+	compound_tag *level;
+	generic_tag *sub_tag;
+	unsigned int y;
+
+	// clear old data
+	biomes.clear();
+	heights.clear();
+	for(unsigned int i = 0; i < region_dim::SECTION_COUNT; ++i)
+		sections[i] = palette_section();
+	section_count = 0;
+
+	// locate level tag
+	sub_tag = tag.get_root_tag().find("Level");
+	if(!sub_tag
+			|| sub_tag->get_type() != generic_tag::COMPOUND)
+		return;
+	level = static_cast<compound_tag *>(sub_tag);
+
+	// copy biomes
+	sub_tag = level->find("Biomes");
+	if(sub_tag
+			&& sub_tag->get_type() == generic_tag::BYTE_ARRAY)
+		biomes = static_cast<byte_array_tag *>(sub_tag)->get_value();
+
+	// narrow height map (heights never exceed BLOCK_HEIGHT)
+	sub_tag = level->find("HeightMap");
+	if(sub_tag
+			&& sub_tag->get_type() == generic_tag::INT_ARRAY) {
+		std::vector<int> &value = static_cast<int_array_tag *>(sub_tag)->get_value();
+		heights.assign(value.begin(), value.end());
+	}
+
+	// pack each section into its palette form
+	sub_tag = level->find("Sections");
+	if(!sub_tag
+			|| sub_tag->get_type() != generic_tag::LIST)
+		return;
+	list_tag *sect_list = static_cast<list_tag *>(sub_tag);
+	for(unsigned int i = 0; i < sect_list->size(); ++i) {
+		if(sect_list->at(i)->get_type() != generic_tag::COMPOUND)
+			continue;
+		compound_tag *sect = static_cast<compound_tag *>(sect_list->at(i));
+		generic_tag *y_tag = sect->find("Y"), *blocks = sect->find("Blocks"), *add = sect->find("Add");
+		if(!y_tag
+				|| y_tag->get_type() != generic_tag::BYTE
+				|| !blocks
+				|| blocks->get_type() != generic_tag::BYTE_ARRAY)
+			continue;
+		y = (unsigned char) static_cast<byte_tag *>(y_tag)->get_value();
+		if(y >= region_dim::SECTION_COUNT)
+			throw std::runtime_error("Section out-of-range");
+		if(add
+				&& add->get_type() == generic_tag::BYTE_ARRAY)
+			sections[y].pack(static_cast<byte_array_tag *>(blocks)->get_value(), &static_cast<byte_array_tag *>(add)->get_value());
+		else
+			sections[y].pack(static_cast<byte_array_tag *>(blocks)->get_value(), NULL);
+		if(y + 1 > section_count)
+			section_count = y + 1;
+	}
+}
+
+/*
+ * Returns a string representation of a compact chunk
+ */
+std::string compact_chunk::to_string(void) const {
+	std::stringstream ss;
+
+	// form string representation
+	ss << "Sections: " << section_count << ", size: " << get_size();
+	return ss.str();
+}
@@ -0,0 +1,150 @@
+/*
+ * compact_chunk.hpp
+ * Copyright (C) 2012 David Jolly
+ * ----------------------
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef COMPACT_CHUNK_HPP_
+#define COMPACT_CHUNK_HPP_
+
+#include <string>
+#include <vector>
+#include "chunk_tag.hpp"
+#include "palette_section.hpp"
+#include "region_dim.hpp"
+
+class compact_chunk {
+private:
+
+	/*
+	 * Chunk biomes
+	 */
+	std::vector<char> biomes;
+
+	/*
+	 * Chunk height map
+	 */
+	std::vector<unsigned short> heights;
+
+	/*
+	 * Chunk sections (indexed by section y coord)
+	 */
+	palette_section sections[region_dim::SECTION_COUNT];
+
+	/*
+	 * Chunk section count (highest present section + 1)
+	 */
+	unsigned int section_count;
+
+public:
+
+	/*
+	 * Compact chunk constructor
+	 */
+	compact_chunk(void) : section_count(0) { return; }
+
+	/*
+	 * Compact chunk constructor
+	 */
+	compact_chunk(const compact_chunk &other);
+
+	/*
+	 * Compact chunk constructor
+	 */
+	compact_chunk(chunk_tag &tag) : section_count(0) { pack(tag); }
+
+	/*
+	 * Compact chunk destructor
+	 */
+	virtual ~compact_chunk(void) { return; }
+
+	/*
+	 * Compact chunk assignment operator
+	 */
+	compact_chunk &operator=(const compact_chunk &other);
+
+	/*
+	 * Compact chunk equals operator
+	 */
+	bool operator==(const compact_chunk &other);
+
+	/*
+	 * Compact chunk not-equals operator
+	 */
+	bool operator!=(const compact_chunk &other) { return !(*this == other); }
+
+	/*
+	 * Returns a compact chunk's empty status
+	 */
+	bool empty(void) const { return !section_count; }
+
+	/*
+	 * Returns a biome value at a given b coord
+	 */
+	char get_biome_at(unsigned int b_x, unsigned int b_z) const;
+
+	/*
+	 * Returns a compact chunk's biomes
+	 */
+	const std::vector<char> &get_biomes(void) const { return biomes; }
+
+	/*
+	 * Returns a block value at a given b coord
+	 */
+	int get_block_at(unsigned int b_x, unsigned int b_y, unsigned int b_z) const;
+
+	/*
+	 * Unpack a compact chunk's blocks (missing sections are filled with air)
+	 */
+	void get_blocks(std::vector<int> &blocks) const;
+
+	/*
+	 * Returns a height value at a given b coord
+	 */
+	int get_height_at(unsigned int b_x, unsigned int b_z) const;
+
+	/*
+	 * Returns a compact chunk's height map
+	 */
+	std::vector<int> get_heightmap(void) const { return std::vector<int>(heights.begin(), heights.end()); }
+
+	/*
+	 * Returns a compact chunk's section at a given section y coord
+	 */
+	const palette_section &get_section(unsigned int y) const { return sections[y]; }
+
+	/*
+	 * Returns a compact chunk's section count
+	 */
+	unsigned int get_section_count(void) const { return section_count; }
+
+	/*
+	 * Returns a compact chunk's in-memory size in bytes
+	 */
+	size_t get_size(void) const;
+
+	/*
+	 * Pack a compact chunk from a chunk tag
+	 */
+	void pack(chunk_tag &tag);
+
+	/*
+	 * Returns a string representation of a compact chunk
+	 */
+	std::string to_string(void) const;
+};
+
+#endif
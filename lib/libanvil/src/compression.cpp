@@ -22,30 +22,25 @@
 #include "compression.hpp"
 
 /*
- * Deflate a char buffer
+ * Deflate a char buffer at a given level (0-9)
  */
-bool compression::deflate_(std::vector<char> &data) {
+bool compression::deflate_(std::vector<char> &data, int level) {
 	int ret;
 	z_stream zs;
-	char buff[SEG_SIZE];
 	std::vector<char> out_data;
 
 	// initialize zlib structure
 	memset(&zs, 0, sizeof(zs));
-	if(deflateInit(&zs, Z_BEST_COMPRESSION) != Z_OK)
+	if(deflateInit(&zs, level) != Z_OK)
 		return false;
 	zs.next_in = (Bytef *) data.data();
 	zs.avail_in = data.size();
 
-	// deflate blocks
-	do {
-		zs.next_out = reinterpret_cast<Bytef *>(buff);
-		zs.avail_out = SEG_SIZE;
-
-		// deflate data and place in out_data
-		ret = deflate(&zs, Z_FINISH);
-		out_data.insert(out_data.end(), buff, buff + zs.total_out);
-	} while(ret == Z_OK);
+	// deflate in a single call into a buffer sized to the worst case
+	out_data.resize(deflateBound(&zs, data.size()));
+	zs.next_out = reinterpret_cast<Bytef *>(out_data.data());
+	zs.avail_out = out_data.size();
+	ret = deflate(&zs, Z_FINISH);
 
 	// check for errors
 	deflateEnd(&zs);
@@ -53,7 +48,8 @@ bool compression::deflate_(std::vector<char> &data) {
 		return false;
 
 	// assign to data
-	data = out_data;
+	out_data.resize(zs.total_out);
+	data.swap(out_data);
 	return true;
 }
 
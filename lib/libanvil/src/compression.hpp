@@ -30,10 +30,20 @@ public:
 	 */
 	static const unsigned int SEG_SIZE = 16384;
 
+	/*
+	 * Default deflate level
+	 */
+	static const int DEF_LEVEL = 9;
+
 	/*
 	 * Deflate a char buffer
 	 */
-	static bool deflate_(std::vector<char> &data);
+	static bool deflate_(std::vector<char> &data) { return deflate_(data, DEF_LEVEL); }
+
+	/*
+	 * Deflate a char buffer at a given level (0-9)
+	 */
+	static bool deflate_(std::vector<char> &data, int level);
 
 	/*
 	 * Inflate a char buffer
@@ -0,0 +1,136 @@
+/*
+ * decode_context.cpp
+ * Copyright (C) 2012 David Jolly
+ * ----------------------
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstring>
+#include <stdexcept>
+#include "chunk_info.hpp"
+#include "compression.hpp"
+#include "decode_context.hpp"
+#include "region_dim.hpp"
+
+/*
+ * Decode context constructor
+ */
+decode_context::decode_context(void) {
+
+	// initialize zlib structure (window bits 15 + 32 accepts zlib & gzip headers)
+	memset(&zs, 0, sizeof(zs));
+	if(inflateInit2(&zs, 15 + 32) != Z_OK)
+		throw std::runtime_error("Failed to initialize inflate stream");
+}
+
+/*
+ * Decode context destructor
+ */
+decode_context::~decode_context(void) {
+	inflateEnd(&zs);
+	file.close();
+}
+
+/*
+ * Inflate a zlib or gzip buffer into the inflated buffer
+ */
+bool decode_context::inflate_(const char *in, size_t length) {
+	int ret;
+	size_t pos = 0;
+
+	// reuse the stream & output buffer from previous chunks
+	if(inflateReset(&zs) != Z_OK)
+		return false;
+	if(data.size() < compression::SEG_SIZE)
+		data.resize(compression::SEG_SIZE);
+	zs.next_in = (Bytef *) in;
+	zs.avail_in = length;
+
+	// inflate blocks, growing the output buffer as needed
+	do {
+		if(pos == data.size())
+			data.resize(data.size() * 2);
+		zs.next_out = reinterpret_cast<Bytef *>(&data[pos]);
+		zs.avail_out = data.size() - pos;
+		ret = inflate(&zs, Z_NO_FLUSH);
+		pos = data.size() - zs.avail_out;
+	} while(ret == Z_OK);
+
+	// check for errors
+	if(ret != Z_STREAM_END) {
+		data.clear();
+		return false;
+	}
+	data.resize(pos);
+	return true;
+}
+
+/*
+ * Reads & inflates a chunk stored at a given sector offset & count
+ */
+std::vector<char> &decode_context::read_chunk(const std::string &path, unsigned int sector, unsigned int count) {
+	char type = read_raw(path, sector, count);
+
+	// check for compression type
+	if(type != chunk_info::GZIP
+			&& type != chunk_info::ZLIB)
+		throw std::runtime_error("Unknown compression type");
+	if(!inflate_(raw.data(), raw.size()))
+		throw std::runtime_error("Failed to inflate chunk");
+	return data;
+}
+
+/*
+ * Reads a chunk's raw (compressed) payload at a given sector offset & count,
+ * returning its compression type
+ */
+char decode_context::read_raw(const std::string &path, unsigned int sector, unsigned int count) {
+	unsigned int length;
+	unsigned char prefix[sizeof(int) + sizeof(char)];
+
+	// switch files only when moving to a new region
+	if(path != this->path
+			|| !file.is_open()) {
+		file.close();
+		file.clear();
+		file.open(path.c_str(), std::ios::in | std::ios::binary);
+		if(!file.is_open())
+			throw std::runtime_error("Failed to open input file");
+		this->path = path;
+	}
+
+	// read every sector of the chunk in one call
+	raw.resize(count * region_dim::SECTOR_SIZE);
+	file.clear();
+	file.seekg((std::streamoff) sector * region_dim::SECTOR_SIZE, std::ios::beg);
+	file.read(raw.data(), raw.size());
+	if(file.gcount() < (std::streamsize) sizeof(prefix))
+		throw std::runtime_error("Failed to read chunk data");
+	raw.resize(file.gcount());
+
+	// strip big-endian length & compression type prefix
+	memcpy(prefix, raw.data(), sizeof(prefix));
+	length = (prefix[0] << 24) | (prefix[1] << 16) | (prefix[2] << 8) | prefix[3];
+	if(!length
+			|| length - 1 > raw.size() - sizeof(prefix))
+		throw std::runtime_error("Malformed chunk length");
+	raw.erase(raw.begin(), raw.begin() + sizeof(prefix));
+
+	// the length should count the type byte, but older writers omitted it,
+	// so keep one extra byte when available (inflate ignores trailing data)
+	if(length < raw.size())
+		raw.resize(length);
+	return prefix[sizeof(int)];
+}
@@ -0,0 +1,96 @@
+/*
+ * decode_context.hpp
+ * Copyright (C) 2012 David Jolly
+ * ----------------------
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DECODE_CONTEXT_HPP_
+#define DECODE_CONTEXT_HPP_
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+class decode_context {
+private:
+
+	/*
+	 * Reusable inflate stream
+	 */
+	z_stream zs;
+
+	/*
+	 * Currently open region file & path
+	 */
+	std::ifstream file;
+	std::string path;
+
+	/*
+	 * Raw (compressed) & inflated scratch buffers
+	 */
+	std::vector<char> raw, data;
+
+	/*
+	 * Decode context constructor (non-copyable)
+	 */
+	decode_context(const decode_context &other);
+
+	/*
+	 * Decode context assignment operator (non-copyable)
+	 */
+	decode_context &operator=(const decode_context &other);
+
+public:
+
+	/*
+	 * Decode context constructor
+	 */
+	decode_context(void);
+
+	/*
+	 * Decode context destructor
+	 */
+	virtual ~decode_context(void);
+
+	/*
+	 * Returns a decode context's inflated buffer
+	 */
+	std::vector<char> &get_data(void) { return data; }
+
+	/*
+	 * Returns a decode context's raw buffer
+	 */
+	std::vector<char> &get_raw(void) { return raw; }
+
+	/*
+	 * Inflate a zlib or gzip buffer into the inflated buffer
+	 */
+	bool inflate_(const char *in, size_t length);
+
+	/*
+	 * Reads & inflates a chunk stored at a given sector offset & count
+	 */
+	std::vector<char> &read_chunk(const std::string &path, unsigned int sector, unsigned int count);
+
+	/*
+	 * Reads a chunk's raw (compressed) payload at a given sector offset & count,
+	 * returning its compression type
+	 */
+	char read_raw(const std::string &path, unsigned int sector, unsigned int count);
+};
+
+#endif
@@ -0,0 +1,197 @@
+/*
+ * heightmap.cpp
+ * Copyright (C) 2012 David Jolly
+ * ----------------------
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstring>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "heightmap.hpp"
+#include "tag/byte_tag.hpp"
+#include "tag/byte_array_tag.hpp"
+#include "tag/compound_tag.hpp"
+#include "tag/int_array_tag.hpp"
+#include "tag/list_tag.hpp"
+
+/*
+ * Block ids that do not block sky light (light opacity zero)
+ */
+const unsigned int heightmap::CLEAR[CLEAR_COUNT] = {
+	0, 6, 20, 26, 27, 28, 31, 32, 37, 38, 39, 40, 50, 51, 52, 54,
+	55, 59, 63, 64, 65, 66, 68, 69, 70, 71, 72, 75, 76, 77, 78, 81,
+	83, 85, 90, 92, 93, 94, 96, 101, 102, 104, 105, 106, 107, 111, 113, 115,
+	116, 117, 118, 119, 120, 122,
+};
+
+/*
+ * Light-blocking status by block id
+ */
+bool heightmap::opaque[256];
+const bool heightmap::OPAQUE_INIT = heightmap::init_opaque();
+
+/*
+ * Initializes the light-blocking table
+ */
+bool heightmap::init_opaque(void) {
+	for(unsigned int i = 0; i < 256; ++i)
+		opaque[i] = true;
+	for(unsigned int i = 0; i < CLEAR_COUNT; ++i)
+		opaque[CLEAR[i]] = false;
+	return true;
+}
+
+/*
+ * Collect a chunk's section block arrays (NULL for missing sections)
+ */
+bool heightmap::collect_sections(chunk_tag &tag, const char *(&sections)[region_dim::SECTION_COUNT]) {
+	unsigned char y;
+	generic_tag *sub_tag;
+	compound_tag *level;
+	list_tag *sect_list;
+	bool found = false;
+
+	// locate sections list
+	for(unsigned int i = 0; i < region_dim::SECTION_COUNT; ++i)
+		sections[i] = NULL;
+	sub_tag = tag.get_root_tag().find("Level");
+	if(!sub_tag
+			|| sub_tag->get_type() != generic_tag::COMPOUND)
+		return false;
+	level = static_cast<compound_tag *>(sub_tag);
+	sub_tag = level->find("Sections");
+	if(!sub_tag
+			|| sub_tag->get_type() != generic_tag::LIST)
+		return false;
+	sect_list = static_cast<list_tag *>(sub_tag);
+
+	// index block arrays by section y coord
+	for(unsigned int i = 0; i < sect_list->size(); ++i) {
+		if(sect_list->at(i)->get_type() != generic_tag::COMPOUND)
+			continue;
+		compound_tag *sect = static_cast<compound_tag *>(sect_list->at(i));
+		generic_tag *y_tag = sect->find("Y"), *blocks = sect->find("Blocks");
+		if(!y_tag
+				|| y_tag->get_type() != generic_tag::BYTE
+				|| !blocks
+				|| blocks->get_type() != generic_tag::BYTE_ARRAY
+				|| static_cast<byte_array_tag *>(blocks)->size() != region_dim::SECTION_BLOCK_COUNT)
+			continue;
+		y = static_cast<byte_tag *>(y_tag)->get_value();
+		if(y >= region_dim::SECTION_COUNT)
+			continue;
+		sections[y] = static_cast<byte_array_tag *>(blocks)->get_value().data();
+		found = true;
+	}
+	return found;
+}
+
+/*
+ * Compute a height map from section block arrays, scanning down from a ceiling
+ * (each height is one above the highest light-blocking block below the ceiling)
+ */
+void heightmap::compute(const char *const (&sections)[region_dim::SECTION_COUNT], int *heights, unsigned int ceiling) {
+	int b_y;
+	const char *layer;
+	unsigned int bits, remaining = region_dim::BLOCK_COUNT;
+	unsigned short pending[region_dim::BLOCK_WIDTH];
+
+	// every column starts unresolved at height zero
+	memset(heights, 0, region_dim::BLOCK_COUNT * sizeof(int));
+	for(unsigned int i = 0; i < region_dim::BLOCK_WIDTH; ++i)
+		pending[i] = 0xffff;
+	if(ceiling > region_dim::BLOCK_HEIGHT)
+		ceiling = region_dim::BLOCK_HEIGHT;
+
+	// scan layers top-down until every column has hit a light-blocking block
+	for(b_y = ceiling - 1; b_y >= 0 && remaining; --b_y) {
+		if(!sections[b_y / region_dim::BLOCK_WIDTH]) {
+
+			// skip the rest of a missing (all air) section
+			b_y -= b_y % region_dim::BLOCK_WIDTH;
+			continue;
+		}
+		layer = sections[b_y / region_dim::BLOCK_WIDTH] + (b_y % region_dim::BLOCK_WIDTH) * region_dim::BLOCK_COUNT;
+		for(unsigned int b_z = 0; b_z < region_dim::BLOCK_WIDTH; ++b_z) {
+			if(!pending[b_z])
+				continue;
+			const char *row = layer + b_z * region_dim::BLOCK_WIDTH;
+
+			// find non-air blocks in a 16-block row at once
+#ifdef __SSE2__
+			__m128i blocks = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row));
+			bits = ~_mm_movemask_epi8(_mm_cmpeq_epi8(blocks, _mm_setzero_si128())) & pending[b_z];
+#else
+			bits = 0;
+			for(unsigned int b_x = 0; b_x < region_dim::BLOCK_WIDTH; ++b_x)
+				if(row[b_x])
+					bits |= 1 << b_x;
+			bits &= pending[b_z];
+#endif
+
+			// only non-air candidates need the opacity lookup
+			while(bits) {
+				unsigned int b_x = __builtin_ctz(bits);
+				bits &= bits - 1;
+				if(opaque[(unsigned char) row[b_x]]) {
+					heights[b_z * region_dim::BLOCK_WIDTH + b_x] = b_y + 1;
+					pending[b_z] &= ~(1 << b_x);
+					--remaining;
+				}
+			}
+		}
+	}
+}
+
+/*
+ * Compute a chunk's ceiling-clamped height map from its sections
+ */
+bool heightmap::compute(chunk_tag &tag, std::vector<int> &heights, unsigned int ceiling) {
+	const char *sections[region_dim::SECTION_COUNT];
+
+	// collect section data
+	heights.clear();
+	if(!collect_sections(tag, sections))
+		return false;
+	heights.resize(region_dim::BLOCK_COUNT);
+	compute(sections, heights.data(), ceiling);
+	return true;
+}
+
+/*
+ * Recompute & store a chunk's HeightMap tag
+ */
+bool heightmap::update(chunk_tag &tag) {
+	generic_tag *sub_tag;
+	compound_tag *level;
+	std::vector<int> heights;
+
+	// compute heights
+	if(!compute(tag, heights))
+		return false;
+
+	// replace the stored height map, adding one if missing
+	level = static_cast<compound_tag *>(tag.get_root_tag().find("Level"));
+	sub_tag = level->find("HeightMap");
+	if(!sub_tag) {
+		sub_tag = new int_array_tag("HeightMap");
+		level->push_back(sub_tag);
+	} else if(sub_tag->get_type() != generic_tag::INT_ARRAY)
+		return false;
+	static_cast<int_array_tag *>(sub_tag)->set_value(heights);
+	return true;
+}
@@ -0,0 +1,85 @@
+/*
+ * heightmap.hpp
+ * Copyright (C) 2012 David Jolly
+ * ----------------------
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HEIGHTMAP_HPP_
+#define HEIGHTMAP_HPP_
+
+#include <vector>
+#include "chunk_tag.hpp"
+#include "region_dim.hpp"
+
+class heightmap {
+private:
+
+	/*
+	 * Light-blocking status by block id
+	 */
+	static bool opaque[256];
+
+	/*
+	 * Initializes the light-blocking table
+	 */
+	static bool init_opaque(void);
+
+	/*
+	 * Light-blocking table initialized status
+	 */
+	static const bool OPAQUE_INIT;
+
+	/*
+	 * Collect a chunk's section block arrays (NULL for missing sections)
+	 */
+	static bool collect_sections(chunk_tag &tag, const char *(&sections)[region_dim::SECTION_COUNT]);
+
+public:
+
+	/*
+	 * Block ids that do not block sky light (light opacity zero)
+	 */
+	static const unsigned int CLEAR_COUNT = 54;
+	static const unsigned int CLEAR[CLEAR_COUNT];
+
+	/*
+	 * Compute a height map from section block arrays, scanning down from a ceiling
+	 * (each height is one above the highest light-blocking block below the ceiling)
+	 */
+	static void compute(const char *const (&sections)[region_dim::SECTION_COUNT], int *heights, unsigned int ceiling);
+
+	/*
+	 * Compute a chunk's height map from its sections
+	 */
+	static bool compute(chunk_tag &tag, std::vector<int> &heights) { return compute(tag, heights, region_dim::BLOCK_HEIGHT); }
+
+	/*
+	 * Compute a chunk's ceiling-clamped height map from its sections
+	 */
+	static bool compute(chunk_tag &tag, std::vector<int> &heights, unsigned int ceiling);
+
+	/*
+	 * Returns true if a given block id blocks sky light
+	 */
+	static bool is_opaque(unsigned int id) { return opaque[id & 0xff]; }
+
+	/*
+	 * Recompute & store a chunk's HeightMap tag
+	 */
+	static bool update(chunk_tag &tag);
+};
+
+#endif
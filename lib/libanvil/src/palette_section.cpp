@@ -0,0 +1,236 @@
+/*
+ * palette_section.cpp
+ * Copyright (C) 2012 David Jolly
+ * ----------------------
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <sstream>
+#include <stdexcept>
+#include "palette_section.hpp"
+
+/*
+ * Palette section constructor
+ */
+palette_section::palette_section(void) : bits(0) {
+
+	// initialize to an air-only section
+	palette.push_back(0);
+}
+
+/*
+ * Palette section constructor
+ */
+palette_section::palette_section(const std::vector<char> &blocks) : bits(0) {
+	pack(blocks, NULL);
+}
+
+/*
+ * Palette section constructor
+ */
+palette_section::palette_section(const std::vector<char> &blocks, const std::vector<char> &add) : bits(0) {
+	pack(blocks, &add);
+}
+
+/*
+ * Palette section assignment operator
+ */
+palette_section &palette_section::operator=(const palette_section &other) {
+
+	// check for self
+	if(this == &other)
+		return *this;
+
+	// assign attributes
+	bits = other.bits;
+	palette = other.palette;
+	data = other.data;
+	return *this;
+}
+
+/*
+ * Palette section equals operator
+ */
+bool palette_section::operator==(const palette_section &other) {
+
+	// check for self
+	if(this == &other)
+		return true;
+
+	// check attributes
+	if(bits == other.bits
+			&& palette == other.palette
+			&& data == other.data)
+		return true;
+
+	// fall back to comparing block ids (palettes may differ in order)
+	for(unsigned int i = 0; i < region_dim::SECTION_BLOCK_COUNT; ++i)
+		if(at(i) != other.at(i))
+			return false;
+	return true;
+}
+
+/*
+ * Returns the smallest supported bit width for a given palette size
+ */
+unsigned int palette_section::bits_for(unsigned int count) {
+	unsigned int bits = 0;
+
+	// only power-of-two widths are used, so entries never straddle a word
+	while((1U << bits) < count)
+		bits = bits ? bits << 1 : 1;
+	return bits;
+}
+
+/*
+ * Pack a series of palette indices at a given bit width
+ */
+void palette_section::pack_indices(const unsigned short *indices, unsigned int bits) {
+	unsigned int per_word;
+
+	// single-entry palettes store no indices
+	this->bits = bits;
+	data.clear();
+	if(!bits)
+		return;
+
+	// pack indices into words
+	per_word = 64 / bits;
+	data.assign(region_dim::SECTION_BLOCK_COUNT / per_word, 0);
+	for(unsigned int i = 0; i < region_dim::SECTION_BLOCK_COUNT; ++i)
+		data[i / per_word] |= ((uint64_t) indices[i]) << ((i % per_word) * bits);
+}
+
+/*
+ * Pack a section from block and (optional) add arrays
+ */
+void palette_section::pack(const std::vector<char> &blocks, const std::vector<char> *add) {
+	int id;
+	short lookup[region_dim::SECTION_BLOCK_COUNT];
+	unsigned short indices[region_dim::SECTION_BLOCK_COUNT];
+
+	// check array sizes
+	if(blocks.size() != region_dim::SECTION_BLOCK_COUNT
+			|| (add && add->size() != region_dim::SECTION_BLOCK_COUNT / 2))
+		throw std::runtime_error("Malformed section block data");
+
+	// build palette in first-seen order
+	palette.clear();
+	for(unsigned int i = 0; i < region_dim::SECTION_BLOCK_COUNT; ++i)
+		lookup[i] = -1;
+	for(unsigned int i = 0; i < region_dim::SECTION_BLOCK_COUNT; ++i) {
+		id = (unsigned char) blocks[i];
+		if(add)
+			id |= ((((unsigned char) (*add)[i >> 1]) >> ((i & 1) << 2)) & 0xf) << 8;
+		if(lookup[id] < 0) {
+			lookup[id] = palette.size();
+			palette.push_back(id);
+		}
+		indices[i] = lookup[id];
+	}
+	pack_indices(indices, bits_for(palette.size()));
+
+	// release any slack left by the palette
+	std::vector<unsigned short>(palette).swap(palette);
+}
+
+/*
+ * Sets a block id at a given index
+ */
+void palette_section::set(unsigned int index, int id) {
+	unsigned int entry, per_word;
+	unsigned short indices[region_dim::SECTION_BLOCK_COUNT];
+
+	// check for valid index & id
+	if(index >= region_dim::SECTION_BLOCK_COUNT)
+		throw std::out_of_range("index out-of-range");
+	if(id < 0 || id >= (int) region_dim::SECTION_BLOCK_COUNT)
+		throw std::out_of_range("block id out-of-range");
+
+	// find id in palette, appending if missing
+	for(entry = 0; entry < palette.size(); ++entry)
+		if(palette[entry] == id)
+			break;
+	if(entry == palette.size()) {
+		palette.push_back(id);
+
+		// widen indices when the palette outgrows the current width
+		if(bits_for(palette.size()) != bits) {
+			for(unsigned int i = 0; i < region_dim::SECTION_BLOCK_COUNT; ++i) {
+				if(!bits)
+					indices[i] = 0;
+				else {
+					per_word = 64 / bits;
+					indices[i] = (data[i / per_word] >> ((i % per_word) * bits)) & ((1U << bits) - 1);
+				}
+			}
+			pack_indices(indices, bits_for(palette.size()));
+		}
+	}
+
+	// write index
+	if(!bits)
+		return;
+	per_word = 64 / bits;
+	data[index / per_word] &= ~(((((uint64_t) 1) << bits) - 1) << ((index % per_word) * bits));
+	data[index / per_word] |= ((uint64_t) entry) << ((index % per_word) * bits);
+}
+
+/*
+ * Unpack all block ids into a buffer of SECTION_BLOCK_COUNT entries
+ */
+void palette_section::unpack(int *blocks) const {
+
+	// dispatch on width so each loop shifts by a constant
+	switch(bits) {
+		case 0:
+			for(unsigned int i = 0; i < region_dim::SECTION_BLOCK_COUNT; ++i)
+				blocks[i] = palette[0];
+			break;
+		case 1: unpack_helper<1>(blocks);
+			break;
+		case 2: unpack_helper<2>(blocks);
+			break;
+		case 4: unpack_helper<4>(blocks);
+			break;
+		case 8: unpack_helper<8>(blocks);
+			break;
+		case 16: unpack_helper<16>(blocks);
+			break;
+		default:
+			throw std::runtime_error("Unsupported palette width");
+			break;
+	}
+}
+
+/*
+ * Unpack all block ids onto the tail of a vector
+ */
+void palette_section::unpack(std::vector<int> &blocks) const {
+	size_t pos = blocks.size();
+	blocks.resize(pos + region_dim::SECTION_BLOCK_COUNT);
+	unpack(&blocks[pos]);
+}
+
+/*
+ * Returns a string representation of a palette section
+ */
+std::string palette_section::to_string(void) const {
+	std::stringstream ss;
+
+	// form string representation
+	ss << "Palette: " << palette.size() << ", bits: " << bits << ", size: " << get_size();
+	return ss.str();
+}
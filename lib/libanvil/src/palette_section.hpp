@@ -0,0 +1,175 @@
+/*
+ * palette_section.hpp
+ * Copyright (C) 2012 David Jolly
+ * ----------------------
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PALETTE_SECTION_HPP_
+#define PALETTE_SECTION_HPP_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "region_dim.hpp"
+
+class palette_section {
+private:
+
+	/*
+	 * Index bit width (0, 1, 2, 4, 8 or 16)
+	 */
+	unsigned int bits;
+
+	/*
+	 * Distinct block ids held by the section
+	 */
+	std::vector<unsigned short> palette;
+
+	/*
+	 * Bit-packed palette indices (entries never straddle a word)
+	 */
+	std::vector<uint64_t> data;
+
+	/*
+	 * Returns the smallest supported bit width for a given palette size
+	 */
+	static unsigned int bits_for(unsigned int count);
+
+	/*
+	 * Pack a series of palette indices at a given bit width
+	 */
+	void pack_indices(const unsigned short *indices, unsigned int bits);
+
+	/*
+	 * Unpack all palette indices at a fixed bit width
+	 */
+	template <unsigned int BITS>
+	void unpack_helper(int *blocks) const {
+		const uint64_t mask = (((uint64_t) 1) << BITS) - 1;
+		const unsigned int per_word = 64 / BITS;
+
+		// expand each word through the palette
+		for(unsigned int i = 0, pos = 0; i < data.size(); ++i) {
+			uint64_t word = data[i];
+			for(unsigned int j = 0; j < per_word; ++j, word >>= BITS)
+				blocks[pos++] = palette[word & mask];
+		}
+	}
+
+public:
+
+	/*
+	 * Palette section constructor
+	 */
+	palette_section(void);
+
+	/*
+	 * Palette section constructor
+	 */
+	palette_section(const palette_section &other) : bits(other.bits), palette(other.palette), data(other.data) { return; }
+
+	/*
+	 * Palette section constructor
+	 */
+	palette_section(const std::vector<char> &blocks);
+
+	/*
+	 * Palette section constructor
+	 */
+	palette_section(const std::vector<char> &blocks, const std::vector<char> &add);
+
+	/*
+	 * Palette section destructor
+	 */
+	virtual ~palette_section(void) { return; }
+
+	/*
+	 * Palette section assignment operator
+	 */
+	palette_section &operator=(const palette_section &other);
+
+	/*
+	 * Palette section equals operator
+	 */
+	bool operator==(const palette_section &other);
+
+	/*
+	 * Palette section not-equals operator
+	 */
+	bool operator!=(const palette_section &other) { return !(*this == other); }
+
+	/*
+	 * Returns a block id at a given index
+	 */
+	int at(unsigned int index) const {
+		if(!bits)
+			return palette[0];
+		unsigned int per_word = 64 / bits;
+		return palette[(data[index / per_word] >> ((index % per_word) * bits)) & ((((uint64_t) 1) << bits) - 1)];
+	}
+
+	/*
+	 * Returns a block id at a given x, y, z coord
+	 */
+	int at(unsigned int x, unsigned int y, unsigned int z) const { return at((y * region_dim::BLOCK_WIDTH + z) * region_dim::BLOCK_WIDTH + x); }
+
+	/*
+	 * Returns a palette section's air-only status
+	 */
+	bool empty(void) const { return palette.size() == 1 && !palette[0]; }
+
+	/*
+	 * Returns a palette section's index bit width
+	 */
+	unsigned int get_bits(void) const { return bits; }
+
+	/*
+	 * Returns a palette section's palette
+	 */
+	const std::vector<unsigned short> &get_palette(void) const { return palette; }
+
+	/*
+	 * Returns a palette section's in-memory size in bytes
+	 */
+	size_t get_size(void) const { return sizeof(*this) + palette.capacity() * sizeof(unsigned short) + data.capacity() * sizeof(uint64_t); }
+
+	/*
+	 * Pack a section from block and (optional) add arrays
+	 */
+	void pack(const std::vector<char> &blocks, const std::vector<char> *add);
+
+	/*
+	 * Sets a block id at a given index
+	 */
+	void set(unsigned int index, int id);
+
+	/*
+	 * Unpack all block ids into a buffer of SECTION_BLOCK_COUNT entries
+	 */
+	void unpack(int *blocks) const;
+
+	/*
+	 * Unpack all block ids onto the tail of a vector
+	 */
+	void unpack(std::vector<int> &blocks) const;
+
+	/*
+	 * Returns a string representation of a palette section
+	 */
+	std::string to_string(void) const;
+};
+
+#endif
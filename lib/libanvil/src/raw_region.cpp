@@ -0,0 +1,243 @@
+/*
+ * raw_region.cpp
+ * Copyright (C) 2012 David Jolly
+ * ----------------------
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <boost/filesystem.hpp>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include "chunk_info.hpp"
+#include "raw_region.hpp"
+#include "region_file.hpp"
+#include "region_file_writer.hpp"
+#include "region_header.hpp"
+
+/*
+ * Drop all chunks
+ */
+void raw_region::clear(void) {
+	for(unsigned int i = 0; i < region_dim::CHUNK_COUNT; ++i)
+		chunks[i] = raw_chunk();
+}
+
+/*
+ * Returns a raw chunk at a given index
+ */
+raw_region::raw_chunk &raw_region::get_chunk(unsigned int index) {
+
+	// check for valid index
+	if(index >= region_dim::CHUNK_COUNT)
+		throw std::out_of_range("index out-of-range");
+	return chunks[index];
+}
+
+/*
+ * Returns a raw region's filled chunk count
+ */
+unsigned int raw_region::get_count(void) {
+	unsigned int count = 0;
+
+	// count filled chunks
+	for(unsigned int i = 0; i < region_dim::CHUNK_COUNT; ++i)
+		if(!chunks[i].empty())
+			++count;
+	return count;
+}
+
+/*
+ * Returns the total file size of a raw region once written
+ */
+size_t raw_region::get_file_size(void) {
+	size_t size = region_dim::HEADER_OFFSET;
+
+	// each chunk is prefixed & padded out to whole sectors
+	for(unsigned int i = 0; i < region_dim::CHUNK_COUNT; ++i)
+		if(!chunks[i].empty())
+			size += ((chunks[i].data.size() + sizeof(int) + sizeof(char) + region_dim::SECTOR_SIZE - 1) / region_dim::SECTOR_SIZE) * region_dim::SECTOR_SIZE;
+	return size;
+}
+
+/*
+ * Returns a raw region's total payload size in bytes
+ */
+size_t raw_region::get_size(void) {
+	size_t size = 0;
+
+	// sum payloads
+	for(unsigned int i = 0; i < region_dim::CHUNK_COUNT; ++i)
+		size += chunks[i].data.size();
+	return size;
+}
+
+/*
+ * Returns a chunk's index at a given x, z coord
+ */
+unsigned int raw_region::index(unsigned int x, unsigned int z) {
+
+	// check for valid coord
+	if(x >= region_dim::CHUNK_WIDTH
+			|| z >= region_dim::CHUNK_WIDTH)
+		throw std::out_of_range("coord out-of-range");
+	return z * region_dim::CHUNK_WIDTH + x;
+}
+
+/*
+ * Returns the chunk index stored at a given position of a storage order
+ */
+unsigned int raw_region::order_index(unsigned int pos, unsigned int order) {
+	unsigned int x = 0, z = 0;
+
+	// check for valid position
+	if(pos >= region_dim::CHUNK_COUNT)
+		throw std::out_of_range("position out-of-range");
+	switch(order) {
+		case ROW_MAJOR:
+			return pos;
+
+		// de-interleave morton code bits (x in even bits, z in odd bits)
+		case Z_ORDER:
+			for(unsigned int i = 0; (1u << (2 * i)) < region_dim::CHUNK_COUNT; ++i) {
+				x |= ((pos >> (2 * i)) & 1) << i;
+				z |= ((pos >> (2 * i + 1)) & 1) << i;
+			}
+			return z * region_dim::CHUNK_WIDTH + x;
+		default:
+			throw std::runtime_error("Unknown storage order");
+	}
+}
+
+/*
+ * Read every chunk's raw payload from a region file in one pass
+ */
+void raw_region::read(const std::string &path) {
+	size_t pos;
+	unsigned int length;
+	region_header header;
+	std::vector<char> buff;
+	const unsigned char *prefix;
+	std::ifstream file(path.c_str(), std::ios::in | std::ios::binary);
+
+	// read header & remaining file in one call each
+	if(!file.is_open())
+		throw std::runtime_error("Failed to open input file");
+	if(!header.read_data(file))
+		throw std::runtime_error("Failed to read region header");
+	file.seekg(0, std::ios::end);
+	buff.resize((size_t) file.tellg());
+	file.seekg(0, std::ios::beg);
+	file.read(buff.data(), buff.size());
+	if(file.gcount() != (std::streamsize) buff.size())
+		throw std::runtime_error("Failed to read region file");
+	clear();
+	region_file::is_region_file(path, x, z);
+
+	// slice out each chunk's payload (its length counts the type byte)
+	for(unsigned int i = 0; i < region_dim::CHUNK_COUNT; ++i) {
+		chunk_info &info = header.get_info_at(i);
+		if(info.empty()
+				|| !info.get_sector_count())
+			continue;
+		pos = (size_t) info.get_sector() * region_dim::SECTOR_SIZE;
+		if(pos < region_dim::HEADER_OFFSET
+				|| pos + sizeof(int) + sizeof(char) > buff.size())
+			throw std::runtime_error("Malformed chunk offset");
+		prefix = reinterpret_cast<const unsigned char *>(&buff[pos]);
+		length = (prefix[0] << 24) | (prefix[1] << 16) | (prefix[2] << 8) | prefix[3];
+		if(length < 2
+				|| length - 1 > buff.size() - pos - sizeof(int) - sizeof(char))
+			throw std::runtime_error("Malformed chunk length");
+		chunks[i].type = prefix[sizeof(int)];
+		chunks[i].modified = info.get_modified();
+		chunks[i].data.assign(buff.begin() + pos + sizeof(int) + sizeof(char),
+				buff.begin() + pos + sizeof(int) + sizeof(char) + length - 1);
+	}
+}
+
+/*
+ * Returns a string representation of a raw region
+ */
+std::string raw_region::to_string(void) {
+	std::stringstream ss;
+
+	// form string representation
+	ss << "(" << x << ", " << z << "): chunks: " << get_count() << ", size: " << get_size();
+	return ss.str();
+}
+
+/*
+ * Write a raw region's chunks back-to-back in a given storage order,
+ * replacing a region file atomically
+ */
+void raw_region::write(const std::string &path, unsigned int order) {
+	region_header header;
+	std::vector<char> data, out;
+	unsigned int index, sectors, pos = region_dim::HEADER_OFFSET / region_dim::SECTOR_SIZE;
+	std::string temp_path = path + ".tmp", dir = boost::filesystem::path(path).parent_path().string();
+	std::ofstream file(temp_path.c_str(), std::ios::out | std::ios::trunc | std::ios::binary);
+
+	// attempt to open temporary file & reserve space for the header
+	if(!file.is_open())
+		throw std::runtime_error("Failed to open output file");
+	out.assign(region_header::HEADER_LENGTH, 0);
+	file.write(out.data(), out.size());
+
+	// append chunks in storage order, padding each to whole sectors
+	for(unsigned int i = 0; i < region_dim::CHUNK_COUNT; ++i) {
+		index = order_index(i, order);
+		raw_chunk &chunk = chunks[index];
+		if(chunk.empty())
+			continue;
+		sectors = (chunk.data.size() + sizeof(int) + sizeof(char) + region_dim::SECTOR_SIZE - 1) / region_dim::SECTOR_SIZE;
+		if(sectors > 0xff) {
+			file.close();
+			remove(temp_path.c_str());
+			throw std::runtime_error("Chunk exceeds maximum sector count");
+		}
+		out.assign(sectors * region_dim::SECTOR_SIZE, 0);
+		out[0] = (char) ((chunk.data.size() + 1) >> 24);
+		out[1] = (char) ((chunk.data.size() + 1) >> 16);
+		out[2] = (char) ((chunk.data.size() + 1) >> 8);
+		out[3] = (char) (chunk.data.size() + 1);
+		out[4] = chunk.type;
+		memcpy(&out[sizeof(int) + sizeof(char)], chunk.data.data(), chunk.data.size());
+		file.write(out.data(), out.size());
+		header.set_info_at(index, chunk_info((pos << 8) | sectors, chunk.data.size() + 1, chunk.type, chunk.modified));
+		pos += sectors;
+	}
+
+	// write header over the reserved space
+	data = header.get_data();
+	file.seekp(0, std::ios::beg);
+	file.write(data.data(), data.size());
+	if(!file.good()) {
+		file.close();
+		remove(temp_path.c_str());
+		throw std::runtime_error("Failed to write output file");
+	}
+	file.close();
+
+	// sync & atomically replace the region file
+	region_file_writer::sync(temp_path);
+	if(rename(temp_path.c_str(), path.c_str())) {
+		remove(temp_path.c_str());
+		throw std::runtime_error("Failed to replace output file");
+	}
+	region_file_writer::sync(dir.empty() ? "." : dir);
+}
@@ -0,0 +1,166 @@
+/*
+ * raw_region.hpp
+ * Copyright (C) 2012 David Jolly
+ * ----------------------
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RAW_REGION_HPP_
+#define RAW_REGION_HPP_
+
+#include <string>
+#include <vector>
+#include "region_dim.hpp"
+
+class raw_region {
+public:
+
+	/*
+	 * Chunk storage orders
+	 */
+	enum ORDER { ROW_MAJOR, Z_ORDER };
+
+	/*
+	 * Raw (still compressed) chunk payload
+	 */
+	class raw_chunk {
+	public:
+		char type;
+		unsigned int modified;
+		std::vector<char> data;
+
+		/*
+		 * Raw chunk constructor
+		 */
+		raw_chunk(void) : type(0), modified(0) { return; }
+
+		/*
+		 * Returns a raw chunk's empty status
+		 */
+		bool empty(void) const { return data.empty(); }
+	};
+
+private:
+
+	/*
+	 * Region coords
+	 */
+	int x, z;
+
+	/*
+	 * Raw chunk payloads
+	 */
+	raw_chunk chunks[region_dim::CHUNK_COUNT];
+
+public:
+
+	/*
+	 * Raw region constructor
+	 */
+	raw_region(void) : x(0), z(0) { return; }
+
+	/*
+	 * Raw region constructor
+	 */
+	raw_region(const std::string &path) : x(0), z(0) { read(path); }
+
+	/*
+	 * Raw region destructor
+	 */
+	virtual ~raw_region(void) { return; }
+
+	/*
+	 * Drop all chunks
+	 */
+	void clear(void);
+
+	/*
+	 * Returns a raw chunk at a given index
+	 */
+	raw_chunk &get_chunk(unsigned int index);
+
+	/*
+	 * Returns a raw chunk at a given x, z coord
+	 */
+	raw_chunk &get_chunk_at(unsigned int x, unsigned int z) { return get_chunk(index(x, z)); }
+
+	/*
+	 * Returns a raw region's filled chunk count
+	 */
+	unsigned int get_count(void);
+
+	/*
+	 * Returns a raw region's total payload size in bytes
+	 */
+	size_t get_size(void);
+
+	/*
+	 * Returns the total file size of a raw region once written
+	 */
+	size_t get_file_size(void);
+
+	/*
+	 * Returns a raw region's x coord
+	 */
+	int get_x(void) { return x; }
+
+	/*
+	 * Returns a raw region's z coord
+	 */
+	int get_z(void) { return z; }
+
+	/*
+	 * Returns a chunk's index at a given x, z coord
+	 */
+	static unsigned int index(unsigned int x, unsigned int z);
+
+	/*
+	 * Returns the chunk index stored at a given position of a storage order
+	 */
+	static unsigned int order_index(unsigned int pos, unsigned int order);
+
+	/*
+	 * Read every chunk's raw payload from a region file in one pass
+	 */
+	void read(const std::string &path);
+
+	/*
+	 * Remove a chunk at a given x, z coord
+	 */
+	void remove_chunk(unsigned int x, unsigned int z) { get_chunk_at(x, z) = raw_chunk(); }
+
+	/*
+	 * Sets a raw region's coords
+	 */
+	void set_coords(int x, int z) { this->x = x; this->z = z; }
+
+	/*
+	 * Returns a string representation of a raw region
+	 */
+	std::string to_string(void);
+
+	/*
+	 * Write a raw region's chunks back-to-back in a given storage order,
+	 * replacing a region file atomically
+	 */
+	void write(const std::string &path, unsigned int order);
+
+	/*
+	 * Write a raw region's chunks back-to-back in row-major order
+	 */
+	void write(const std::string &path) { write(path, ROW_MAJOR); }
+};
+
+#endif
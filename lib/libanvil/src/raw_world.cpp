@@ -0,0 +1,295 @@
+/*
+ * raw_world.cpp
+ * Copyright (C) 2012 David Jolly
+ * ----------------------
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <boost/filesystem.hpp>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include "raw_region.hpp"
+#include "raw_world.hpp"
+#include "region_dim.hpp"
+#include "region_file.hpp"
+#include "region_file_updater.hpp"
+#include "region_header.hpp"
+#include "world.hpp"
+
+/*
+ * Returns a string representation of a report
+ */
+std::string raw_world::report::to_string(void) const {
+	std::stringstream ss;
+
+	// form string representation
+	ss << "Regions deleted: " << deleted << ", rewritten: " << rewritten << ", chunks removed: " << chunks
+			<< ", size: " << before << " -> " << after << ", errors: " << errors.size();
+	return ss.str();
+}
+
+/*
+ * Copy a chunk between region directories (either may be the same),
+ * returning false if no source chunk exists
+ */
+bool raw_world::copy_chunk(const std::string &src_dir, int src_x, int src_z, const std::string &dst_dir, int dst_x, int dst_z) {
+	return transfer(src_dir, src_x, src_z, dst_dir, dst_x, dst_z, false);
+}
+
+/*
+ * Returns a region's coverage by the kept area
+ */
+unsigned int raw_world::coverage(int x, int z) {
+	long long near_x, near_z, far_x, far_z;
+	int low_x = x * (int) region_dim::CHUNK_WIDTH, low_z = z * (int) region_dim::CHUNK_WIDTH,
+			high_x = low_x + region_dim::CHUNK_WIDTH - 1, high_z = low_z + region_dim::CHUNK_WIDTH - 1;
+
+	// compare region & kept rectangles
+	if(!radius_mode) {
+		if(high_x < min_x || low_x > max_x
+				|| high_z < min_z || low_z > max_z)
+			return OUTSIDE;
+		if(low_x >= min_x && high_x <= max_x
+				&& low_z >= min_z && high_z <= max_z)
+			return INSIDE;
+		return PARTIAL;
+	}
+
+	// compare the region's nearest & farthest chunks to the radius
+	near_x = std::max(low_x, std::min(center_x, high_x)) - center_x;
+	near_z = std::max(low_z, std::min(center_z, high_z)) - center_z;
+	far_x = std::max(std::abs(low_x - center_x), std::abs(high_x - center_x));
+	far_z = std::max(std::abs(low_z - center_z), std::abs(high_z - center_z));
+	if(near_x * near_x + near_z * near_z > radius_sq)
+		return OUTSIDE;
+	if(far_x * far_x + far_z * far_z <= radius_sq)
+		return INSIDE;
+	return PARTIAL;
+}
+
+/*
+ * Returns true if a chunk at a given chunk x, z coord is kept
+ */
+bool raw_world::keep(int x, int z) {
+	long long dx = x - center_x, dz = z - center_z;
+
+	// check rectangle or radius
+	if(!radius_mode)
+		return x >= min_x && x <= max_x
+				&& z >= min_z && z <= max_z;
+	return dx * dx + dz * dz <= radius_sq;
+}
+
+/*
+ * Move a chunk between region directories (either may be the same),
+ * returning false if no source chunk exists
+ */
+bool raw_world::move_chunk(const std::string &src_dir, int src_x, int src_z, const std::string &dst_dir, int dst_x, int dst_z) {
+	return transfer(src_dir, src_x, src_z, dst_dir, dst_x, dst_z, true);
+}
+
+/*
+ * Returns a region file's path in a directory at a given region x, z coord
+ */
+std::string raw_world::region_path(const std::string &dir, int x, int z) {
+	std::stringstream ss;
+
+	// form region file path
+	ss << dir << "/r." << x << "." << z << ".mca";
+	return ss.str();
+}
+
+/*
+ * Remove a chunk, returning false if no chunk exists
+ */
+bool raw_world::remove_chunk(const std::string &dir, int x, int z) {
+	unsigned int local_x = world::local_coord(x, region_dim::CHUNK_WIDTH), local_z = world::local_coord(z, region_dim::CHUNK_WIDTH);
+	std::string path = region_path(dir, world::region_coord(x), world::region_coord(z));
+
+	// check if region exists
+	if(!boost::filesystem::exists(path))
+		return false;
+
+	// clear header entry & free sectors
+	region_file_updater updater(path);
+	if(!updater.is_filled(local_x, local_z))
+		return false;
+	updater.remove_chunk(local_x, local_z);
+	return true;
+}
+
+/*
+ * Move (or copy) a chunk between region directories, returning false if no
+ * source chunk exists
+ */
+bool raw_world::transfer(const std::string &src_dir, int src_x, int src_z, const std::string &dst_dir, int dst_x, int dst_z, bool move) {
+	char type;
+	unsigned int modified;
+	std::vector<char> data;
+	unsigned int src_local_x = world::local_coord(src_x, region_dim::CHUNK_WIDTH), src_local_z = world::local_coord(src_z, region_dim::CHUNK_WIDTH),
+			dst_local_x = world::local_coord(dst_x, region_dim::CHUNK_WIDTH), dst_local_z = world::local_coord(dst_z, region_dim::CHUNK_WIDTH);
+	std::string src_path = region_path(src_dir, world::region_coord(src_x), world::region_coord(src_z)),
+			dst_path = region_path(dst_dir, world::region_coord(dst_x), world::region_coord(dst_z));
+
+	// check if source region exists
+	if(!boost::filesystem::exists(src_path))
+		return false;
+
+	// read the compressed payload & timestamp
+	region_file_updater src(src_path);
+	if(!src.read_raw(src_local_x, src_local_z, type, data))
+		return false;
+	modified = src.get_header().get_info_at(src_local_z * region_dim::CHUNK_WIDTH + src_local_x).get_modified();
+
+	// write within the same region file, or into another one
+	if(boost::filesystem::exists(dst_path)
+			&& boost::filesystem::equivalent(src_path, dst_path)) {
+		if(src_local_x == dst_local_x
+				&& src_local_z == dst_local_z)
+			return true;
+		src.write_raw(dst_local_x, dst_local_z, type, data, modified);
+	} else {
+		region_file_updater dst(dst_path);
+		dst.write_raw(dst_local_x, dst_local_z, type, data, modified);
+	}
+
+	// remove the source once the copy is written
+	if(move)
+		src.remove_chunk(src_local_x, src_local_z);
+	return true;
+}
+
+/*
+ * Trim every region file in a directory in parallel
+ */
+raw_world::report raw_world::trim(const std::string &dir) {
+
+	// collect region files in a stable order
+	region_file::list_region_files(dir, paths);
+
+	// trim regions in parallel (failed regions are left untouched)
+	region_file::for_each(paths, threads, *this, result.errors);
+	return result;
+}
+
+/*
+ * Trim a single region file
+ */
+void raw_world::trim_file(const std::string &path, int x, int z, report &rep) {
+	unsigned int removed = 0;
+	region_header header;
+	raw_region reg;
+
+	// keep regions that lie entirely inside the kept area
+	rep.before = boost::filesystem::file_size(path);
+	switch(coverage(x, z)) {
+		case INSIDE:
+			rep.after = rep.before;
+			return;
+
+		// delete regions that lie entirely outside, counting their chunks from the header
+		case OUTSIDE: {
+			std::ifstream file(path.c_str(), std::ios::in | std::ios::binary);
+			if(!file.is_open()
+					|| !header.read_data(file))
+				throw std::runtime_error("Failed to read region header");
+			file.close();
+			for(unsigned int i = 0; i < region_dim::CHUNK_COUNT; ++i)
+				if(!header.get_info_at(i).empty()
+						&& header.get_info_at(i).get_sector_count())
+					++removed;
+			if(remove(path.c_str()))
+				throw std::runtime_error("Failed to delete region file");
+			rep.chunks = removed;
+			rep.deleted = 1;
+		} break;
+
+		// drop raw chunks outside the kept area & rewrite the rest back-to-back
+		default:
+			reg.read(path);
+			for(unsigned int i = 0; i < region_dim::CHUNK_COUNT; ++i)
+				if(!reg.get_chunk(i).empty()
+						&& !keep(x * (int) region_dim::CHUNK_WIDTH + (int) (i % region_dim::CHUNK_WIDTH),
+						z * (int) region_dim::CHUNK_WIDTH + (int) (i / region_dim::CHUNK_WIDTH))) {
+					reg.get_chunk(i) = raw_region::raw_chunk();
+					++removed;
+				}
+			if(!removed) {
+				rep.after = rep.before;
+				return;
+			}
+			rep.chunks = removed;
+			if(!reg.get_count()) {
+				if(remove(path.c_str()))
+					throw std::runtime_error("Failed to delete region file");
+				rep.deleted = 1;
+				return;
+			}
+			reg.write(path);
+			rep.after = boost::filesystem::file_size(path);
+			rep.rewritten = 1;
+			break;
+	}
+}
+
+/*
+ * Remove every chunk farther than a chunk radius from a center chunk
+ */
+raw_world::report raw_world::trim_radius(const std::string &dir, int x, int z, unsigned int radius, unsigned int threads) {
+	raw_world trimmer(threads);
+
+	// keep chunks within the radius
+	trimmer.radius_mode = true;
+	trimmer.center_x = x;
+	trimmer.center_z = z;
+	trimmer.radius_sq = (long long) radius * radius;
+	return trimmer.trim(dir);
+}
+
+/*
+ * Remove every chunk outside an inclusive chunk coord rectangle
+ */
+raw_world::report raw_world::trim_rect(const std::string &dir, int min_x, int min_z, int max_x, int max_z, unsigned int threads) {
+	raw_world trimmer(threads);
+
+	// keep chunks within the rectangle
+	trimmer.min_x = min_x;
+	trimmer.min_z = min_z;
+	trimmer.max_x = max_x;
+	trimmer.max_z = max_z;
+	return trimmer.trim(dir);
+}
+
+/*
+ * Trim a region & merge its report (called concurrently from worker threads)
+ */
+void raw_world::visit(size_t index) {
+	int x, z;
+	report rep;
+
+	region_file::is_region_file(paths.at(index), x, z);
+	trim_file(paths.at(index), x, z, rep);
+	lock.lock();
+	result.deleted += rep.deleted;
+	result.rewritten += rep.rewritten;
+	result.chunks += rep.chunks;
+	result.before += rep.before;
+	result.after += rep.after;
+	lock.unlock();
+}
@@ -0,0 +1,176 @@
+/*
+ * raw_world.hpp
+ * Copyright (C) 2012 David Jolly
+ * ----------------------
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RAW_WORLD_HPP_
+#define RAW_WORLD_HPP_
+
+#include <mutex>
+#include <string>
+#include <vector>
+#include "region_visitor.hpp"
+
+/*
+ * Chunk operations on region directories that move compressed payloads &
+ * header entries without inflating chunks (a chunk's own xPos/zPos tags are
+ * left as-is, so copies to new coords keep their original position tags)
+ */
+class raw_world : private region_visitor {
+public:
+
+	/*
+	 * Trim report
+	 */
+	class report {
+	public:
+
+		/*
+		 * Regions deleted & rewritten
+		 */
+		unsigned int deleted, rewritten;
+
+		/*
+		 * Chunks removed
+		 */
+		unsigned int chunks;
+
+		/*
+		 * Total file sizes before & after trimming
+		 */
+		unsigned long long before, after;
+
+		/*
+		 * Regions left untouched due to errors
+		 */
+		std::vector<std::string> errors;
+
+		/*
+		 * Report constructor
+		 */
+		report(void) : deleted(0), rewritten(0), chunks(0), before(0), after(0) { return; }
+
+		/*
+		 * Returns a string representation of a report
+		 */
+		std::string to_string(void) const;
+	};
+
+private:
+
+	/*
+	 * Region coverage by kept area
+	 */
+	enum COVERAGE { OUTSIDE, PARTIAL, INSIDE };
+
+	/*
+	 * Kept area (an inclusive chunk rectangle, or a chunk radius around a center)
+	 */
+	bool radius_mode;
+	int min_x, min_z, max_x, max_z;
+	long long radius_sq;
+	int center_x, center_z;
+
+	/*
+	 * Region file paths to trim
+	 */
+	std::vector<std::string> paths;
+
+	/*
+	 * Worker thread count
+	 */
+	unsigned int threads;
+
+	/*
+	 * Merged report
+	 */
+	report result;
+	std::mutex lock;
+
+	/*
+	 * Raw world constructor
+	 */
+	raw_world(unsigned int threads) : radius_mode(false), min_x(0), min_z(0), max_x(0), max_z(0), radius_sq(0),
+			center_x(0), center_z(0), threads(threads) { return; }
+
+	/*
+	 * Returns a region's coverage by the kept area
+	 */
+	unsigned int coverage(int x, int z);
+
+	/*
+	 * Returns true if a chunk at a given chunk x, z coord is kept
+	 */
+	bool keep(int x, int z);
+
+	/*
+	 * Move (or copy) a chunk between region directories, returning false if no
+	 * source chunk exists
+	 */
+	static bool transfer(const std::string &src_dir, int src_x, int src_z, const std::string &dst_dir, int dst_x, int dst_z, bool move);
+
+	/*
+	 * Trim a single region file
+	 */
+	void trim_file(const std::string &path, int x, int z, report &rep);
+
+	/*
+	 * Trim every region file in a directory in parallel
+	 */
+	report trim(const std::string &dir);
+
+	/*
+	 * Trim a region & merge its report (called concurrently from worker threads)
+	 */
+	void visit(size_t index);
+
+public:
+
+	/*
+	 * Copy a chunk between region directories (either may be the same),
+	 * returning false if no source chunk exists
+	 */
+	static bool copy_chunk(const std::string &src_dir, int src_x, int src_z, const std::string &dst_dir, int dst_x, int dst_z);
+
+	/*
+	 * Move a chunk between region directories (either may be the same),
+	 * returning false if no source chunk exists
+	 */
+	static bool move_chunk(const std::string &src_dir, int src_x, int src_z, const std::string &dst_dir, int dst_x, int dst_z);
+
+	/*
+	 * Remove a chunk, returning false if no chunk exists
+	 */
+	static bool remove_chunk(const std::string &dir, int x, int z);
+
+	/*
+	 * Returns a region file's path in a directory at a given region x, z coord
+	 */
+	static std::string region_path(const std::string &dir, int x, int z);
+
+	/*
+	 * Remove every chunk farther than a chunk radius from a center chunk
+	 */
+	static report trim_radius(const std::string &dir, int x, int z, unsigned int radius, unsigned int threads);
+
+	/*
+	 * Remove every chunk outside an inclusive chunk coord rectangle
+	 */
+	static report trim_rect(const std::string &dir, int min_x, int min_z, int max_x, int max_z, unsigned int threads);
+};
+
+#endif
@@ -112,9 +112,6 @@ void region::generate(int x, int z, region &reg) {
  * Generate a new chunk in a region
  */
 void region::generate_chunk(unsigned int x, unsigned int z, region &reg) {
-	unsigned char count;
-	unsigned int length, offset;
-	unsigned int pos = region_dim::HEADER_OFFSET;
 	unsigned int index = z * region_dim::CHUNK_WIDTH + x;
 
 	// check for valid index
@@ -124,6 +121,18 @@ void region::generate_chunk(unsigned int x, unsigned int z, region &reg) {
 	// cleanup old tags and assign new chunk
 	reg.get_tag_at(index).clean_root();
 	reg.get_tag_at(index) = chunk_tag();
+	generate_chunk_tag(reg.get_tag_at(index));
+
+	// size only the new chunk, then update the header from cached lengths
+	reg.get_header().set_info_at(index, chunk_info(((region_dim::HEADER_OFFSET / region_dim::SECTOR_SIZE) << 8) | 1,
+			reg.get_tag_at(index).get_data().size(), chunk_info::ZLIB, 0));
+	reg.layout();
+}
+
+/*
+ * Generate a new, empty chunk tag
+ */
+void region::generate_chunk_tag(chunk_tag &tag) {
 
 	// generate new sub-tags
 	compound_tag *level = new compound_tag("Level");
@@ -158,21 +167,7 @@ void region::generate_chunk(unsigned int x, unsigned int z, region &reg) {
 	level->push_back(terrain_populated);
 	level->push_back(height_map);
 	level->push_back(sections);
-	reg.get_tag_at(index).get_root_tag().push_back(level);
-
-	// update header to reflect changes
-	for(unsigned int i = 0; i < region_dim::CHUNK_COUNT; ++i) {
-
-		// skip over unfilled chunks
-		if(!reg.is_filled(i)
-				&& i != index)
-			continue;
-		length = reg.get_tag_at(i).get_data().size();
-		count = (length / region_dim::SECTOR_SIZE) + 1;
-		offset = pos / region_dim::SECTOR_SIZE;
-		reg.get_header().set_info_at(i, chunk_info((offset << 8) | count, length, chunk_info::ZLIB, 0));
-		pos += count * region_dim::SECTOR_SIZE;
-	}
+	tag.get_root_tag().push_back(level);
 }
 
 /*
@@ -197,6 +192,23 @@ bool region::is_filled(unsigned int index) {
 	return !header.get_info_at(index).empty();
 }
 
+/*
+ * Lay out filled chunks back-to-back from their cached header lengths
+ */
+void region::layout(void) {
+	unsigned int count, pos = region_dim::HEADER_OFFSET / region_dim::SECTOR_SIZE;
+
+	// assign each filled chunk the sectors following the previous chunk
+	for(unsigned int i = 0; i < region_dim::CHUNK_COUNT; ++i) {
+		chunk_info &info = header.get_info_at(i);
+		if(info.empty())
+			continue;
+		count = (info.get_length() / region_dim::SECTOR_SIZE) + 1;
+		info.set_offset((pos << 8) | count);
+		pos += count;
+	}
+}
+
 /*
  * Sets a region's tags
  */
@@ -96,6 +96,11 @@ public:
 	 */
 	static void generate_chunk(unsigned int x, unsigned int z, region &reg);
 
+	/*
+	 * Generate a new, empty chunk tag
+	 */
+	static void generate_chunk_tag(chunk_tag &tag);
+
 	/*
 	 * Returns a region's header
 	 */
@@ -126,6 +131,11 @@ public:
 	 */
 	bool is_filled(unsigned int index);
 
+	/*
+	 * Lay out filled chunks back-to-back from their cached header lengths
+	 */
+	void layout(void);
+
 	/*
 	 * Sets a region's header
 	 */
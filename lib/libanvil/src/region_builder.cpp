@@ -0,0 +1,106 @@
+/*
+ * region_builder.cpp
+ * Copyright (C) 2012 David Jolly
+ * ----------------------
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdexcept>
+#include "chunk_info.hpp"
+#include "region_builder.hpp"
+#include "region_dim.hpp"
+
+/*
+ * Region builder constructor
+ */
+region_builder::region_builder(const std::string &path, int x, int z) : writer(path) {
+	region::generate(x, z, writer.get_region());
+}
+
+/*
+ * Add (or replace) an empty chunk at a given x, z coord, returning its tag
+ */
+chunk_tag &region_builder::add_chunk(unsigned int x, unsigned int z) {
+	unsigned int pos = index(x, z);
+	chunk_tag &tag = writer.get_region().get_tag_at(pos);
+
+	// cleanup old tags and assign new chunk
+	tag.clean_root();
+	tag = chunk_tag();
+	region::generate_chunk_tag(tag);
+	mark_filled(pos);
+	return tag;
+}
+
+/*
+ * Returns a chunk's tag at a given x, z coord
+ */
+chunk_tag &region_builder::get_chunk(unsigned int x, unsigned int z) {
+	unsigned int pos = index(x, z);
+
+	// check if filled
+	if(!writer.get_region().is_filled(pos))
+		throw std::runtime_error("Chunk does not exist");
+	return writer.get_region().get_tag_at(pos);
+}
+
+/*
+ * Returns a chunk's header index at a given x, z coord
+ */
+unsigned int region_builder::index(unsigned int x, unsigned int z) {
+
+	// check for valid coord
+	if(x >= region_dim::CHUNK_WIDTH
+			|| z >= region_dim::CHUNK_WIDTH)
+		throw std::out_of_range("coord out-of-range");
+	return z * region_dim::CHUNK_WIDTH + x;
+}
+
+/*
+ * Mark a chunk as filled (its sectors are assigned when finished)
+ */
+void region_builder::mark_filled(unsigned int index) {
+
+	// any non-zero offset marks a chunk as filled; the writer lays out real
+	// offsets from each chunk's encoded size
+	writer.get_region().get_header().set_info_at(index, chunk_info(((region_dim::HEADER_OFFSET / region_dim::SECTOR_SIZE) << 8) | 1,
+			0, chunk_info::ZLIB, 0));
+}
+
+/*
+ * Remove a chunk at a given x, z coord
+ */
+void region_builder::remove_chunk(unsigned int x, unsigned int z) {
+	unsigned int pos = index(x, z);
+	chunk_tag &tag = writer.get_region().get_tag_at(pos);
+
+	// cleanup old tags & clear header entry
+	tag.clean_root();
+	tag = chunk_tag();
+	writer.get_region().get_header().set_info_at(pos, chunk_info(0, 0, chunk_info::ZLIB, 0));
+}
+
+/*
+ * Set (or replace) a chunk at a given x, z coord with a copy of a tag
+ */
+void region_builder::set_chunk(unsigned int x, unsigned int z, chunk_tag &tag) {
+	unsigned int pos = index(x, z);
+
+	// cleanup old tags and assign a deep copy (tags are not shared)
+	writer.get_region().get_tag_at(pos).clean_root();
+	writer.get_region().get_tag_at(pos) = chunk_tag();
+	writer.get_region().get_tag_at(pos).copy(tag);
+	mark_filled(pos);
+}
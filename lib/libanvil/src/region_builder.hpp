@@ -0,0 +1,124 @@
+/*
+ * region_builder.hpp
+ * Copyright (C) 2012 David Jolly
+ * ----------------------
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef REGION_BUILDER_HPP_
+#define REGION_BUILDER_HPP_
+
+#include <string>
+#include "chunk_tag.hpp"
+#include "region.hpp"
+#include "region_file_writer.hpp"
+
+class region_builder {
+private:
+
+	/*
+	 * Region file writer holding the region under construction
+	 */
+	region_file_writer writer;
+
+	/*
+	 * Region builder constructor (non-copyable)
+	 */
+	region_builder(const region_builder &other);
+
+	/*
+	 * Region builder assignment operator (non-copyable)
+	 */
+	region_builder &operator=(const region_builder &other);
+
+	/*
+	 * Returns a chunk's header index at a given x, z coord
+	 */
+	static unsigned int index(unsigned int x, unsigned int z);
+
+	/*
+	 * Mark a chunk as filled (its sectors are assigned when finished)
+	 */
+	void mark_filled(unsigned int index);
+
+public:
+
+	/*
+	 * Region builder constructor
+	 */
+	region_builder(const std::string &path, int x, int z);
+
+	/*
+	 * Region builder destructor
+	 */
+	virtual ~region_builder(void) { return; }
+
+	/*
+	 * Add (or replace) an empty chunk at a given x, z coord, returning its tag
+	 */
+	chunk_tag &add_chunk(unsigned int x, unsigned int z);
+
+	/*
+	 * Serialize & deflate every chunk once, lay out sectors & write the region
+	 */
+	void finish(void) { writer.write(); }
+
+	/*
+	 * Returns a chunk's tag at a given x, z coord
+	 */
+	chunk_tag &get_chunk(unsigned int x, unsigned int z);
+
+	/*
+	 * Returns a region builder's filled chunk count
+	 */
+	unsigned int get_count(void) { return writer.get_region().get_header().get_count(); }
+
+	/*
+	 * Returns a region builder's region
+	 */
+	region &get_region(void) { return writer.get_region(); }
+
+	/*
+	 * Returns a region builder's writer
+	 */
+	region_file_writer &get_writer(void) { return writer; }
+
+	/*
+	 * Returns true if a chunk exists at a given x, z coord
+	 */
+	bool is_filled(unsigned int x, unsigned int z) { return writer.get_region().is_filled(index(x, z)); }
+
+	/*
+	 * Remove a chunk at a given x, z coord
+	 */
+	void remove_chunk(unsigned int x, unsigned int z);
+
+	/*
+	 * Set (or replace) a chunk at a given x, z coord with a copy of a tag
+	 */
+	void set_chunk(unsigned int x, unsigned int z, chunk_tag &tag);
+
+	/*
+	 * Sets a region builder's deflate level (0-9)
+	 */
+	void set_level(int level) { writer.set_level(level); }
+
+	/*
+	 * Sets a region builder's worker thread count (0 uses the hardware concurrency)
+	 */
+	void set_threads(unsigned int threads) { writer.set_threads(threads); }
+};
+
+#endif
@@ -0,0 +1,365 @@
+/*
+ * region_checker.cpp
+ * Copyright (C) 2012 David Jolly
+ * ----------------------
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include "chunk_info.hpp"
+#include "region_checker.hpp"
+#include "region_dim.hpp"
+#include "region_file.hpp"
+#include "region_file_reader.hpp"
+#include "region_header.hpp"
+#include "tag/byte_array_tag.hpp"
+#include "tag/byte_tag.hpp"
+#include "tag/compound_tag.hpp"
+#include "tag/int_array_tag.hpp"
+#include "tag/int_tag.hpp"
+#include "tag/list_tag.hpp"
+
+/*
+ * Problem type names
+ */
+const std::string region_checker::PROBLEM_NAME[PROBLEM_COUNT] = {
+	"read_failed", "bad_file_size", "bad_offset", "out_of_file", "overlap", "bad_length", "bad_compression",
+	"inflate_failed", "parse_failed", "bad_structure",
+};
+
+/*
+ * Returns a JSON representation of a report
+ */
+std::string region_checker::report::to_json(void) const {
+	std::stringstream ss;
+
+	// form summary
+	ss << "{\"regions\":" << regions << ",\"chunks\":" << chunks << ",\"bad_chunks\":" << bad_chunks << ",\"issues\":[";
+
+	// form one object per issue
+	for(unsigned int i = 0; i < issues.size(); ++i) {
+		const issue &iss = issues.at(i);
+		if(i)
+			ss << ",";
+		ss << "{\"path\":\"" << escape(iss.path) << "\"";
+		if(iss.x != NO_CHUNK)
+			ss << ",\"x\":" << iss.x << ",\"z\":" << iss.z;
+		ss << ",\"problem\":\"" << PROBLEM_NAME[iss.problem] << "\",\"detail\":\"" << escape(iss.detail) << "\"}";
+	}
+	ss << "]}";
+	return ss.str();
+}
+
+/*
+ * Returns a string representation of a report
+ */
+std::string region_checker::report::to_string(void) const {
+	std::stringstream ss;
+
+	// form string representation
+	ss << "Regions: " << regions << ", chunks: " << chunks << ", bad chunks: " << bad_chunks << ", issues: " << issues.size();
+	return ss.str();
+}
+
+/*
+ * Check every region file in a directory in parallel
+ */
+region_checker::report region_checker::check(const std::string &dir, const options &opt) {
+	report rep;
+	std::vector<std::string> errors;
+	region_checker checker(opt);
+
+	// collect region files in a stable order
+	region_file::list_region_files(dir, checker.paths);
+	checker.results.resize(checker.paths.size());
+
+	// check regions in parallel (failed reads are reported as issues, so no
+	// region errors are collected)
+	region_file::for_each(checker.paths, opt.threads, checker, errors);
+
+	// merge per-region reports in path order, so output is stable across thread counts
+	for(unsigned int i = 0; i < checker.results.size(); ++i) {
+		report &res = checker.results.at(i);
+		rep.regions += res.regions;
+		rep.chunks += res.chunks;
+		rep.bad_chunks += res.bad_chunks;
+		rep.issues.insert(rep.issues.end(), res.issues.begin(), res.issues.end());
+	}
+	return rep;
+}
+
+/*
+ * Check a single region file, returning its report
+ */
+region_checker::report region_checker::check_file(const std::string &path, const options &opt) {
+	decode_context context;
+
+	return check_file(path, opt, context);
+}
+
+/*
+ * Check a single region file, reusing a decode context
+ */
+region_checker::report region_checker::check_file(const std::string &path, const options &opt, decode_context &context) {
+	int x = 0, z = 0;
+	size_t pos;
+	unsigned int length, sectors, end;
+	report rep;
+	region_header header;
+	std::string detail;
+	std::vector<char> buff;
+	std::vector<int> owner;
+	std::vector<bool> bad(region_dim::CHUNK_COUNT, false);
+	const unsigned char *prefix;
+	std::ifstream file(path.c_str(), std::ios::in | std::ios::binary);
+
+	// read header & remaining file in one call each
+	rep.regions = 1;
+	if(!file.is_open()
+			|| !header.read_data(file)) {
+		rep.issues.push_back(issue(path, NO_CHUNK, NO_CHUNK, READ_FAILED, "failed to read region header"));
+		return rep;
+	}
+	file.seekg(0, std::ios::end);
+	buff.resize((size_t) file.tellg());
+	file.seekg(0, std::ios::beg);
+	file.read(buff.data(), buff.size());
+	if(file.gcount() != (std::streamsize) buff.size()) {
+		rep.issues.push_back(issue(path, NO_CHUNK, NO_CHUNK, READ_FAILED, "failed to read region file"));
+		return rep;
+	}
+	region_file::is_region_file(path, x, z);
+	if(buff.size() % region_dim::SECTOR_SIZE) {
+		std::stringstream ss;
+		ss << "file size " << buff.size() << " is not a multiple of the sector size";
+		rep.issues.push_back(issue(path, NO_CHUNK, NO_CHUNK, BAD_FILE_SIZE, ss.str()));
+	}
+	sectors = (buff.size() + region_dim::SECTOR_SIZE - 1) / region_dim::SECTOR_SIZE;
+	owner.assign(sectors, -1);
+
+	// check each chunk's header entry, sector run & payload
+	for(unsigned int i = 0; i < region_dim::CHUNK_COUNT; ++i) {
+		chunk_info &info = header.get_info_at(i);
+		int c_x = i % region_dim::CHUNK_WIDTH, c_z = i / region_dim::CHUNK_WIDTH;
+		std::stringstream ss;
+		if(info.empty())
+			continue;
+		++rep.chunks;
+
+		// check sector run against the header & file end
+		if(!info.get_sector_count()
+				|| info.get_sector() < region_dim::HEADER_OFFSET / region_dim::SECTOR_SIZE) {
+			ss << "sector run " << info.get_sector() << "+" << info.get_sector_count() << " is invalid";
+			rep.issues.push_back(issue(path, c_x, c_z, BAD_OFFSET, ss.str()));
+			bad[i] = true;
+			continue;
+		}
+		end = info.get_sector() + info.get_sector_count();
+		if(end > sectors) {
+			ss << "sector run " << info.get_sector() << "+" << info.get_sector_count() << " ends past sector " << sectors;
+			rep.issues.push_back(issue(path, c_x, c_z, OUT_OF_FILE, ss.str()));
+			bad[i] = true;
+			continue;
+		}
+
+		// check for sectors shared with an earlier chunk
+		for(unsigned int j = info.get_sector(); j < end; ++j) {
+			if(owner.at(j) != -1
+					&& !bad[i]) {
+				ss << "sector " << j << " is shared with chunk (" << owner.at(j) % region_dim::CHUNK_WIDTH
+						<< ", " << owner.at(j) / region_dim::CHUNK_WIDTH << ")";
+				rep.issues.push_back(issue(path, c_x, c_z, OVERLAP, ss.str()));
+				bad[owner.at(j)] = true;
+				bad[i] = true;
+			}
+			owner.at(j) = i;
+		}
+		ss.str("");
+
+		// check length (including the compression type byte) against the sector run
+		pos = (size_t) info.get_sector() * region_dim::SECTOR_SIZE;
+		prefix = reinterpret_cast<const unsigned char *>(&buff[pos]);
+		length = (prefix[0] << 24) | (prefix[1] << 16) | (prefix[2] << 8) | prefix[3];
+		if(length < 2
+				|| (size_t) length + sizeof(int) > (size_t) info.get_sector_count() * region_dim::SECTOR_SIZE
+				|| pos + sizeof(int) + length > buff.size()) {
+			ss << "length " << length << " does not fit " << info.get_sector_count() << " sector(s)";
+			rep.issues.push_back(issue(path, c_x, c_z, BAD_LENGTH, ss.str()));
+			bad[i] = true;
+			continue;
+		}
+
+		// check compression type & inflate
+		if(prefix[sizeof(int)] != chunk_info::GZIP
+				&& prefix[sizeof(int)] != chunk_info::ZLIB) {
+			ss << "unknown compression type " << (unsigned int) prefix[sizeof(int)];
+			rep.issues.push_back(issue(path, c_x, c_z, BAD_COMPRESSION, ss.str()));
+			bad[i] = true;
+			continue;
+		}
+		if(!context.inflate_(&buff[pos + sizeof(int) + sizeof(char)], length - 1)) {
+			rep.issues.push_back(issue(path, c_x, c_z, INFLATE_FAILED, "payload does not inflate"));
+			bad[i] = true;
+			continue;
+		}
+
+		// optionally parse & check structure
+		if(!opt.deep)
+			continue;
+		chunk_tag tag;
+		try {
+			region_file_reader::parse_chunk_tag(context.get_data(), tag);
+		} catch(std::exception &exc) {
+			rep.issues.push_back(issue(path, c_x, c_z, PARSE_FAILED, exc.what()));
+			bad[i] = true;
+			continue;
+		}
+		detail = check_structure(tag, x * (int) region_dim::CHUNK_WIDTH + c_x, z * (int) region_dim::CHUNK_WIDTH + c_z);
+		if(!detail.empty()) {
+			rep.issues.push_back(issue(path, c_x, c_z, BAD_STRUCTURE, detail));
+			bad[i] = true;
+		}
+	}
+	rep.bad_chunks = std::count(bad.begin(), bad.end(), true);
+	return rep;
+}
+
+/*
+ * Check a chunk's NBT structure, returning a description of the first
+ * problem found (or an empty string)
+ */
+std::string region_checker::check_structure(chunk_tag &tag, int x, int z) {
+	unsigned int y, seen = 0;
+	generic_tag *sub_tag;
+	compound_tag *level, *sect;
+	list_tag *sect_list;
+	std::stringstream ss;
+
+	// check level compound & position
+	sub_tag = tag.get_root_tag().find("Level");
+	if(!sub_tag
+			|| sub_tag->get_type() != generic_tag::COMPOUND)
+		return "missing Level compound";
+	level = static_cast<compound_tag *>(sub_tag);
+	sub_tag = level->find("xPos");
+	generic_tag *z_tag = level->find("zPos");
+	if(!sub_tag
+			|| sub_tag->get_type() != generic_tag::INT
+			|| !z_tag
+			|| z_tag->get_type() != generic_tag::INT)
+		return "missing xPos/zPos";
+	if(static_cast<int_tag *>(sub_tag)->get_value() != x
+			|| static_cast<int_tag *>(z_tag)->get_value() != z) {
+		ss << "position (" << static_cast<int_tag *>(sub_tag)->get_value() << ", " << static_cast<int_tag *>(z_tag)->get_value()
+				<< ") does not match chunk (" << x << ", " << z << ")";
+		return ss.str();
+	}
+
+	// check per-column arrays
+	sub_tag = level->find("Biomes");
+	if(sub_tag
+			&& (sub_tag->get_type() != generic_tag::BYTE_ARRAY
+			|| static_cast<byte_array_tag *>(sub_tag)->size() != region_dim::BLOCK_COUNT))
+		return "malformed Biomes";
+	sub_tag = level->find("HeightMap");
+	if(sub_tag
+			&& (sub_tag->get_type() != generic_tag::INT_ARRAY
+			|| static_cast<int_array_tag *>(sub_tag)->size() != region_dim::BLOCK_COUNT))
+		return "malformed HeightMap";
+
+	// check sections
+	sub_tag = level->find("Sections");
+	if(!sub_tag)
+		return "";
+	if(sub_tag->get_type() != generic_tag::LIST)
+		return "malformed Sections";
+	sect_list = static_cast<list_tag *>(sub_tag);
+	for(unsigned int i = 0; i < sect_list->size(); ++i) {
+		if(sect_list->at(i)->get_type() != generic_tag::COMPOUND)
+			return "malformed section";
+		sect = static_cast<compound_tag *>(sect_list->at(i));
+		sub_tag = sect->find("Y");
+		if(!sub_tag
+				|| sub_tag->get_type() != generic_tag::BYTE)
+			return "section missing Y";
+		y = (unsigned char) static_cast<byte_tag *>(sub_tag)->get_value();
+		ss << "section " << y << ": ";
+		if(y >= region_dim::SECTION_COUNT)
+			return ss.str() + "Y out-of-range";
+		if(seen & (1 << y))
+			return ss.str() + "duplicate Y";
+		seen |= 1 << y;
+		sub_tag = sect->find("Blocks");
+		if(!sub_tag
+				|| sub_tag->get_type() != generic_tag::BYTE_ARRAY
+				|| static_cast<byte_array_tag *>(sub_tag)->size() != region_dim::SECTION_BLOCK_COUNT)
+			return ss.str() + "malformed Blocks";
+		const char *nibbles[] = { "Add", "Data", "BlockLight", "SkyLight" };
+		for(unsigned int j = 0; j < sizeof(nibbles) / sizeof(*nibbles); ++j) {
+			sub_tag = sect->find(nibbles[j]);
+			if(sub_tag
+					&& (sub_tag->get_type() != generic_tag::BYTE_ARRAY
+					|| static_cast<byte_array_tag *>(sub_tag)->size() != region_dim::SECTION_BLOCK_COUNT / 2))
+				return ss.str() + "malformed " + nibbles[j];
+		}
+		ss.str("");
+	}
+	return "";
+}
+
+/*
+ * Escape a string for use within a JSON string
+ */
+std::string region_checker::escape(const std::string &str) {
+	char hex[8];
+	std::string out;
+
+	// escape quotes, backslashes & control characters
+	for(unsigned int i = 0; i < str.size(); ++i)
+		switch(str.at(i)) {
+			case '"': out += "\\\"";
+				break;
+			case '\\': out += "\\\\";
+				break;
+			default:
+				if((unsigned char) str.at(i) < 0x20) {
+					sprintf(hex, "\\u%04x", (unsigned char) str.at(i));
+					out += hex;
+				} else
+					out += str.at(i);
+				break;
+		}
+	return out;
+}
+
+/*
+ * Check a region into its report slot, reporting a failed read as an issue
+ * (called concurrently from worker threads)
+ */
+void region_checker::visit(size_t index) {
+
+	// check region (each worker writes only its claimed slot)
+	try {
+		results.at(index) = check_file(paths.at(index), opt);
+	} catch(std::exception &exc) {
+		results.at(index) = report();
+		results.at(index).regions = 1;
+		results.at(index).issues.push_back(issue(paths.at(index), NO_CHUNK, NO_CHUNK, READ_FAILED, exc.what()));
+	}
+}
@@ -0,0 +1,204 @@
+/*
+ * region_checker.hpp
+ * Copyright (C) 2012 David Jolly
+ * ----------------------
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef REGION_CHECKER_HPP_
+#define REGION_CHECKER_HPP_
+
+#include <string>
+#include <vector>
+#include "chunk_tag.hpp"
+#include "decode_context.hpp"
+#include "region_visitor.hpp"
+
+/*
+ * Read-only integrity checks over region files (header & sector layout,
+ * compression & inflate, and optionally a full NBT parse with structural checks)
+ */
+class region_checker : private region_visitor {
+public:
+
+	/*
+	 * Problem types
+	 */
+	enum PROBLEM { READ_FAILED, BAD_FILE_SIZE, BAD_OFFSET, OUT_OF_FILE, OVERLAP, BAD_LENGTH, BAD_COMPRESSION,
+			INFLATE_FAILED, PARSE_FAILED, BAD_STRUCTURE };
+	static const unsigned int PROBLEM_COUNT = 10;
+	static const std::string PROBLEM_NAME[PROBLEM_COUNT];
+
+	/*
+	 * Region-wide problem chunk coord
+	 */
+	static const int NO_CHUNK = -1;
+
+	/*
+	 * Check options
+	 */
+	class options {
+	public:
+
+		/*
+		 * Worker thread count (0 uses the hardware concurrency)
+		 */
+		unsigned int threads;
+
+		/*
+		 * Parse each chunk's NBT & check its structure
+		 */
+		bool deep;
+
+		/*
+		 * Options constructor
+		 */
+		options(void) : threads(0), deep(false) { return; }
+	};
+
+	/*
+	 * Problem found in a region file
+	 */
+	class issue {
+	public:
+
+		/*
+		 * Region file path
+		 */
+		std::string path;
+
+		/*
+		 * Chunk x, z coord within the region (NO_CHUNK for region-wide problems)
+		 */
+		int x, z;
+
+		/*
+		 * Problem type & detail
+		 */
+		unsigned int problem;
+		std::string detail;
+
+		/*
+		 * Issue constructor
+		 */
+		issue(const std::string &path, int x, int z, unsigned int problem, const std::string &detail) : path(path), x(x), z(z),
+				problem(problem), detail(detail) { return; }
+	};
+
+	/*
+	 * Check report
+	 */
+	class report {
+	public:
+
+		/*
+		 * Regions & chunks checked
+		 */
+		unsigned int regions, chunks;
+
+		/*
+		 * Chunks with at least one problem
+		 */
+		unsigned int bad_chunks;
+
+		/*
+		 * Problems found, ordered by path
+		 */
+		std::vector<issue> issues;
+
+		/*
+		 * Report constructor
+		 */
+		report(void) : regions(0), chunks(0), bad_chunks(0) { return; }
+
+		/*
+		 * Returns a report's clean status
+		 */
+		bool clean(void) const { return issues.empty(); }
+
+		/*
+		 * Returns a JSON representation of a report
+		 */
+		std::string to_json(void) const;
+
+		/*
+		 * Returns a string representation of a report
+		 */
+		std::string to_string(void) const;
+	};
+
+private:
+
+	/*
+	 * Region file paths to check
+	 */
+	std::vector<std::string> paths;
+
+	/*
+	 * Check options
+	 */
+	const options &opt;
+
+	/*
+	 * Per-region reports, merged in path order
+	 */
+	std::vector<report> results;
+
+	/*
+	 * Region checker constructor
+	 */
+	region_checker(const options &opt) : opt(opt) { return; }
+
+	/*
+	 * Check a chunk's NBT structure, returning a description of the first
+	 * problem found (or an empty string)
+	 */
+	static std::string check_structure(chunk_tag &tag, int x, int z);
+
+	/*
+	 * Check a single region file, reusing a decode context
+	 */
+	static report check_file(const std::string &path, const options &opt, decode_context &context);
+
+	/*
+	 * Escape a string for use within a JSON string
+	 */
+	static std::string escape(const std::string &str);
+
+	/*
+	 * Check a region into its report slot, reporting a failed read as an issue
+	 * (called concurrently from worker threads)
+	 */
+	void visit(size_t index);
+
+public:
+
+	/*
+	 * Check every region file in a directory in parallel
+	 */
+	static report check(const std::string &dir, const options &opt);
+
+	/*
+	 * Check every region file in a directory in parallel (default options)
+	 */
+	static report check(const std::string &dir) { return check(dir, options()); }
+
+	/*
+	 * Check a single region file, returning its report
+	 */
+	static report check_file(const std::string &path, const options &opt);
+};
+
+#endif
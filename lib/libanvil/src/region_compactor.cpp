@@ -0,0 +1,106 @@
+/*
+ * region_compactor.cpp
+ * Copyright (C) 2012 David Jolly
+ * ----------------------
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <boost/filesystem.hpp>
+#include <sstream>
+#include <stdexcept>
+#include "chunk_info.hpp"
+#include "compression.hpp"
+#include "region_compactor.hpp"
+#include "region_file.hpp"
+
+/*
+ * Returns a string representation of a report
+ */
+std::string region_compactor::report::to_string(void) const {
+	std::stringstream ss;
+
+	// form string representation
+	ss << "Regions: " << regions << ", chunks: " << chunks << ", size: " << before << " -> " << after
+			<< " (" << get_reclaimed() << " bytes reclaimed), errors: " << errors.size();
+	return ss.str();
+}
+
+/*
+ * Compact every region file in a directory in parallel
+ */
+region_compactor::report region_compactor::compact(const std::string &dir, const options &opt) {
+	region_compactor compactor(opt);
+
+	// collect region files in a stable order
+	region_file::list_region_files(dir, compactor.paths);
+
+	// compact regions in parallel (failed regions are left untouched)
+	region_file::for_each(compactor.paths, opt.threads, compactor, compactor.result.errors);
+	return compactor.result;
+}
+
+/*
+ * Compact a single region file, returning its report
+ */
+region_compactor::report region_compactor::compact_file(const std::string &path, const options &opt) {
+	report rep;
+	raw_region reg(path);
+	decode_context context;
+
+	// optionally recompress, otherwise keep compressed bytes as-is
+	rep.before = boost::filesystem::file_size(path);
+	if(opt.level != KEEP_LEVEL)
+		for(unsigned int i = 0; i < region_dim::CHUNK_COUNT; ++i)
+			if(!reg.get_chunk(i).empty())
+				recompress(reg.get_chunk(i), context, opt.level);
+
+	// rewrite chunks back-to-back in storage order
+	reg.write(path, opt.order);
+	rep.after = boost::filesystem::file_size(path);
+	rep.regions = 1;
+	rep.chunks = reg.get_count();
+	return rep;
+}
+
+/*
+ * Inflate & deflate a raw chunk at a new level
+ */
+void region_compactor::recompress(raw_region::raw_chunk &chunk, decode_context &context, int level) {
+
+	// check for compression type
+	if(chunk.type != chunk_info::GZIP
+			&& chunk.type != chunk_info::ZLIB)
+		throw std::runtime_error("Unknown compression type");
+	if(!context.inflate_(chunk.data.data(), chunk.data.size()))
+		throw std::runtime_error("Failed to inflate chunk");
+	chunk.data = context.get_data();
+	if(!compression::deflate_(chunk.data, level))
+		throw std::runtime_error("Failed to deflate chunk");
+	chunk.type = chunk_info::ZLIB;
+}
+
+/*
+ * Compact a region & merge its report (called concurrently from worker threads)
+ */
+void region_compactor::visit(size_t index) {
+	report rep = compact_file(paths.at(index), opt);
+
+	lock.lock();
+	result.regions += rep.regions;
+	result.chunks += rep.chunks;
+	result.before += rep.before;
+	result.after += rep.after;
+	lock.unlock();
+}
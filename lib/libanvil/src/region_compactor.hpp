@@ -0,0 +1,153 @@
+/*
+ * region_compactor.hpp
+ * Copyright (C) 2012 David Jolly
+ * ----------------------
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef REGION_COMPACTOR_HPP_
+#define REGION_COMPACTOR_HPP_
+
+#include <mutex>
+#include <string>
+#include <vector>
+#include "decode_context.hpp"
+#include "raw_region.hpp"
+#include "region_visitor.hpp"
+
+class region_compactor : private region_visitor {
+public:
+
+	/*
+	 * Keep each chunk's compressed bytes as-is
+	 */
+	static const int KEEP_LEVEL = -1;
+
+	/*
+	 * Compaction options
+	 */
+	class options {
+	public:
+
+		/*
+		 * Worker thread count (0 uses the hardware concurrency)
+		 */
+		unsigned int threads;
+
+		/*
+		 * Chunk storage order (raw_region::ORDER)
+		 */
+		unsigned int order;
+
+		/*
+		 * Recompression level (KEEP_LEVEL copies compressed bytes)
+		 */
+		int level;
+
+		/*
+		 * Options constructor
+		 */
+		options(void) : threads(0), order(raw_region::ROW_MAJOR), level(KEEP_LEVEL) { return; }
+	};
+
+	/*
+	 * Compaction report
+	 */
+	class report {
+	public:
+
+		/*
+		 * Regions & chunks rewritten
+		 */
+		unsigned int regions, chunks;
+
+		/*
+		 * Total file sizes before & after compaction
+		 */
+		unsigned long long before, after;
+
+		/*
+		 * Regions left untouched due to errors
+		 */
+		std::vector<std::string> errors;
+
+		/*
+		 * Report constructor
+		 */
+		report(void) : regions(0), chunks(0), before(0), after(0) { return; }
+
+		/*
+		 * Returns the number of bytes reclaimed
+		 */
+		long long get_reclaimed(void) const { return (long long) before - (long long) after; }
+
+		/*
+		 * Returns a string representation of a report
+		 */
+		std::string to_string(void) const;
+	};
+
+private:
+
+	/*
+	 * Region file paths to compact
+	 */
+	std::vector<std::string> paths;
+
+	/*
+	 * Compaction options
+	 */
+	const options &opt;
+
+	/*
+	 * Merged report
+	 */
+	report result;
+	std::mutex lock;
+
+	/*
+	 * Region compactor constructor
+	 */
+	region_compactor(const options &opt) : opt(opt) { return; }
+
+	/*
+	 * Inflate & deflate a raw chunk at a new level
+	 */
+	static void recompress(raw_region::raw_chunk &chunk, decode_context &context, int level);
+
+	/*
+	 * Compact a region & merge its report (called concurrently from worker threads)
+	 */
+	void visit(size_t index);
+
+public:
+
+	/*
+	 * Compact a single region file, returning its report
+	 */
+	static report compact_file(const std::string &path, const options &opt);
+
+	/*
+	 * Compact every region file in a directory in parallel
+	 */
+	static report compact(const std::string &dir, const options &opt);
+
+	/*
+	 * Compact every region file in a directory in parallel (default options)
+	 */
+	static report compact(const std::string &dir) { return compact(dir, options()); }
+};
+
+#endif
@@ -53,6 +53,16 @@ public:
 	 */
 	static const unsigned int HEADER_OFFSET = 8192;
 
+	/*
+	 * Maximum number of sections per chunk
+	 */
+	static const unsigned int SECTION_COUNT = 16;
+
+	/*
+	 * Number of blocks per chunk section
+	 */
+	static const unsigned int SECTION_BLOCK_COUNT = 4096;
+
 	/*
 	 * Region file sector size
 	 */
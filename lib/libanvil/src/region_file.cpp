@@ -17,7 +17,11 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+#include <boost/filesystem.hpp>
 #include <sstream>
+#include <stdexcept>
+#include <thread>
 #include "region_file.hpp"
 
 /*
@@ -67,6 +71,38 @@ void region_file::convert_endian(std::vector<char> &data) {
 	data = rev;
 }
 
+/*
+ * Visit every region file of a list in parallel, one region per worker at a
+ * time (the calling thread included), collecting each failed region's error
+ * as "path: what"
+ */
+void region_file::for_each(const std::vector<std::string> &paths, unsigned int threads, region_visitor &visitor,
+		std::vector<std::string> &errors) {
+	std::vector<std::thread> workers;
+	region_pass pass(paths, visitor, errors);
+
+	threads = get_thread_count(threads, paths.size());
+	for(unsigned int i = 1; i < threads; ++i)
+		workers.push_back(std::thread(&region_file::run_pass, &pass));
+	run_pass(&pass);
+	for(unsigned int i = 0; i < workers.size(); ++i)
+		workers.at(i).join();
+}
+
+/*
+ * Returns the worker thread count for a number of tasks (the requested
+ * count, or the hardware concurrency if zero, bounded by the task count)
+ */
+unsigned int region_file::get_thread_count(unsigned int threads, size_t tasks) {
+	if(!threads)
+		threads = std::thread::hardware_concurrency();
+	if(!threads)
+		threads = 1;
+	if(threads > tasks)
+		threads = tasks;
+	return threads;
+}
+
 /*
  * Returns true if a specified path is a region file
  */
@@ -86,6 +122,53 @@ bool region_file::is_region_file(const std::string &path, int &x, int &z) {
 	return true;
 }
 
+/*
+ * Collect the region files in a directory, in a stable order
+ */
+void region_file::list_region_files(const std::string &dir, std::vector<std::string> &paths) {
+	int x, z;
+
+	// check if region directory exists
+	if(!boost::filesystem::is_directory(dir))
+		throw std::runtime_error("Directory does not exist");
+
+	// collect region files in a stable order
+	boost::filesystem::directory_iterator end, iter(dir);
+	for(; iter != end; ++iter)
+		if(!boost::filesystem::is_directory(*iter)
+				&& region_file::is_region_file(iter->path().string(), x, z))
+			paths.push_back(iter->path().string());
+	std::sort(paths.begin(), paths.end());
+}
+
+/*
+ * Worker thread entry point (visits claimed regions)
+ */
+void region_file::run_pass(region_pass *pass) {
+	size_t index;
+
+	for(;;) {
+
+		// claim the next region
+		pass->lock.lock();
+		if(pass->next >= pass->paths.size()) {
+			pass->lock.unlock();
+			return;
+		}
+		index = pass->next++;
+		pass->lock.unlock();
+
+		// visit region, recording its error
+		try {
+			pass->visitor.visit(index);
+		} catch(std::exception &exc) {
+			pass->lock.lock();
+			pass->errors.push_back(pass->paths.at(index) + ": " + exc.what());
+			pass->lock.unlock();
+		}
+	}
+}
+
 /*
  * Returns a string representation of a region file
  */
@@ -21,10 +21,46 @@
 #define REGION_FILE_HPP_
 
 #include <boost/regex.hpp>
+#include <mutex>
 #include <string>
+#include <vector>
 #include "region.hpp"
+#include "region_visitor.hpp"
 
 class region_file {
+private:
+
+	/*
+	 * Parallel region pass (shared by its worker threads)
+	 */
+	class region_pass {
+	public:
+
+		/*
+		 * Region file paths, visitor & collected errors
+		 */
+		const std::vector<std::string> &paths;
+		region_visitor &visitor;
+		std::vector<std::string> &errors;
+
+		/*
+		 * Next region to claim & pass lock
+		 */
+		size_t next;
+		std::mutex lock;
+
+		/*
+		 * Region pass constructor
+		 */
+		region_pass(const std::vector<std::string> &paths, region_visitor &visitor, std::vector<std::string> &errors) :
+				paths(paths), visitor(visitor), errors(errors), next(0) { return; }
+	};
+
+	/*
+	 * Worker thread entry point (visits claimed regions)
+	 */
+	static void run_pass(region_pass *pass);
+
 public:
 
 	/*
@@ -100,6 +136,14 @@ public:
 	 */
 	static void convert_endian(std::vector<char> &data);
 
+	/*
+	 * Visit every region file of a list in parallel, one region per worker at a
+	 * time (the calling thread included), collecting each failed region's error
+	 * as "path: what"
+	 */
+	static void for_each(const std::vector<std::string> &paths, unsigned int threads, region_visitor &visitor,
+			std::vector<std::string> &errors);
+
 	/*
 	 * Generate a new region file
 	 */
@@ -120,11 +164,22 @@ public:
 	 */
 	region &get_region(void) { return reg; }
 
+	/*
+	 * Returns the worker thread count for a number of tasks (the requested
+	 * count, or the hardware concurrency if zero, bounded by the task count)
+	 */
+	static unsigned int get_thread_count(unsigned int threads, size_t tasks);
+
 	/*
 	 * Returns true if a specified path is a region file
 	 */
 	static bool is_region_file(const std::string &path, int &x, int &z);
 
+	/*
+	 * Collect the region files in a directory, in a stable order
+	 */
+	static void list_region_files(const std::string &dir, std::vector<std::string> &paths);
+
 	/*
 	 * Sets a region file's path
 	 */
@@ -228,7 +228,7 @@ bool region_file_reader::is_filled(unsigned int x, unsigned int z) {
 /*
  * Read a tag from data
  */
-generic_tag *region_file_reader::parse_tag(byte_stream &stream, bool is_list, char list_type) {
+generic_tag *region_file_reader::parse_tag(byte_stream &stream, bool is_list, char list_type, const std::set<std::string> *projection) {
 	char type;
 	short name_len;
 	std::string name;
@@ -250,6 +250,17 @@ generic_tag *region_file_reader::parse_tag(byte_stream &stream, bool is_list, ch
 		}
 	}
 
+	// skip leaf tags outside of the projection
+	if(projection
+			&& !is_list
+			&& type != generic_tag::END
+			&& type != generic_tag::LIST
+			&& type != generic_tag::COMPOUND
+			&& projection->find(name) == projection->end()) {
+		skip_value(stream, type);
+		return NULL;
+	}
+
 	// parse tag based off type
 	switch(type) {
 		case generic_tag::END:
@@ -286,7 +297,7 @@ generic_tag *region_file_reader::parse_tag(byte_stream &stream, bool is_list, ch
 
 			// parse all subtags and add to list
 			for(int i = 0; i < ele_len; ++i) {
-				sub_tag = parse_tag(stream, true, ele_type);
+				sub_tag = parse_tag(stream, true, ele_type, projection);
 				lst_tag->push_back(sub_tag);
 			}
 			tag = lst_tag;
@@ -296,12 +307,13 @@ generic_tag *region_file_reader::parse_tag(byte_stream &stream, bool is_list, ch
 
 			// parse all sub_tags and add to compound
 			do {
-				sub_tag = parse_tag(stream, false, 0);
+				sub_tag = parse_tag(stream, false, 0, projection);
 				if(!sub_tag)
-					throw std::runtime_error("Failed to parse tag");
+					continue;
 				if(sub_tag->get_type() != generic_tag::END)
 					cmp_tag->push_back(sub_tag);
-			} while(sub_tag->get_type() != generic_tag::END);
+			} while(!sub_tag
+					|| sub_tag->get_type() != generic_tag::END);
 			delete sub_tag;
 			tag = cmp_tag;
 		} break;
@@ -318,7 +330,7 @@ generic_tag *region_file_reader::parse_tag(byte_stream &stream, bool is_list, ch
 /*
  * Read a chunk tag from data
  */
-void region_file_reader::parse_chunk_tag(std::vector<char> &data, chunk_tag &tag) {
+void region_file_reader::parse_chunk_tag(std::vector<char> &data, chunk_tag &tag, const std::set<std::string> *projection) {
 	char type;
 	std::string name;
 	generic_tag *sub_tag = NULL;
@@ -339,20 +351,21 @@ void region_file_reader::parse_chunk_tag(std::vector<char> &data, chunk_tag &tag
 		do {
 
 			//parse subtag
-			sub_tag = parse_tag(bstream, false, 0);
+			sub_tag = parse_tag(bstream, false, 0, projection);
 			if(!sub_tag)
-				throw std::runtime_error("Failed to parse tag");
+				continue;
 			if(sub_tag->get_type() != generic_tag::END)
 				tag.get_root_tag().push_back(sub_tag);
-		} while(sub_tag->get_type() != generic_tag::END);
+		} while(!sub_tag
+				|| sub_tag->get_type() != generic_tag::END);
 		delete sub_tag;
 	}
 }
 
 /*
- * Reads a file into region_file
+ * Opens a file and reads its header, leaving chunks unread
  */
-void region_file_reader::read(void) {
+void region_file_reader::open(void) {
 	int x, z;
 
 	// attempt to open file
@@ -368,6 +381,15 @@ void region_file_reader::read(void) {
 
 	// read header data
 	read_header();
+}
+
+/*
+ * Reads a file into region_file
+ */
+void region_file_reader::read(void) {
+
+	// open file & read header data
+	open();
 
 	// read chunk data
 	read_chunks();
@@ -376,47 +398,77 @@ void region_file_reader::read(void) {
 	file.close();
 }
 
+/*
+ * Reads a single chunk's data from a file
+ */
+void region_file_reader::read_chunk(unsigned int index) {
+	std::vector<char> raw_vec;
+	chunk_info &info = reg.get_header().get_info_at(index);
+
+	// skip empty chunks
+	if(info.empty())
+		return;
+
+	// Retrieve raw data
+	raw_vec.resize(info.get_length());
+	file.seekg(info.get_offset(), std::ios::beg);
+	file.read(raw_vec.data(), info.get_length());
+
+	// tolerate a short read on the final (unpadded) chunk
+	if(file.gcount() <= 0)
+		throw std::runtime_error("Failed to read chunk data");
+	raw_vec.resize(file.gcount());
+	file.clear();
+
+	// check for compression type
+	switch(info.get_type()) {
+	case chunk_info::GZIP:
+		throw std::runtime_error("Unsupported compression type");
+		break;
+	case chunk_info::ZLIB:
+		compression::inflate_(raw_vec);
+		break;
+	default:
+		throw std::runtime_error("Unknown compression type");
+		break;
+	}
+
+	// use data to fill chunk tag
+	parse_chunk_tag(raw_vec, reg.get_tag_at(index));
+}
+
+/*
+ * Reads a single chunk at a given x, z coord (reopening the file if needed)
+ */
+void region_file_reader::read_chunk_at(unsigned int x, unsigned int z) {
+	unsigned int pos = z * region_dim::CHUNK_WIDTH + x;
+
+	// check coordinates
+	if(pos >= region_dim::CHUNK_COUNT)
+		throw std::out_of_range("coordinates out-of-range");
+
+	// reopen file if it was closed after reading the header
+	if(!file.is_open()) {
+		file.clear();
+		file.open(path.c_str(), std::ios::in | std::ios::binary);
+		if(!file.is_open())
+			throw std::runtime_error("Failed to open input file");
+	}
+	read_chunk(pos);
+}
+
 /*
  * Reads chunk data from a file
  */
 void region_file_reader::read_chunks(void) {
-	chunk_info info;
 
 	// check if file is open
 	if(!file.is_open())
 		throw std::runtime_error("Failed to read chunk data");
 
 	// iterate though header entries, reading in chunks if they exist
-	for(unsigned int i = 0; i < region_dim::CHUNK_COUNT; ++i) {
-		info = reg.get_header().get_info_at(i);
-
-		// skip empty chunks
-		if(info.empty())
-			continue;
-
-		// Retrieve raw data
-		char raw_data[info.get_length()];
-		std::vector<char> raw_vec;
-		file.seekg(info.get_offset(), std::ios::beg);
-		file.read((char *) raw_data, info.get_length());
-		raw_vec.assign(raw_data, raw_data + info.get_length());
-
-		// check for compression type
-		switch(info.get_type()) {
-		case chunk_info::GZIP:
-			throw std::runtime_error("Unsupported compression type");
-			break;
-		case chunk_info::ZLIB:
-			compression::inflate_(raw_vec);
-			break;
-		default:
-			throw std::runtime_error("Unknown compression type");
-			break;
-		}
-
-		// use data to fill chunk tag
-		parse_chunk_tag(raw_vec, reg.get_tag_at(i));
-	}
+	for(unsigned int i = 0; i < region_dim::CHUNK_COUNT; ++i)
+		read_chunk(i);
 }
 
 /*
@@ -481,3 +533,66 @@ std::string region_file_reader::read_string_value(byte_stream &stream) {
 		value += read_value<char>(stream);
 	return value;
 }
+
+/*
+ * Skips over a tag value of a given type in stream
+ */
+void region_file_reader::skip_value(byte_stream &stream, char type) {
+	int len;
+	char ele_type;
+	unsigned int width = 0;
+
+	// determine fixed value width
+	switch(type) {
+		case generic_tag::END:
+			return;
+		case generic_tag::BYTE: width = sizeof(char);
+			break;
+		case generic_tag::SHORT: width = sizeof(short);
+			break;
+		case generic_tag::INT:
+		case generic_tag::FLOAT: width = sizeof(int);
+			break;
+		case generic_tag::LONG:
+		case generic_tag::DOUBLE: width = sizeof(long long);
+			break;
+		case generic_tag::BYTE_ARRAY:
+			len = read_value<int>(stream);
+			if(len < 0
+					|| (unsigned int) len > stream.available() / sizeof(char))
+				throw std::runtime_error("Unexpected end of stream");
+			width = len * sizeof(char);
+			break;
+		case generic_tag::STRING:
+			width = (unsigned short) read_value<short>(stream);
+			break;
+		case generic_tag::INT_ARRAY:
+			len = read_value<int>(stream);
+			if(len < 0
+					|| (unsigned int) len > stream.available() / sizeof(int))
+				throw std::runtime_error("Unexpected end of stream");
+			width = len * sizeof(int);
+			break;
+		case generic_tag::LIST:
+			ele_type = read_value<char>(stream);
+			len = read_value<int>(stream);
+			for(int i = 0; i < len; ++i)
+				skip_value(stream, ele_type);
+			return;
+		case generic_tag::COMPOUND:
+			while((ele_type = read_value<char>(stream)) != generic_tag::END) {
+				width = (unsigned short) read_value<short>(stream);
+				stream.set_position(stream.get_position() + width);
+				skip_value(stream, ele_type);
+			}
+			return;
+		default:
+			throw std::runtime_error("Unknown tag type");
+			break;
+	}
+
+	// advance past value
+	if(width > stream.available())
+		throw std::runtime_error("Unexpected end of stream");
+	stream.set_position(stream.get_position() + width);
+}
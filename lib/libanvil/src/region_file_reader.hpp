@@ -21,6 +21,7 @@
 #define REGION_FILE_READER_HPP_
 
 #include <fstream>
+#include <set>
 #include <stdexcept>
 #include <string>
 #include "byte_stream.hpp"
@@ -35,20 +36,15 @@ private:
 	std::ifstream file;
 
 	/*
-	 * Read a chunk tag from data
-	 */
-	void parse_chunk_tag(std::vector<char> &data, chunk_tag &tag);
-
-	/*
-	 * Read a tag from data
+	 * Read a tag from data (leaf tags missing from projection are skipped)
 	 */
-	generic_tag *parse_tag(byte_stream &stream, bool is_list, char list_type);
+	static generic_tag *parse_tag(byte_stream &stream, bool is_list, char list_type, const std::set<std::string> *projection);
 
 	/*
 	 * Reads an array tag value from stream
 	 */
 	template <class T>
-	std::vector<T> read_array_value(byte_stream &stream) {
+	static std::vector<T> read_array_value(byte_stream &stream) {
 		int ele_len;
 		std::vector<T> value;
 
@@ -58,11 +54,20 @@ private:
 
 		// retrieve value
 		ele_len = read_value<int>(stream);
+		if(ele_len < 0
+				|| (unsigned int) ele_len > stream.available() / sizeof(T))
+			throw std::runtime_error("Malformed array length");
+		value.reserve(ele_len);
 		for(int i = 0; i < ele_len; ++i)
 			value.push_back(read_value<T>(stream));
 		return value;
 	}
 
+	/*
+	 * Reads a single chunk's data from a file
+	 */
+	void read_chunk(unsigned int index);
+
 	/*
 	 * Reads chunk data from a file
 	 */
@@ -76,13 +81,13 @@ private:
 	/*
 	 * Reads a string tag value from stream
 	 */
-	std::string read_string_value(byte_stream &stream);
+	static std::string read_string_value(byte_stream &stream);
 
 	/*
 	 * Reads a numeric tag value from stream
 	 */
 	template <class T>
-	T read_value(byte_stream &stream) {
+	static T read_value(byte_stream &stream) {
 		T value;
 
 		// check stream status
@@ -131,6 +136,11 @@ public:
 	 */
 	bool operator!=(const region_file_reader &other) { return !(*this == other); }
 
+	/*
+	 * Closes a region file opened with open
+	 */
+	void close(void) { file.close(); }
+
 	/*
 	 * Returns a region biome value at a given x, z & b coord
 	 */
@@ -186,11 +196,37 @@ public:
 	 */
 	bool is_filled(unsigned int x, unsigned int z);
 
+	/*
+	 * Opens a file and reads its header, leaving chunks unread
+	 */
+	void open(void);
+
+	/*
+	 * Read a chunk tag from data
+	 */
+	static void parse_chunk_tag(std::vector<char> &data, chunk_tag &tag) { parse_chunk_tag(data, tag, NULL); }
+
+	/*
+	 * Read a chunk tag from data, keeping only leaf tags named in projection
+	 * (compound & list tags are always kept; a NULL projection keeps everything)
+	 */
+	static void parse_chunk_tag(std::vector<char> &data, chunk_tag &tag, const std::set<std::string> *projection);
+
 	/*
 	 * Reads a file into region_file
 	 */
 	void read(void);
 
+	/*
+	 * Reads a single chunk at a given x, z coord (reopening the file if needed)
+	 */
+	void read_chunk_at(unsigned int x, unsigned int z);
+
+	/*
+	 * Skips over a tag value of a given type in stream
+	 */
+	static void skip_value(byte_stream &stream, char type);
+
 	/*
 	 * Returns a string representation of a region file reader
 	 */
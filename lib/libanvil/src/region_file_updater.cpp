@@ -0,0 +1,262 @@
+/*
+ * region_file_updater.cpp
+ * Copyright (C) 2012 David Jolly
+ * ----------------------
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <boost/filesystem.hpp>
+#include <cstring>
+#include <ctime>
+#include <sstream>
+#include <stdexcept>
+#include "region_dim.hpp"
+#include "region_file_updater.hpp"
+
+/*
+ * Region file updater destructor
+ */
+region_file_updater::~region_file_updater(void) {
+
+	// destructors must not throw
+	try {
+		close();
+	} catch(...) {
+		return;
+	}
+}
+
+/*
+ * Flush & close a region file, trimming free sectors from its end
+ */
+void region_file_updater::close(void) {
+	boost::uintmax_t size;
+
+	// check if open
+	if(!file.is_open())
+		return;
+	file.close();
+
+	// trim trailing free sectors
+	size = (boost::uintmax_t) allocator.get_sector_count() * region_dim::SECTOR_SIZE;
+	if(boost::filesystem::file_size(path) > size)
+		boost::filesystem::resize_file(path, size);
+}
+
+/*
+ * Returns a chunk's header index at a given x, z coord
+ */
+unsigned int region_file_updater::index(unsigned int x, unsigned int z) {
+
+	// check for valid coord
+	if(x >= region_dim::CHUNK_WIDTH
+			|| z >= region_dim::CHUNK_WIDTH)
+		throw std::out_of_range("coord out-of-range");
+	return z * region_dim::CHUNK_WIDTH + x;
+}
+
+/*
+ * Returns true if a chunk exists at a given x, z coord
+ */
+bool region_file_updater::is_filled(unsigned int x, unsigned int z) {
+	chunk_info &info = header.get_info_at(index(x, z));
+
+	return !info.empty()
+			&& info.get_sector_count();
+}
+
+/*
+ * Open a region file for update (creating an empty region if missing)
+ */
+void region_file_updater::open(const std::string &path) {
+	std::vector<char> empty;
+
+	// close any open file
+	close();
+	this->path = path;
+
+	// create an empty region
+	if(!boost::filesystem::exists(path)) {
+		std::ofstream out(path.c_str(), std::ios::out | std::ios::binary);
+		if(!out.is_open())
+			throw std::runtime_error("Failed to create region file");
+		empty.assign(region_dim::HEADER_OFFSET, 0);
+		out.write(empty.data(), empty.size());
+	}
+
+	// open for update & map used sectors from the header
+	file.clear();
+	file.open(path.c_str(), std::ios::in | std::ios::out | std::ios::binary);
+	if(!file.is_open())
+		throw std::runtime_error("Failed to open region file");
+	if(!header.read_data(file)) {
+		file.close();
+		throw std::runtime_error("Failed to read region header");
+	}
+	allocator.reset(header);
+}
+
+/*
+ * Read a chunk's compressed payload & type at a given x, z coord
+ * (returns false if no chunk exists)
+ */
+bool region_file_updater::read_raw(unsigned int x, unsigned int z, char &type, std::vector<char> &data) {
+	unsigned int length;
+	unsigned char prefix[sizeof(int) + sizeof(char)];
+	chunk_info &info = header.get_info_at(index(x, z));
+
+	// check if open & filled
+	if(!file.is_open())
+		throw std::runtime_error("Region file is not open");
+	if(info.empty()
+			|| !info.get_sector_count())
+		return false;
+
+	// read length (including the compression type byte) & type prefix
+	file.clear();
+	file.seekg((std::streamoff) info.get_sector() * region_dim::SECTOR_SIZE, std::ios::beg);
+	if(!file.read((char *) prefix, sizeof(prefix)))
+		throw std::runtime_error("Failed to read chunk data");
+	length = (prefix[0] << 24) | (prefix[1] << 16) | (prefix[2] << 8) | prefix[3];
+	if(length < 2
+			|| length + sizeof(int) > info.get_sector_count() * region_dim::SECTOR_SIZE)
+		throw std::runtime_error("Malformed chunk length");
+
+	// read payload
+	type = prefix[sizeof(int)];
+	data.resize(length - 1);
+	if(!file.read(data.data(), data.size()))
+		throw std::runtime_error("Failed to read chunk data");
+	return true;
+}
+
+/*
+ * Remove a chunk at a given x, z coord, freeing its sectors
+ */
+void region_file_updater::remove_chunk(unsigned int x, unsigned int z) {
+	unsigned int pos = index(x, z);
+	chunk_info info = header.get_info_at(pos);
+
+	// check if open & filled
+	if(!file.is_open())
+		throw std::runtime_error("Region file is not open");
+	if(info.empty())
+		return;
+
+	// clear header entry before releasing sectors
+	header.set_info_at(pos, chunk_info());
+	write_entry(pos);
+	allocator.release(info.get_sector(), info.get_sector_count());
+}
+
+/*
+ * Returns a string representation of a region file updater
+ */
+std::string region_file_updater::to_string(void) {
+	std::stringstream ss;
+
+	// form string representation
+	ss << "Path: " << path << ", chunks: " << header.get_count() << ", " << allocator.to_string();
+	return ss.str();
+}
+
+/*
+ * Serialize, deflate & write a chunk at a given x, z coord
+ */
+void region_file_updater::write_chunk(unsigned int x, unsigned int z, chunk_tag &tag) {
+	std::vector<char> data = tag.get_data();
+
+	// deflate & write
+	if(!compression::deflate_(data, level))
+		throw std::runtime_error("Failed to deflate chunk");
+	write_raw(x, z, chunk_info::ZLIB, data, time(NULL));
+}
+
+/*
+ * Write a chunk's header offset & timestamp entries
+ */
+void region_file_updater::write_entry(unsigned int index) {
+	char entry[sizeof(int)];
+	chunk_info &info = header.get_info_at(index);
+
+	// write big-endian offset
+	entry[0] = (char) (info.get_offset() >> 24);
+	entry[1] = (char) (info.get_offset() >> 16);
+	entry[2] = (char) (info.get_offset() >> 8);
+	entry[3] = (char) info.get_offset();
+	file.seekp(index * sizeof(int), std::ios::beg);
+	file.write(entry, sizeof(entry));
+
+	// write big-endian timestamp
+	entry[0] = (char) (info.get_modified() >> 24);
+	entry[1] = (char) (info.get_modified() >> 16);
+	entry[2] = (char) (info.get_modified() >> 8);
+	entry[3] = (char) info.get_modified();
+	file.seekp(region_dim::CHUNK_COUNT * sizeof(int) + index * sizeof(int), std::ios::beg);
+	file.write(entry, sizeof(entry));
+	if(!file.flush())
+		throw std::runtime_error("Failed to write region header");
+}
+
+/*
+ * Write an already compressed chunk at a given x, z coord, in place when
+ * it still fits, otherwise into the best-fitting free run
+ */
+void region_file_updater::write_raw(unsigned int x, unsigned int z, char type, const std::vector<char> &data, unsigned int modified) {
+	std::vector<char> out;
+	unsigned int pos = index(x, z), sector, sectors;
+	chunk_info &info = header.get_info_at(pos);
+
+	// check if open & chunk size
+	if(!file.is_open())
+		throw std::runtime_error("Region file is not open");
+	sectors = (data.size() + sizeof(int) + sizeof(char) + region_dim::SECTOR_SIZE - 1) / region_dim::SECTOR_SIZE;
+	if(sectors > 0xff)
+		throw std::runtime_error("Chunk exceeds maximum sector count");
+
+	// reuse the chunk's sectors when it still fits, otherwise allocate a new run
+	// (before releasing the old one, so the old chunk stays intact until the
+	// header points elsewhere)
+	if(!info.empty()
+			&& info.get_sector_count()
+			&& sectors <= info.get_sector_count()) {
+		sector = info.get_sector();
+		allocator.release(sector + sectors, info.get_sector_count() - sectors);
+	} else {
+		sector = allocator.allocate(sectors);
+		if(!info.empty())
+			allocator.release(info.get_sector(), info.get_sector_count());
+	}
+
+	// write length (including the compression type byte), type, data & padding
+	out.assign(sectors * region_dim::SECTOR_SIZE, 0);
+	out[0] = (char) ((data.size() + 1) >> 24);
+	out[1] = (char) ((data.size() + 1) >> 16);
+	out[2] = (char) ((data.size() + 1) >> 8);
+	out[3] = (char) (data.size() + 1);
+	out[4] = type;
+	memcpy(&out[sizeof(int) + sizeof(char)], data.data(), data.size());
+	file.seekp((std::streamoff) sector * region_dim::SECTOR_SIZE, std::ios::beg);
+	if(!file.write(out.data(), out.size())
+			|| !file.flush())
+		throw std::runtime_error("Failed to write chunk data");
+
+	// update only this chunk's header entries
+	info.set_offset((sector << 8) | sectors);
+	info.set_length(data.size() + 1);
+	info.set_type(type);
+	info.set_modified(modified);
+	write_entry(pos);
+}
@@ -0,0 +1,165 @@
+/*
+ * region_file_updater.hpp
+ * Copyright (C) 2012 David Jolly
+ * ----------------------
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef REGION_FILE_UPDATER_HPP_
+#define REGION_FILE_UPDATER_HPP_
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include "chunk_tag.hpp"
+#include "compression.hpp"
+#include "region_header.hpp"
+#include "sector_allocator.hpp"
+
+class region_file_updater {
+private:
+
+	/*
+	 * Region file path & stream
+	 */
+	std::string path;
+	std::fstream file;
+
+	/*
+	 * Raw region header
+	 */
+	region_header header;
+
+	/*
+	 * Free sector map
+	 */
+	sector_allocator allocator;
+
+	/*
+	 * Deflate level
+	 */
+	int level;
+
+	/*
+	 * Region file updater constructor (non-copyable)
+	 */
+	region_file_updater(const region_file_updater &other);
+
+	/*
+	 * Region file updater assignment operator (non-copyable)
+	 */
+	region_file_updater &operator=(const region_file_updater &other);
+
+	/*
+	 * Returns a chunk's header index at a given x, z coord
+	 */
+	static unsigned int index(unsigned int x, unsigned int z);
+
+	/*
+	 * Write a chunk's header offset & timestamp entries
+	 */
+	void write_entry(unsigned int index);
+
+public:
+
+	/*
+	 * Region file updater constructor
+	 */
+	region_file_updater(void) : level(compression::DEF_LEVEL) { return; }
+
+	/*
+	 * Region file updater constructor
+	 */
+	region_file_updater(const std::string &path) : level(compression::DEF_LEVEL) { open(path); }
+
+	/*
+	 * Region file updater destructor
+	 */
+	virtual ~region_file_updater(void);
+
+	/*
+	 * Flush & close a region file, trimming free sectors from its end
+	 */
+	void close(void);
+
+	/*
+	 * Returns a region file updater's free sector map
+	 */
+	sector_allocator &get_allocator(void) { return allocator; }
+
+	/*
+	 * Returns a region file updater's raw header
+	 */
+	region_header &get_header(void) { return header; }
+
+	/*
+	 * Returns a region file updater's deflate level
+	 */
+	int get_level(void) { return level; }
+
+	/*
+	 * Returns a region file updater's path
+	 */
+	const std::string &get_path(void) { return path; }
+
+	/*
+	 * Returns true if a chunk exists at a given x, z coord
+	 */
+	bool is_filled(unsigned int x, unsigned int z);
+
+	/*
+	 * Returns a region file updater's open status
+	 */
+	bool is_open(void) { return file.is_open(); }
+
+	/*
+	 * Open a region file for update (creating an empty region if missing)
+	 */
+	void open(const std::string &path);
+
+	/*
+	 * Read a chunk's compressed payload & type at a given x, z coord
+	 * (returns false if no chunk exists)
+	 */
+	bool read_raw(unsigned int x, unsigned int z, char &type, std::vector<char> &data);
+
+	/*
+	 * Remove a chunk at a given x, z coord, freeing its sectors
+	 */
+	void remove_chunk(unsigned int x, unsigned int z);
+
+	/*
+	 * Sets a region file updater's deflate level (0-9)
+	 */
+	void set_level(int level) { this->level = level; }
+
+	/*
+	 * Returns a string representation of a region file updater
+	 */
+	std::string to_string(void);
+
+	/*
+	 * Serialize, deflate & write a chunk at a given x, z coord
+	 */
+	void write_chunk(unsigned int x, unsigned int z, chunk_tag &tag);
+
+	/*
+	 * Write an already compressed chunk at a given x, z coord, in place when
+	 * it still fits, otherwise into the best-fitting free run
+	 */
+	void write_raw(unsigned int x, unsigned int z, char type, const std::vector<char> &data, unsigned int modified);
+};
+
+#endif
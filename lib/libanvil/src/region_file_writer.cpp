@@ -17,14 +17,19 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <boost/filesystem.hpp>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
 #include <sstream>
 #include <stdexcept>
-#include <vector>
-#include "byte_stream.hpp"
+#include <thread>
+#include <unistd.h>
 #include "chunk_info.hpp"
-#include "compression.hpp"
 #include "region_dim.hpp"
+#include "region_file.hpp"
 #include "region_file_writer.hpp"
+#include "region_header.hpp"
 
 /*
  * Region file writer assignment operator
@@ -38,6 +43,8 @@ region_file_writer &region_file_writer::operator=(const region_file_writer &othe
 	// assign attributes
 	path = other.path;
 	reg = other.reg;
+	level = other.level;
+	threads = other.threads;
 	return *this;
 }
 
@@ -56,58 +63,167 @@ bool region_file_writer::operator==(const region_file_writer &other) {
 }
 
 /*
- * Write a region file to file
+ * Serialize, deflate & sector-pad queued chunks (worker thread entry point)
+ */
+void region_file_writer::encode(encode_queue &queue) {
+	size_t index;
+	unsigned int sectors;
+	std::vector<char> data, out;
+	std::unique_lock<std::mutex> lock(queue.lock);
+
+	for(;;) {
+
+		// claim the next chunk, staying within a window of the writing thread
+		while(!queue.failed
+				&& queue.next < queue.indices.size()
+				&& queue.next >= queue.written + queue.window)
+			queue.cond.wait(lock);
+		if(queue.failed
+				|| queue.next >= queue.indices.size())
+			return;
+		index = queue.next++;
+		lock.unlock();
+
+		// serialize & deflate chunk, prefixing its length (including the
+		// compression type byte) and padding it out to whole sectors
+		try {
+			data = reg.get_tag_at(queue.indices.at(index)).get_data();
+			if(!compression::deflate_(data, level))
+				throw std::runtime_error("Failed to deflate chunk");
+			sectors = (data.size() + sizeof(int) + sizeof(char) + region_dim::SECTOR_SIZE - 1) / region_dim::SECTOR_SIZE;
+			if(sectors > 0xff)
+				throw std::runtime_error("Chunk exceeds maximum sector count");
+			out.assign(sectors * region_dim::SECTOR_SIZE, 0);
+			out[0] = (char) ((data.size() + 1) >> 24);
+			out[1] = (char) ((data.size() + 1) >> 16);
+			out[2] = (char) ((data.size() + 1) >> 8);
+			out[3] = (char) (data.size() + 1);
+			out[4] = chunk_info::ZLIB;
+			memcpy(&out[sizeof(int) + sizeof(char)], data.data(), data.size());
+		} catch(std::exception &exc) {
+			lock.lock();
+			queue.failed = true;
+			queue.error = exc.what();
+			queue.cond.notify_all();
+			return;
+		}
+
+		// hand encoded chunk to the writing thread
+		lock.lock();
+		queue.encoded.at(index).swap(out);
+		queue.lengths.at(index) = data.size() + 1;
+		queue.ready.at(index) = true;
+		queue.cond.notify_all();
+	}
+}
+
+/*
+ * Flush a written file (or directory) to disk
+ */
+void region_file_writer::sync(const std::string &path) {
+	int fd = open(path.c_str(), O_RDONLY);
+
+	// check file
+	if(fd < 0)
+		throw std::runtime_error("Failed to open file for sync");
+	if(fsync(fd)) {
+		close(fd);
+		throw std::runtime_error("Failed to sync file");
+	}
+	close(fd);
+}
+
+/*
+ * Write a region file to file, deflating chunks in parallel & streaming
+ * them to a temporary file that replaces the region file once synced
  */
 void region_file_writer::write(void) {
-	unsigned char count;
-	unsigned int offset, remaining;
-	std::vector<char> header_data;
-	unsigned int pos = region_dim::HEADER_OFFSET;
-	byte_stream region_stream(byte_stream::SWAP_ENDIAN);
-
-	// attempt to open file
-	file.open(path.c_str(), std::ios::out | std::ios::trunc | std::ios::binary);
+	encode_queue queue;
+	unsigned int sectors, count;
+	std::vector<char> data, header_data;
+	std::vector<std::thread> workers;
+	unsigned int pos = region_dim::HEADER_OFFSET / region_dim::SECTOR_SIZE;
+	std::string temp_path = path + ".tmp", dir = boost::filesystem::path(path).parent_path().string();
+
+	// collect filled chunks in index order, which fixes the sector layout
+	for(unsigned int i = 0; i < region_dim::CHUNK_COUNT; ++i)
+		if(reg.is_filled(i))
+			queue.indices.push_back(i);
+	queue.lengths.resize(queue.indices.size());
+	queue.encoded.resize(queue.indices.size());
+	queue.ready.assign(queue.indices.size(), false);
+	queue.next = 0;
+	queue.written = 0;
+	queue.failed = false;
+
+	// attempt to open temporary file & reserve space for the header
+	file.clear();
+	file.open(temp_path.c_str(), std::ios::out | std::ios::trunc | std::ios::binary);
 	if(!file.is_open())
 		throw std::runtime_error("Failed to open output file");
+	header_data.assign(region_header::HEADER_LENGTH, 0);
+	file.write(header_data.data(), header_data.size());
 
-	// iterate through tags
-	for(unsigned int i = 0; i < region_dim::CHUNK_COUNT; ++i) {
-
-		// skip unfilled chunks
-		if(!reg.is_filled(i))
-			continue;
-
-		// compress chunk
-		std::vector<char> chunk_data = reg.get_tag_at(i).get_data();
-		compression::deflate_(chunk_data);
+	// start workers, bounding the number of encoded chunks held in memory
+	count = region_file::get_thread_count(threads, queue.indices.size());
+	queue.window = count * WINDOW;
+	for(unsigned int i = 0; i < count; ++i)
+		workers.push_back(std::thread(&region_file_writer::encode, this, std::ref(queue)));
+
+	// stream chunks to file in index order as they are encoded
+	for(size_t i = 0; i < queue.indices.size(); ++i) {
+		std::unique_lock<std::mutex> lock(queue.lock);
+		while(!queue.failed
+				&& !queue.ready.at(i))
+			queue.cond.wait(lock);
+		if(queue.failed)
+			break;
+		data.swap(queue.encoded.at(i));
+		queue.encoded.at(i).clear();
+		queue.written = i + 1;
+		queue.cond.notify_all();
+		lock.unlock();
 
 		// adjust header
-		reg.get_header().get_info_at(i).set_length(chunk_data.size());
-		count = (chunk_data.size() / region_dim::SECTOR_SIZE) + 1;
-		offset = pos / region_dim::SECTOR_SIZE;
-		reg.get_header().get_info_at(i).set_offset((offset << 8) | count);
-
-		// append chunk header & chunk to region stream
-		region_stream << (int) reg.get_header().get_info_at(i).get_length();
-		region_stream << (char) reg.get_header().get_info_at(i).get_type();
-		region_stream << chunk_data;
-
-		// add remaining zeros to fill out sector
-		remaining = region_dim::SECTOR_SIZE - (reg.get_header().get_info_at(i).get_length() % region_dim::SECTOR_SIZE) - (sizeof(int) + sizeof(char));
-		for(unsigned int j = 0; j < remaining; ++j)
-			region_stream << (char) 0;
-
-		// move position forward
-		pos += count * region_dim::SECTOR_SIZE;
+		chunk_info &info = reg.get_header().get_info_at(queue.indices.at(i));
+		sectors = data.size() / region_dim::SECTOR_SIZE;
+		info.set_offset((pos << 8) | sectors);
+		info.set_length(queue.lengths.at(i));
+		info.set_type(chunk_info::ZLIB);
+		pos += sectors;
+		if(!file.write(data.data(), data.size())) {
+			lock.lock();
+			queue.failed = true;
+			queue.error = "Failed to write output file";
+			queue.cond.notify_all();
+			break;
+		}
 	}
 
-	// write header to file
-	header_data = reg.get_header().get_data();
-	file.write(header_data.data(), header_data.size());
-
-	// write chunks to file
-	file.write(region_stream.rdbuf(), region_stream.size());
-
-	// close file
+	// wait for workers
+	for(unsigned int i = 0; i < workers.size(); ++i)
+		workers.at(i).join();
+
+	// write header over the reserved space
+	if(!queue.failed) {
+		header_data = reg.get_header().get_data();
+		file.seekp(0, std::ios::beg);
+		if(!file.write(header_data.data(), header_data.size())) {
+			queue.failed = true;
+			queue.error = "Failed to write output file";
+		}
+	}
 	file.close();
+	if(queue.failed) {
+		remove(temp_path.c_str());
+		throw std::runtime_error(queue.error);
+	}
+
+	// sync & atomically replace the region file
+	sync(temp_path);
+	if(rename(temp_path.c_str(), path.c_str())) {
+		remove(temp_path.c_str());
+		throw std::runtime_error("Failed to replace output file");
+	}
+	sync(dir.empty() ? "." : dir);
 }
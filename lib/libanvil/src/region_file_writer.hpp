@@ -20,39 +20,76 @@
 #ifndef REGION_FILE_WRITER_HPP_
 #define REGION_FILE_WRITER_HPP_
 
+#include <condition_variable>
 #include <fstream>
+#include <mutex>
 #include <string>
+#include <vector>
+#include "compression.hpp"
 #include "region_file.hpp"
 
 class region_file_writer : public region_file {
+public:
+
+	/*
+	 * Encoded chunks in flight per worker thread
+	 */
+	static const unsigned int WINDOW = 4;
+
 private:
 
+	/*
+	 * Chunks encoded by worker threads & consumed in order by the writing thread
+	 */
+	class encode_queue {
+	public:
+		std::vector<unsigned int> indices, lengths;
+		std::vector<std::vector<char> > encoded;
+		std::vector<bool> ready;
+		size_t next, written, window;
+		bool failed;
+		std::string error;
+		std::mutex lock;
+		std::condition_variable cond;
+	};
+
 	/*
 	 * Region file
 	 */
 	std::ofstream file;
 
+	/*
+	 * Deflate level & worker thread count (0 uses the hardware concurrency)
+	 */
+	int level;
+	unsigned int threads;
+
+	/*
+	 * Serialize, deflate & sector-pad queued chunks (worker thread entry point)
+	 */
+	void encode(encode_queue &queue);
+
 public:
 
 	/*
 	 * Region file writer constructor
 	 */
-	region_file_writer(void) { return; }
+	region_file_writer(void) : level(compression::DEF_LEVEL), threads(0) { return; }
 
 	/*
 	 * Region file writer constructor
 	 */
-	region_file_writer(const region_file_writer &other) : region_file(other.path, other.reg) { return; }
+	region_file_writer(const region_file_writer &other) : region_file(other.path, other.reg), level(other.level), threads(other.threads) { return; }
 
 	/*
 	 * Region file writer constructor
 	 */
-	region_file_writer(const std::string &path) : region_file(path) { return; }
+	region_file_writer(const std::string &path) : region_file(path), level(compression::DEF_LEVEL), threads(0) { return; }
 
 	/*
 	 * Region file writer constructor
 	 */
-	region_file_writer(const std::string &path, const region &reg) : region_file(path, reg) { return; }
+	region_file_writer(const std::string &path, const region &reg) : region_file(path, reg), level(compression::DEF_LEVEL), threads(0) { return; }
 
 	/*
 	 * Region file writer destructor
@@ -79,13 +116,39 @@ public:
 	 */
 	std::ofstream &get_file(void) { return file; }
 
+	/*
+	 * Returns a region file writer's deflate level
+	 */
+	int get_level(void) { return level; }
+
+	/*
+	 * Returns a region file writer's worker thread count
+	 */
+	unsigned int get_threads(void) { return threads; }
+
+	/*
+	 * Sets a region file writer's deflate level (0-9)
+	 */
+	void set_level(int level) { this->level = level; }
+
+	/*
+	 * Sets a region file writer's worker thread count (0 uses the hardware concurrency)
+	 */
+	void set_threads(unsigned int threads) { this->threads = threads; }
+
+	/*
+	 * Flush a written file (or directory) to disk
+	 */
+	static void sync(const std::string &path);
+
 	/*
 	 * Returns a string representation of a region file writer
 	 */
 	std::string to_string(void) { return region_file::to_string(); }
 
 	/*
-	 * Write a region file to file
+	 * Write a region file to file, deflating chunks in parallel & streaming
+	 * them to a temporary file that replaces the region file once synced
 	 */
 	void write(void);
 };
@@ -123,6 +123,29 @@ chunk_info &region_header::get_info_at(unsigned int index) {
 	return info[index];
 }
 
+/*
+ * Read a region header's raw offsets (sector << 8 | count) & timestamps from a stream
+ */
+bool region_header::read_data(std::istream &in) {
+	const unsigned char *data;
+	char buff[HEADER_LENGTH];
+
+	// read entire header in one call
+	in.read(buff, HEADER_LENGTH);
+	if(in.gcount() != (std::streamsize) HEADER_LENGTH)
+		return false;
+	data = reinterpret_cast<const unsigned char *>(buff);
+
+	// convert big-endian offsets & timestamps
+	for(unsigned int i = 0; i < region_dim::CHUNK_COUNT; ++i, data += sizeof(int)) {
+		info[i] = chunk_info();
+		info[i].set_offset((data[0] << 24) | (data[1] << 16) | (data[2] << 8) | data[3]);
+	}
+	for(unsigned int i = 0; i < region_dim::CHUNK_COUNT; ++i, data += sizeof(int))
+		info[i].set_modified((data[0] << 24) | (data[1] << 16) | (data[2] << 8) | data[3]);
+	return true;
+}
+
 /*
  * Set a region header's info
  */
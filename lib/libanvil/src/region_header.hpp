@@ -20,12 +20,14 @@
 #ifndef REGION_HEADER_HPP_
 #define REGION_HEADER_HPP_
 
+#include <istream>
 #include <string>
 #include <vector>
 #include "chunk_info.hpp"
 #include "region_dim.hpp"
 
 class region_header {
+public:
 
 	/*
 	 * Total header size
@@ -96,6 +98,11 @@ public:
 	 */
 	chunk_info &get_info_at(unsigned int index);
 
+	/*
+	 * Read a region header's raw offsets (sector << 8 | count) & timestamps from a stream
+	 */
+	bool read_data(std::istream &in);
+
 	/*
 	 * Set a region header's info
 	 */
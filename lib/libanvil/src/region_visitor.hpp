@@ -0,0 +1,40 @@
+/*
+ * region_visitor.hpp
+ * Copyright (C) 2012 David Jolly
+ * ----------------------
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef REGION_VISITOR_HPP_
+#define REGION_VISITOR_HPP_
+
+#include <cstddef>
+
+class region_visitor {
+public:
+
+	/*
+	 * Region visitor destructor
+	 */
+	virtual ~region_visitor(void) { return; }
+
+	/*
+	 * Called for each region by its index within a pass; a thrown exception
+	 * is recorded as the region's error (called concurrently from worker threads)
+	 */
+	virtual void visit(size_t index) = 0;
+};
+
+#endif
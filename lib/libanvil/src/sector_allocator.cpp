@@ -0,0 +1,132 @@
+/*
+ * sector_allocator.cpp
+ * Copyright (C) 2012 David Jolly
+ * ----------------------
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <sstream>
+#include <stdexcept>
+#include "region_dim.hpp"
+#include "sector_allocator.hpp"
+
+/*
+ * Allocate the best-fitting free run of sectors (growing the file if no
+ * run fits), returning its first sector
+ */
+unsigned int sector_allocator::allocate(unsigned int count) {
+	unsigned int end = get_sector_count(), best = end, best_length = 0, start, length;
+
+	// check for a valid count
+	if(!count)
+		throw std::out_of_range("sector count out-of-range");
+
+	// find the smallest free run that fits, preferring the lowest
+	for(unsigned int i = 0; i < end;) {
+		if(used.at(i)) {
+			++i;
+			continue;
+		}
+		start = i;
+		while(i < end
+				&& !used.at(i))
+			++i;
+		length = i - start;
+		if(length >= count
+				&& (!best_length || length < best_length)) {
+			best = start;
+			best_length = length;
+			if(length == count)
+				break;
+		}
+	}
+
+	// otherwise grow the file
+	reserve(best, count);
+	return best;
+}
+
+/*
+ * Returns the number of free sectors before the end of the file
+ */
+unsigned int sector_allocator::get_free_count(void) {
+	unsigned int free = 0, end = get_sector_count();
+
+	// count unused sectors
+	for(unsigned int i = 0; i < end; ++i)
+		if(!used.at(i))
+			++free;
+	return free;
+}
+
+/*
+ * Returns the number of sectors up to & including the last used sector
+ */
+unsigned int sector_allocator::get_sector_count(void) {
+	unsigned int end = used.size();
+
+	// skip trailing free sectors
+	while(end
+			&& !used.at(end - 1))
+		--end;
+	return end;
+}
+
+/*
+ * Release a run of sectors
+ */
+void sector_allocator::release(unsigned int sector, unsigned int count) {
+	for(unsigned int i = sector; i < sector + count && i < used.size(); ++i)
+		used.at(i) = false;
+}
+
+/*
+ * Reserve a run of sectors
+ */
+void sector_allocator::reserve(unsigned int sector, unsigned int count) {
+
+	// grow the bitmap as needed
+	if(sector + count > used.size())
+		used.resize(sector + count, false);
+	for(unsigned int i = sector; i < sector + count; ++i)
+		used.at(i) = true;
+}
+
+/*
+ * Reset an allocator to the header & every chunk in a raw header
+ */
+void sector_allocator::reset(region_header &header) {
+	used.clear();
+
+	// reserve header & chunk sectors
+	reserve(0, region_dim::HEADER_OFFSET / region_dim::SECTOR_SIZE);
+	for(unsigned int i = 0; i < region_dim::CHUNK_COUNT; ++i) {
+		chunk_info &info = header.get_info_at(i);
+		if(!info.empty()
+				&& info.get_sector_count())
+			reserve(info.get_sector(), info.get_sector_count());
+	}
+}
+
+/*
+ * Returns a string representation of a sector allocator
+ */
+std::string sector_allocator::to_string(void) {
+	std::stringstream ss;
+
+	// form string representation
+	ss << "Sectors: " << get_sector_count() << ", free: " << get_free_count();
+	return ss.str();
+}
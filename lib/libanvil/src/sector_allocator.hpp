@@ -0,0 +1,89 @@
+/*
+ * sector_allocator.hpp
+ * Copyright (C) 2012 David Jolly
+ * ----------------------
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SECTOR_ALLOCATOR_HPP_
+#define SECTOR_ALLOCATOR_HPP_
+
+#include <string>
+#include <vector>
+#include "region_header.hpp"
+
+class sector_allocator {
+private:
+
+	/*
+	 * Sector used status
+	 */
+	std::vector<bool> used;
+
+public:
+
+	/*
+	 * Sector allocator constructor
+	 */
+	sector_allocator(void) { return; }
+
+	/*
+	 * Sector allocator constructor (reserves the header & every chunk in a raw header)
+	 */
+	sector_allocator(region_header &header) { reset(header); }
+
+	/*
+	 * Sector allocator destructor
+	 */
+	virtual ~sector_allocator(void) { return; }
+
+	/*
+	 * Allocate the best-fitting free run of sectors (growing the file if no
+	 * run fits), returning its first sector
+	 */
+	unsigned int allocate(unsigned int count);
+
+	/*
+	 * Returns the number of free sectors before the end of the file
+	 */
+	unsigned int get_free_count(void);
+
+	/*
+	 * Returns the number of sectors up to & including the last used sector
+	 */
+	unsigned int get_sector_count(void);
+
+	/*
+	 * Release a run of sectors
+	 */
+	void release(unsigned int sector, unsigned int count);
+
+	/*
+	 * Reserve a run of sectors
+	 */
+	void reserve(unsigned int sector, unsigned int count);
+
+	/*
+	 * Reset an allocator to the header & every chunk in a raw header
+	 */
+	void reset(region_header &header);
+
+	/*
+	 * Returns a string representation of a sector allocator
+	 */
+	std::string to_string(void);
+};
+
+#endif
@@ -84,6 +84,11 @@ public:
 	 */
 	void erase(unsigned int index) { value.erase(value.begin() + index); }
 
+	/*
+	 * Returns a compound tag's direct sub-tag with a given name, or NULL
+	 */
+	generic_tag *find(const std::string &name);
+
 	/*
 	 * Return a compound tag's data
 	 */
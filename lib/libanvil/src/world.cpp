@@ -0,0 +1,307 @@
+/*
+ * world.cpp
+ * Copyright (C) 2012 David Jolly
+ * ----------------------
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <sstream>
+#include <stdexcept>
+#include "world.hpp"
+
+/*
+ * World destructor
+ */
+world::~world(void) {
+	clear();
+}
+
+/*
+ * Drop all cached chunks & close all regions
+ */
+void world::clear(void) {
+	std::map<long long, region_entry *>::iterator iter;
+
+	// drop cached chunks (chunks still held by callers stay alive)
+	cache_lock.lock();
+	cache.clear();
+	cache_index.clear();
+	size = 0;
+	cache_lock.unlock();
+
+	// close all regions
+	region_lock.lock();
+	for(iter = regions.begin(); iter != regions.end(); ++iter)
+		delete iter->second;
+	regions.clear();
+	open_regions.clear();
+	region_lock.unlock();
+}
+
+/*
+ * Evict least recently used chunks until the cache is within budget
+ */
+void world::evict(void) {
+
+	// always keep the most recently used chunk
+	while(size > capacity
+			&& cache.size() > 1) {
+		size -= cache.back().second->get_size();
+		cache_index.erase(cache.back().first);
+		cache.pop_back();
+	}
+}
+
+/*
+ * Returns a biome value at a given block x, z coord
+ */
+char world::get_biome(int x, int z) {
+	chunk_ptr chunk = get_chunk(chunk_coord(x), chunk_coord(z));
+
+	// return the default biome if no chunk exists
+	if(!chunk)
+		return 0;
+	return chunk->get_biome_at(local_coord(x, region_dim::BLOCK_WIDTH), local_coord(z, region_dim::BLOCK_WIDTH));
+}
+
+/*
+ * Returns a block value at a given block x, y, z coord
+ */
+int world::get_block(int x, int y, int z) {
+	chunk_ptr chunk;
+
+	// return an air block outside of the world
+	if(y < 0
+			|| y >= (int) region_dim::BLOCK_HEIGHT)
+		return 0;
+	chunk = get_chunk(chunk_coord(x), chunk_coord(z));
+	if(!chunk)
+		return 0;
+	return chunk->get_block_at(local_coord(x, region_dim::BLOCK_WIDTH), y, local_coord(z, region_dim::BLOCK_WIDTH));
+}
+
+/*
+ * Returns a chunk at a given chunk x, z coord (NULL if the chunk does not exist)
+ */
+world::chunk_ptr world::get_chunk(int c_x, int c_z) {
+	chunk_ptr chunk;
+	long long pos = key(c_x, c_z);
+	std::map<long long, std::list<cache_entry>::iterator>::iterator iter;
+
+	// check the cache, moving hits to the front
+	cache_lock.lock();
+	iter = cache_index.find(pos);
+	if(iter != cache_index.end()) {
+		cache.splice(cache.begin(), cache, iter->second);
+		chunk = iter->second->second;
+		cache_lock.unlock();
+		return chunk;
+	}
+	cache_lock.unlock();
+
+	// read the chunk without holding the cache lock
+	chunk = load_chunk(c_x, c_z);
+	if(!chunk)
+		return chunk;
+
+	// insert into the cache, unless another reader beat us to it
+	cache_lock.lock();
+	iter = cache_index.find(pos);
+	if(iter != cache_index.end()) {
+		cache.splice(cache.begin(), cache, iter->second);
+		chunk = iter->second->second;
+	} else {
+		cache.push_front(cache_entry(pos, chunk));
+		cache_index[pos] = cache.begin();
+		size += chunk->get_size();
+		evict();
+	}
+	cache_lock.unlock();
+	return chunk;
+}
+
+/*
+ * Returns a height value at a given block x, z coord
+ */
+int world::get_height(int x, int z) {
+	chunk_ptr chunk = get_chunk(chunk_coord(x), chunk_coord(z));
+
+	// return zero height if no chunk exists
+	if(!chunk)
+		return 0;
+	return chunk->get_height_at(local_coord(x, region_dim::BLOCK_WIDTH), local_coord(z, region_dim::BLOCK_WIDTH));
+}
+
+/*
+ * Returns the region entry at a given region x, z coord, opening it if needed
+ */
+world::region_entry *world::get_region_entry(int r_x, int r_z) {
+	bool created = false;
+	region_entry *entry = NULL;
+	long long pos = key(r_x, r_z);
+	std::map<long long, region_entry *>::iterator iter;
+
+	// find or create entry
+	region_lock.lock();
+	iter = regions.find(pos);
+	if(iter == regions.end()) {
+
+		// lock the new entry before publishing it, so no reader sees it half-open
+		entry = new region_entry;
+		entry->lock.lock();
+		regions[pos] = entry;
+		created = true;
+	} else
+		entry = iter->second;
+	region_lock.unlock();
+	if(!created)
+		return entry;
+
+	// read the region header (absent or unreadable regions have no reader)
+	entry->reader = new region_file_reader(region_path(r_x, r_z));
+	try {
+		entry->reader->open();
+		touch_region(entry);
+	} catch(std::exception &exc) {
+		delete entry->reader;
+		entry->reader = NULL;
+	}
+	entry->lock.unlock();
+	return entry;
+}
+
+/*
+ * Returns a world's current cache size in bytes
+ */
+size_t world::get_size(void) {
+	size_t result;
+
+	// read size under lock
+	cache_lock.lock();
+	result = size;
+	cache_lock.unlock();
+	return result;
+}
+
+/*
+ * Returns true if a chunk exists at a given chunk x, z coord
+ */
+bool world::is_filled(int c_x, int c_z) {
+	bool result;
+	region_entry *entry = get_region_entry(region_coord(c_x), region_coord(c_z));
+
+	// check header
+	entry->lock.lock();
+	result = entry->reader
+			&& entry->reader->is_filled(local_coord(c_x, region_dim::CHUNK_WIDTH), local_coord(c_z, region_dim::CHUNK_WIDTH));
+	entry->lock.unlock();
+	return result;
+}
+
+/*
+ * Reads a chunk from its region file
+ */
+world::chunk_ptr world::load_chunk(int c_x, int c_z) {
+	chunk_ptr chunk;
+	unsigned int l_x = local_coord(c_x, region_dim::CHUNK_WIDTH), l_z = local_coord(c_z, region_dim::CHUNK_WIDTH);
+	region_entry *entry = get_region_entry(region_coord(c_x), region_coord(c_z));
+
+	// region readers are not thread-safe, so serialize access per region
+	entry->lock.lock();
+	if(!entry->reader
+			|| !entry->reader->is_filled(l_x, l_z)) {
+		entry->lock.unlock();
+		return chunk;
+	}
+	try {
+		entry->reader->read_chunk_at(l_x, l_z);
+		touch_region(entry);
+
+		// pack into compact form & release the parsed tags
+		chunk_tag &tag = entry->reader->get_chunk_tag_at(l_x, l_z);
+		chunk = chunk_ptr(new compact_chunk(tag));
+		tag.clean_root();
+		tag = chunk_tag();
+	} catch(...) {
+		entry->reader->get_chunk_tag_at(l_x, l_z).clean_root();
+		entry->reader->get_chunk_tag_at(l_x, l_z) = chunk_tag();
+		entry->lock.unlock();
+		throw;
+	}
+	entry->lock.unlock();
+	return chunk;
+}
+
+/*
+ * Returns the region file path at a given region x, z coord
+ */
+std::string world::region_path(int r_x, int r_z) {
+	std::stringstream ss;
+
+	// form region file path
+	ss << dir << "/r." << r_x << "." << r_z << ".mca";
+	return ss.str();
+}
+
+/*
+ * Sets a world's cache byte budget
+ */
+void world::set_capacity(size_t capacity) {
+	cache_lock.lock();
+	this->capacity = capacity;
+	evict();
+	cache_lock.unlock();
+}
+
+/*
+ * Marks a region's file handle as recently used, closing the oldest handles
+ * (the caller must hold the entry's lock)
+ */
+void world::touch_region(region_entry *entry) {
+	region_entry *oldest;
+
+	region_lock.lock();
+	if(entry->is_open)
+		open_regions.erase(entry->open_pos);
+	open_regions.push_front(entry);
+	entry->open_pos = open_regions.begin();
+	entry->is_open = true;
+
+	// close least recently used handles (skipping regions currently in use)
+	while(open_regions.size() > MAX_OPEN_REGIONS) {
+		oldest = open_regions.back();
+		if(oldest == entry
+				|| !oldest->lock.try_lock())
+			break;
+		oldest->reader->close();
+		oldest->is_open = false;
+		open_regions.pop_back();
+		oldest->lock.unlock();
+	}
+	region_lock.unlock();
+}
+
+/*
+ * Returns a string representation of a world
+ */
+std::string world::to_string(void) {
+	std::stringstream ss;
+
+	// form string representation
+	cache_lock.lock();
+	ss << "Path: " << dir << ", cached: " << cache.size() << ", size: " << size << "/" << capacity;
+	cache_lock.unlock();
+	return ss.str();
+}
@@ -0,0 +1,238 @@
+/*
+ * world.hpp
+ * Copyright (C) 2012 David Jolly
+ * ----------------------
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef WORLD_HPP_
+#define WORLD_HPP_
+
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include "compact_chunk.hpp"
+#include "region_file_reader.hpp"
+
+class world {
+public:
+
+	/*
+	 * Shared handle to a cached chunk
+	 */
+	typedef std::shared_ptr<const compact_chunk> chunk_ptr;
+
+private:
+
+	/*
+	 * Lazily opened region (reader is NULL if the region file is absent)
+	 */
+	class region_entry {
+	public:
+		region_file_reader *reader;
+		std::mutex lock;
+		std::list<region_entry *>::iterator open_pos;
+		bool is_open;
+		region_entry(void) : reader(NULL), is_open(false) { return; }
+		~region_entry(void) { delete reader; }
+	};
+
+	/*
+	 * Cached chunk, keyed by chunk x, z coord
+	 */
+	typedef std::pair<long long, chunk_ptr> cache_entry;
+
+	/*
+	 * World region file directory
+	 */
+	std::string dir;
+
+	/*
+	 * Cache byte budget & current size
+	 */
+	size_t capacity, size;
+
+	/*
+	 * Cached chunks (most recently used first)
+	 */
+	std::list<cache_entry> cache;
+
+	/*
+	 * Cached chunk lookup
+	 */
+	std::map<long long, std::list<cache_entry>::iterator> cache_index;
+
+	/*
+	 * Opened regions, keyed by region x, z coord
+	 */
+	std::map<long long, region_entry *> regions;
+
+	/*
+	 * Regions holding an open file handle (most recently used first)
+	 */
+	std::list<region_entry *> open_regions;
+
+	/*
+	 * Cache & region locks
+	 */
+	std::mutex cache_lock, region_lock;
+
+	/*
+	 * World constructor (non-copyable)
+	 */
+	world(const world &other);
+
+	/*
+	 * World assignment operator (non-copyable)
+	 */
+	world &operator=(const world &other);
+
+	/*
+	 * Evict least recently used chunks until the cache is within budget
+	 */
+	void evict(void);
+
+	/*
+	 * Returns a coordinate key
+	 */
+	static long long key(int x, int z) { return (long long) (((unsigned long long) (unsigned int) x << 32) | (unsigned int) z); }
+
+	/*
+	 * Returns the region entry at a given region x, z coord, opening it if needed
+	 */
+	region_entry *get_region_entry(int r_x, int r_z);
+
+	/*
+	 * Reads a chunk from its region file
+	 */
+	chunk_ptr load_chunk(int c_x, int c_z);
+
+	/*
+	 * Marks a region's file handle as recently used, closing the oldest handles
+	 */
+	void touch_region(region_entry *entry);
+
+public:
+
+	/*
+	 * Default cache byte budget
+	 */
+	static const size_t DEF_CAPACITY = 256 * 1024 * 1024;
+
+	/*
+	 * Maximum number of region files kept open
+	 */
+	static const unsigned int MAX_OPEN_REGIONS = 64;
+
+	/*
+	 * World constructor
+	 */
+	world(const std::string &dir) : dir(dir), capacity(DEF_CAPACITY), size(0) { return; }
+
+	/*
+	 * World constructor
+	 */
+	world(const std::string &dir, size_t capacity) : dir(dir), capacity(capacity), size(0) { return; }
+
+	/*
+	 * World destructor
+	 */
+	virtual ~world(void);
+
+	/*
+	 * Returns the chunk coord containing a given block coord
+	 */
+	static int chunk_coord(int b) { return floor_div(b, region_dim::BLOCK_WIDTH); }
+
+	/*
+	 * Drop all cached chunks & close all regions
+	 */
+	void clear(void);
+
+	/*
+	 * Floor division (rounds toward negative infinity)
+	 */
+	static int floor_div(int value, int div) { return (value >= 0) ? value / div : -((-value + div - 1) / div); }
+
+	/*
+	 * Returns a biome value at a given block x, z coord
+	 */
+	char get_biome(int x, int z);
+
+	/*
+	 * Returns a block value at a given block x, y, z coord
+	 */
+	int get_block(int x, int y, int z);
+
+	/*
+	 * Returns a world's cache byte budget
+	 */
+	size_t get_capacity(void) { return capacity; }
+
+	/*
+	 * Returns a chunk at a given chunk x, z coord (NULL if the chunk does not exist)
+	 */
+	chunk_ptr get_chunk(int c_x, int c_z);
+
+	/*
+	 * Returns a world's region file directory
+	 */
+	const std::string &get_directory(void) { return dir; }
+
+	/*
+	 * Returns a height value at a given block x, z coord
+	 */
+	int get_height(int x, int z);
+
+	/*
+	 * Returns a world's current cache size in bytes
+	 */
+	size_t get_size(void);
+
+	/*
+	 * Returns true if a chunk exists at a given chunk x, z coord
+	 */
+	bool is_filled(int c_x, int c_z);
+
+	/*
+	 * Returns the local (in-chunk or in-region) coord of a given coord
+	 */
+	static unsigned int local_coord(int value, int div) { return value - floor_div(value, div) * div; }
+
+	/*
+	 * Returns the region coord containing a given chunk coord
+	 */
+	static int region_coord(int c) { return floor_div(c, region_dim::CHUNK_WIDTH); }
+
+	/*
+	 * Returns the region file path at a given region x, z coord
+	 */
+	std::string region_path(int r_x, int r_z);
+
+	/*
+	 * Sets a world's cache byte budget
+	 */
+	void set_capacity(size_t capacity);
+
+	/*
+	 * Returns a string representation of a world
+	 */
+	std::string to_string(void);
+};
+
+#endif
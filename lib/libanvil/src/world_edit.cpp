@@ -0,0 +1,375 @@
+/*
+ * world_edit.cpp
+ * Copyright (C) 2012 David Jolly
+ * ----------------------
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <boost/filesystem.hpp>
+#include <sstream>
+#include <stdexcept>
+#include "compression.hpp"
+#include "decode_context.hpp"
+#include "heightmap.hpp"
+#include "raw_world.hpp"
+#include "region.hpp"
+#include "region_dim.hpp"
+#include "region_file.hpp"
+#include "region_file_reader.hpp"
+#include "region_file_updater.hpp"
+#include "world.hpp"
+#include "world_edit.hpp"
+#include "tag/byte_array_tag.hpp"
+#include "tag/byte_tag.hpp"
+#include "tag/int_tag.hpp"
+#include "tag/list_tag.hpp"
+
+/*
+ * Returns a string representation of a report
+ */
+std::string world_edit::report::to_string(void) const {
+	std::stringstream ss;
+
+	// form string representation
+	ss << "Regions written: " << regions << ", chunks written: " << chunks << " (" << created << " created)"
+			<< ", errors: " << errors.size();
+	return ss.str();
+}
+
+/*
+ * World edit constructor
+ */
+world_edit::world_edit(const std::string &dir) : dir(dir), count(0), level(compression::DEF_LEVEL), threads(0) {
+
+	// check if region directory exists
+	if(!boost::filesystem::is_directory(dir))
+		throw std::runtime_error("Directory does not exist");
+}
+
+/*
+ * Apply & clear every pending edit, writing affected regions in parallel
+ */
+world_edit::report world_edit::apply(void) {
+	report rep;
+	std::map<std::pair<int, int>, region_edits>::iterator iter = edits.begin();
+
+	// collect regions in a stable order
+	keys.clear();
+	paths.clear();
+	for(; iter != edits.end(); ++iter) {
+		keys.push_back(iter->first);
+		paths.push_back(raw_world::region_path(dir, iter->first.first, iter->first.second));
+	}
+	result = report();
+
+	// apply regions in parallel
+	region_file::for_each(paths, threads, *this, result.errors);
+
+	// drop the applied batch
+	rep = result;
+	clear();
+	return rep;
+}
+
+/*
+ * Apply a chunk's edits to its decoded tag
+ */
+void world_edit::apply_chunk(chunk_tag &tag, chunk_edits &chunk) {
+	unsigned int sect_y, pos;
+	generic_tag *sub_tag;
+	compound_tag *level, *sections[region_dim::SECTION_COUNT];
+	std::vector<char> *blocks[region_dim::SECTION_COUNT], *data[region_dim::SECTION_COUNT], *add[region_dim::SECTION_COUNT];
+
+	// locate level compound
+	sub_tag = tag.get_root_tag().find("Level");
+	if(!sub_tag
+			|| sub_tag->get_type() != generic_tag::COMPOUND)
+		throw std::runtime_error("Malformed chunk tag");
+	level = static_cast<compound_tag *>(sub_tag);
+
+	// set block ids & data, resolving each section's arrays once
+	for(unsigned int i = 0; i < region_dim::SECTION_COUNT; ++i)
+		sections[i] = NULL;
+	for(unsigned int i = 0; i < chunk.blocks.size(); ++i) {
+		block_edit &edit = chunk.blocks.at(i);
+		sect_y = edit.index / region_dim::SECTION_BLOCK_COUNT;
+		pos = edit.index % region_dim::SECTION_BLOCK_COUNT;
+		if(!sections[sect_y]) {
+			sections[sect_y] = get_section(level, sect_y);
+			blocks[sect_y] = &get_array(sections[sect_y], "Blocks", region_dim::SECTION_BLOCK_COUNT, 0);
+			data[sect_y] = &get_array(sections[sect_y], "Data", region_dim::SECTION_BLOCK_COUNT / 2, 0);
+			sub_tag = sections[sect_y]->find("Add");
+			add[sect_y] = sub_tag ? &get_array(sections[sect_y], "Add", region_dim::SECTION_BLOCK_COUNT / 2, 0) : NULL;
+		}
+		if((edit.id >> 8)
+				&& !add[sect_y])
+			add[sect_y] = &get_array(sections[sect_y], "Add", region_dim::SECTION_BLOCK_COUNT / 2, 0);
+		blocks[sect_y]->at(pos) = (char) edit.id;
+		if(add[sect_y])
+			set_nibble(*add[sect_y], pos, edit.id >> 8);
+		if(edit.data != KEEP_DATA)
+			set_nibble(*data[sect_y], pos, edit.data);
+	}
+
+	// set biomes (unset biomes are left as 0xff, recomputed by the game)
+	if(!chunk.biomes.empty()) {
+		std::vector<char> &biomes = get_array(level, "Biomes", region_dim::BLOCK_COUNT, (char) 0xff);
+		for(unsigned int i = 0; i < chunk.biomes.size(); ++i)
+			biomes.at(chunk.biomes.at(i).first) = (char) chunk.biomes.at(i).second;
+	}
+
+	// replace (or add) level sub-tags with copies of the pending tags
+	std::vector<generic_tag *> &value = level->get_value();
+	for(unsigned int i = 0; i < chunk.tags.size(); ++i) {
+		generic_tag *copy = chunk_tag::copy_tag(chunk.tags.at(i));
+		if(!copy)
+			throw std::runtime_error("Failed to copy tag");
+		for(pos = 0; pos < value.size(); ++pos)
+			if(value.at(pos)->get_name() == copy->get_name())
+				break;
+		if(pos < value.size()) {
+			chunk_tag::clean_tag(value.at(pos));
+			value.at(pos) = copy;
+		} else
+			value.push_back(copy);
+	}
+
+	// recompute the height map once block edits are in place
+	if(!chunk.blocks.empty())
+		heightmap::update(tag);
+}
+
+/*
+ * Apply a region's edits, writing each edited chunk in place
+ */
+void world_edit::apply_region(int x, int z, region_edits &reg, report &rep) {
+	char type;
+	std::vector<char> raw;
+	decode_context context;
+	region_edits::iterator iter = reg.begin();
+	region_file_updater updater(raw_world::region_path(dir, x, z));
+
+	// decode, modify & encode each edited chunk once
+	updater.set_level(level);
+	for(; iter != reg.end(); ++iter) {
+		unsigned int local_x = iter->first % region_dim::CHUNK_WIDTH, local_z = iter->first / region_dim::CHUNK_WIDTH;
+		chunk_tag tag;
+
+		// decode the stored chunk, or start a new one
+		if(updater.read_raw(local_x, local_z, type, raw)) {
+			if(type != chunk_info::GZIP
+					&& type != chunk_info::ZLIB)
+				throw std::runtime_error("Unknown compression type");
+			if(!context.inflate_(raw.data(), raw.size()))
+				throw std::runtime_error("Failed to inflate chunk");
+			region_file_reader::parse_chunk_tag(context.get_data(), tag);
+		} else {
+			region::generate_chunk_tag(tag);
+			compound_tag *level_tag = static_cast<compound_tag *>(tag.get_root_tag().find("Level"));
+			static_cast<int_tag *>(level_tag->find("xPos"))->set_value(x * (int) region_dim::CHUNK_WIDTH + (int) local_x);
+			static_cast<int_tag *>(level_tag->find("zPos"))->set_value(z * (int) region_dim::CHUNK_WIDTH + (int) local_z);
+			++rep.created;
+		}
+
+		// modify & write back
+		apply_chunk(tag, iter->second);
+		updater.write_chunk(local_x, local_z, tag);
+		++rep.chunks;
+	}
+	updater.close();
+	rep.regions = 1;
+}
+
+/*
+ * Drop every pending edit
+ */
+void world_edit::clear(void) {
+	std::map<std::pair<int, int>, region_edits>::iterator iter = edits.begin();
+
+	// free pending tags
+	for(; iter != edits.end(); ++iter)
+		for(region_edits::iterator chunk = iter->second.begin(); chunk != iter->second.end(); ++chunk)
+			for(unsigned int i = 0; i < chunk->second.tags.size(); ++i)
+				chunk_tag::clean_tag(chunk->second.tags.at(i));
+	edits.clear();
+	keys.clear();
+	count = 0;
+}
+
+/*
+ * Returns a named byte array tag of a given size, adding or resizing it
+ * (new bytes take a given fill value)
+ */
+std::vector<char> &world_edit::get_array(compound_tag *parent, const std::string &name, size_t size, char fill) {
+	generic_tag *sub_tag = parent->find(name);
+
+	// add missing array
+	if(!sub_tag) {
+		sub_tag = new byte_array_tag(name);
+		parent->push_back(sub_tag);
+	} else if(sub_tag->get_type() != generic_tag::BYTE_ARRAY)
+		throw std::runtime_error("Malformed chunk tag");
+
+	// resize to the expected length
+	std::vector<char> &value = static_cast<byte_array_tag *>(sub_tag)->get_value();
+	if(value.size() != size)
+		value.resize(size, fill);
+	return value;
+}
+
+/*
+ * Returns a chunk's pending edits at a given chunk x, z coord
+ */
+world_edit::chunk_edits &world_edit::get_chunk_edits(int x, int z) {
+	return edits[std::make_pair(world::region_coord(x), world::region_coord(z))]
+			[world::local_coord(z, region_dim::CHUNK_WIDTH) * region_dim::CHUNK_WIDTH + world::local_coord(x, region_dim::CHUNK_WIDTH)];
+}
+
+/*
+ * Returns a section's compound tag at a given section y coord, adding
+ * empty sections up to it (in y order) if missing
+ */
+compound_tag *world_edit::get_section(compound_tag *level, unsigned int y) {
+	int sect_y;
+	unsigned int pos;
+	generic_tag *sub_tag;
+	list_tag *sect_list;
+	compound_tag *sect = NULL;
+
+	// locate sections list, adding one if missing
+	sub_tag = level->find("Sections");
+	if(!sub_tag) {
+		sub_tag = new list_tag("Sections", generic_tag::COMPOUND);
+		level->push_back(sub_tag);
+	} else if(sub_tag->get_type() != generic_tag::LIST)
+		throw std::runtime_error("Malformed chunk tag");
+	sect_list = static_cast<list_tag *>(sub_tag);
+
+	// find each section up to the y coord, adding empty (air, fully sky-lit)
+	// sections where missing in y order (block readers join sections in list
+	// order, so sections must stay sorted & contiguous from zero)
+	for(unsigned int s = 0; s <= y; ++s) {
+		sect = NULL;
+		pos = sect_list->size();
+		for(unsigned int i = 0; i < sect_list->size(); ++i) {
+			if(sect_list->at(i)->get_type() != generic_tag::COMPOUND)
+				continue;
+			sub_tag = static_cast<compound_tag *>(sect_list->at(i))->find("Y");
+			if(!sub_tag
+					|| sub_tag->get_type() != generic_tag::BYTE)
+				continue;
+			sect_y = (unsigned char) static_cast<byte_tag *>(sub_tag)->get_value();
+			if(sect_y == (int) s) {
+				sect = static_cast<compound_tag *>(sect_list->at(i));
+				break;
+			}
+			if(sect_y > (int) s
+					&& i < pos)
+				pos = i;
+		}
+		if(sect)
+			continue;
+		sect = new compound_tag;
+		sect->push_back(new byte_tag("Y", (char) s));
+		sect->push_back(new byte_array_tag("Blocks", std::vector<char>(region_dim::SECTION_BLOCK_COUNT, 0)));
+		sect->push_back(new byte_array_tag("Data", std::vector<char>(region_dim::SECTION_BLOCK_COUNT / 2, 0)));
+		sect->push_back(new byte_array_tag("BlockLight", std::vector<char>(region_dim::SECTION_BLOCK_COUNT / 2, 0)));
+		sect->push_back(new byte_array_tag("SkyLight", std::vector<char>(region_dim::SECTION_BLOCK_COUNT / 2, (char) 0xff)));
+		sect_list->insert(sect, pos);
+	}
+	return sect;
+}
+
+/*
+ * Sets a biome at a given world block x, z coord
+ */
+void world_edit::set_biome(int x, int z, unsigned char biome) {
+	unsigned int b_x = world::local_coord(x, region_dim::BLOCK_WIDTH), b_z = world::local_coord(z, region_dim::BLOCK_WIDTH);
+
+	// record edit
+	get_chunk_edits(world::chunk_coord(x), world::chunk_coord(z)).biomes.push_back(
+			std::make_pair((unsigned char) (b_z * region_dim::BLOCK_WIDTH + b_x), biome));
+	++count;
+}
+
+/*
+ * Sets a block id & data value at a given world block x, y, z coord
+ */
+void world_edit::set_block(int x, unsigned int y, int z, unsigned short id, int data) {
+	unsigned int b_x = world::local_coord(x, region_dim::BLOCK_WIDTH), b_z = world::local_coord(z, region_dim::BLOCK_WIDTH);
+
+	// check for valid height, id & data
+	if(y >= region_dim::BLOCK_HEIGHT)
+		throw std::out_of_range("height out-of-range");
+	if(id > 0xfff)
+		throw std::out_of_range("block id out-of-range");
+	if(data != KEEP_DATA
+			&& (data < 0 || data > 0xf))
+		throw std::out_of_range("block data out-of-range");
+
+	// record edit
+	get_chunk_edits(world::chunk_coord(x), world::chunk_coord(z)).blocks.push_back(
+			block_edit((y * region_dim::BLOCK_WIDTH + b_z) * region_dim::BLOCK_WIDTH + b_x, id, data));
+	++count;
+}
+
+/*
+ * Replaces (or adds) a named tag within a chunk's Level compound at a given
+ * chunk x, z coord (the world edit takes ownership of the tag)
+ */
+void world_edit::set_tag(int x, int z, generic_tag *tag) {
+
+	// check for valid tag
+	if(!tag)
+		throw std::runtime_error("Invalid tag");
+
+	// record edit
+	get_chunk_edits(x, z).tags.push_back(tag);
+	++count;
+}
+
+/*
+ * Returns a string representation of a world edit
+ */
+std::string world_edit::to_string(void) {
+	std::stringstream ss;
+
+	// form string representation
+	ss << "Dir: " << dir << ", pending edits: " << count << ", regions: " << edits.size();
+	return ss.str();
+}
+
+/*
+ * Apply a region's edits & merge its report (called concurrently from
+ * worker threads)
+ */
+void world_edit::visit(size_t index) {
+	report rep;
+	std::string error;
+
+	// apply region edits (chunks written before a failure are kept & counted)
+	try {
+		apply_region(keys.at(index).first, keys.at(index).second, edits.find(keys.at(index))->second, rep);
+	} catch(std::exception &exc) {
+		error = exc.what();
+	}
+	lock.lock();
+	result.regions += rep.regions;
+	result.chunks += rep.chunks;
+	result.created += rep.created;
+	lock.unlock();
+	if(!error.empty())
+		throw std::runtime_error(error);
+}
@@ -0,0 +1,263 @@
+/*
+ * world_edit.hpp
+ * Copyright (C) 2012 David Jolly
+ * ----------------------
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef WORLD_EDIT_HPP_
+#define WORLD_EDIT_HPP_
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include "chunk_tag.hpp"
+#include "region_visitor.hpp"
+#include "tag/compound_tag.hpp"
+#include "tag/generic_tag.hpp"
+
+/*
+ * Batched block, biome & tag edits addressed by world coords, applied with
+ * one decode-modify-encode cycle per chunk & one updater per region
+ */
+class world_edit : private region_visitor {
+public:
+
+	/*
+	 * Keep a block's existing data value
+	 */
+	static const int KEEP_DATA = -1;
+
+	/*
+	 * Apply report
+	 */
+	class report {
+	public:
+
+		/*
+		 * Regions & chunks written
+		 */
+		unsigned int regions, chunks;
+
+		/*
+		 * Chunks created for edits in empty positions
+		 */
+		unsigned int created;
+
+		/*
+		 * Regions left (partly) unedited due to errors
+		 */
+		std::vector<std::string> errors;
+
+		/*
+		 * Report constructor
+		 */
+		report(void) : regions(0), chunks(0), created(0) { return; }
+
+		/*
+		 * Returns a string representation of a report
+		 */
+		std::string to_string(void) const;
+	};
+
+private:
+
+	/*
+	 * Block edit (index within a chunk as (y * 16 + z) * 16 + x)
+	 */
+	class block_edit {
+	public:
+		unsigned int index;
+		unsigned short id;
+		int data;
+
+		/*
+		 * Block edit constructor
+		 */
+		block_edit(unsigned int index, unsigned short id, int data) : index(index), id(id), data(data) { return; }
+	};
+
+	/*
+	 * Pending edits for a single chunk, in recorded order
+	 */
+	class chunk_edits {
+	public:
+		std::vector<block_edit> blocks;
+		std::vector<std::pair<unsigned char, unsigned char>> biomes;
+		std::vector<generic_tag *> tags;
+	};
+
+	/*
+	 * Pending edits by local chunk index within a region
+	 */
+	typedef std::map<unsigned int, chunk_edits> region_edits;
+
+	/*
+	 * Region directory
+	 */
+	std::string dir;
+
+	/*
+	 * Pending edits by region x, z coord
+	 */
+	std::map<std::pair<int, int>, region_edits> edits;
+
+	/*
+	 * Pending edit count
+	 */
+	size_t count;
+
+	/*
+	 * Deflate level & worker thread count
+	 */
+	int level;
+	unsigned int threads;
+
+	/*
+	 * Regions to apply (by region x, z coord & path) & merged report
+	 */
+	std::vector<std::pair<int, int>> keys;
+	std::vector<std::string> paths;
+	report result;
+	std::mutex lock;
+
+	/*
+	 * World edit constructor (non-copyable)
+	 */
+	world_edit(const world_edit &other);
+
+	/*
+	 * World edit assignment operator (non-copyable)
+	 */
+	world_edit &operator=(const world_edit &other);
+
+	/*
+	 * Apply a chunk's edits to its decoded tag
+	 */
+	static void apply_chunk(chunk_tag &tag, chunk_edits &chunk);
+
+	/*
+	 * Apply a region's edits, writing each edited chunk in place
+	 */
+	void apply_region(int x, int z, region_edits &reg, report &rep);
+
+	/*
+	 * Returns a chunk's pending edits at a given chunk x, z coord
+	 */
+	chunk_edits &get_chunk_edits(int x, int z);
+
+	/*
+	 * Returns a section's compound tag at a given section y coord, adding
+	 * empty sections up to it (in y order) if missing
+	 */
+	static compound_tag *get_section(compound_tag *level, unsigned int y);
+
+	/*
+	 * Returns a named byte array tag of a given size, adding or resizing it
+	 * (new bytes take a given fill value)
+	 */
+	static std::vector<char> &get_array(compound_tag *parent, const std::string &name, size_t size, char fill);
+
+	/*
+	 * Apply a region's edits & merge its report (called concurrently from
+	 * worker threads)
+	 */
+	void visit(size_t index);
+
+	/*
+	 * Set a nibble within a nibble array
+	 */
+	static void set_nibble(std::vector<char> &data, unsigned int index, unsigned int value) {
+		char &byte = data.at(index >> 1);
+		byte = (index & 1) ? (char) ((byte & 0x0f) | (value << 4)) : (char) ((byte & 0xf0) | (value & 0x0f));
+	}
+
+public:
+
+	/*
+	 * World edit constructor
+	 */
+	world_edit(const std::string &dir);
+
+	/*
+	 * World edit destructor
+	 */
+	virtual ~world_edit(void) { clear(); }
+
+	/*
+	 * Apply & clear every pending edit, writing affected regions in parallel
+	 */
+	report apply(void);
+
+	/*
+	 * Drop every pending edit
+	 */
+	void clear(void);
+
+	/*
+	 * Returns a world edit's pending edit count
+	 */
+	size_t get_count(void) { return count; }
+
+	/*
+	 * Returns a world edit's region directory
+	 */
+	const std::string &get_dir(void) { return dir; }
+
+	/*
+	 * Returns a world edit's pending region count
+	 */
+	size_t get_region_count(void) { return edits.size(); }
+
+	/*
+	 * Sets a biome at a given world block x, z coord
+	 */
+	void set_biome(int x, int z, unsigned char biome);
+
+	/*
+	 * Sets a block id at a given world block x, y, z coord (keeping its data value)
+	 */
+	void set_block(int x, unsigned int y, int z, unsigned short id) { set_block(x, y, z, id, KEEP_DATA); }
+
+	/*
+	 * Sets a block id & data value at a given world block x, y, z coord
+	 */
+	void set_block(int x, unsigned int y, int z, unsigned short id, int data);
+
+	/*
+	 * Sets a world edit's deflate level (0-9)
+	 */
+	void set_level(int level) { this->level = level; }
+
+	/*
+	 * Replaces (or adds) a named tag within a chunk's Level compound at a given
+	 * chunk x, z coord (the world edit takes ownership of the tag)
+	 */
+	void set_tag(int x, int z, generic_tag *tag);
+
+	/*
+	 * Sets a world edit's worker thread count (0 uses the hardware concurrency)
+	 */
+	void set_threads(unsigned int threads) { this->threads = threads; }
+
+	/*
+	 * Returns a string representation of a world edit
+	 */
+	std::string to_string(void);
+};
+
+#endif
@@ -0,0 +1,460 @@
+/*
+ * world_generator.cpp
+ * Copyright (C) 2012 David Jolly
+ * ----------------------
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <boost/filesystem.hpp>
+#include <cstdlib>
+#include <sstream>
+#include <stdexcept>
+#include "heightmap.hpp"
+#include "raw_world.hpp"
+#include "region_builder.hpp"
+#include "region_dim.hpp"
+#include "region_file.hpp"
+#include "world.hpp"
+#include "world_generator.hpp"
+#include "tag/byte_array_tag.hpp"
+#include "tag/byte_tag.hpp"
+#include "tag/compound_tag.hpp"
+#include "tag/int_tag.hpp"
+#include "tag/list_tag.hpp"
+
+/*
+ * Returns a string representation of a report
+ */
+std::string world_generator::report::to_string(void) const {
+	std::stringstream ss;
+
+	// form string representation
+	ss << "Regions: " << regions << ", chunks: " << chunks << ", size: " << size << ", errors: " << errors.size();
+	return ss.str();
+}
+
+/*
+ * Returns fractal 2D value noise (0-65535) summed over octaves
+ */
+unsigned int world_generator::fractal(unsigned int seed, unsigned int channel, int x, int z, unsigned int shift, unsigned int octaves) {
+	unsigned int sum = 0, weight = 0;
+
+	// halve the lattice size & amplitude each octave
+	for(unsigned int i = 0; i < octaves && i <= shift; ++i) {
+		sum += noise(seed + i, channel, x, z, shift - i) << (octaves - i - 1);
+		weight += 1 << (octaves - i - 1);
+	}
+	return sum / weight;
+}
+
+/*
+ * Generate every region within an options rectangle in parallel
+ */
+world_generator::report world_generator::generate(const std::string &dir, const options &opt) {
+	world_generator generator(dir, opt);
+
+	// check if region directory exists
+	if(!boost::filesystem::is_directory(dir))
+		throw std::runtime_error("Directory does not exist");
+	if(opt.min_x > opt.max_x
+			|| opt.min_z > opt.max_z)
+		throw std::runtime_error("Invalid region bounds");
+
+	// collect region coords in row-major order
+	for(int z = opt.min_z; z <= opt.max_z; ++z)
+		for(int x = opt.min_x; x <= opt.max_x; ++x) {
+			generator.keys.push_back(std::make_pair(x, z));
+			generator.paths.push_back(raw_world::region_path(dir, x, z));
+		}
+
+	// generate regions in parallel
+	region_file::for_each(generator.paths, opt.threads, generator, generator.result.errors);
+	return generator.result;
+}
+
+/*
+ * Fill an empty (skeleton) chunk tag with generated content at a given
+ * chunk x, z coord
+ */
+void world_generator::generate_chunk(chunk_tag &tag, int x, int z, unsigned int seed) {
+	int w_x, w_z, height, top, max_top = 0;
+	unsigned int density, pos, rnd;
+	unsigned char surface, filler;
+	int heights[region_dim::BLOCK_COUNT];
+	std::vector<char> blocks(region_dim::BLOCK_HEIGHT * region_dim::BLOCK_COUNT, AIR),
+			data(region_dim::BLOCK_HEIGHT * region_dim::BLOCK_COUNT / 2, 0),
+			sky(region_dim::BLOCK_HEIGHT * region_dim::BLOCK_COUNT / 2, 0),
+			biomes(region_dim::BLOCK_COUNT);
+	generic_tag *sub_tag;
+	compound_tag *level;
+
+	// locate level compound
+	sub_tag = tag.get_root_tag().find("Level");
+	if(!sub_tag
+			|| sub_tag->get_type() != generic_tag::COMPOUND)
+		throw std::runtime_error("Malformed chunk tag");
+	level = static_cast<compound_tag *>(sub_tag);
+
+	// fill each column from bedrock to its surface, then water & plants
+	for(unsigned int b_z = 0; b_z < region_dim::BLOCK_WIDTH; ++b_z)
+		for(unsigned int b_x = 0; b_x < region_dim::BLOCK_WIDTH; ++b_x) {
+			unsigned char biome;
+			w_x = x * (int) region_dim::BLOCK_WIDTH + (int) b_x;
+			w_z = z * (int) region_dim::BLOCK_WIDTH + (int) b_z;
+			pos = b_z * region_dim::BLOCK_WIDTH + b_x;
+			height = get_column(seed, w_x, w_z, biome);
+			heights[pos] = height;
+			biomes[pos] = (char) biome;
+
+			// pick surface & filler blocks by biome
+			switch(biome) {
+				case DESERT:
+				case BEACH:
+					surface = SAND;
+					filler = SAND;
+					break;
+				case OCEAN:
+				case RIVER:
+					surface = (hash(seed, ORE, w_x, 0, w_z) & 3) ? SAND : GRAVEL;
+					filler = (height < SEA_LEVEL - 8) ? STONE : SAND;
+					break;
+				case EXTREME_HILLS:
+					surface = (height > 110) ? STONE : GRASS;
+					filler = (height > 110) ? STONE : DIRT;
+					break;
+				default:
+					surface = GRASS;
+					filler = DIRT;
+					break;
+			}
+
+			// bedrock floor, stone with scattered ores, filler & surface
+			blocks[pos] = BEDROCK;
+			for(int y = 1; y <= height; ++y) {
+				char &block = blocks[y * region_dim::BLOCK_COUNT + pos];
+				if(y == height)
+					block = surface;
+				else if(y > height - 4)
+					block = filler;
+				else if(y < 4
+						&& (int) (hash(seed, ORE, w_x, y, w_z) & 3) >= y)
+					block = BEDROCK;
+				else {
+					rnd = hash(seed, ORE, w_x, y, w_z) % 1000;
+					if(y < 64
+							&& rnd < 12)
+						block = COAL_ORE;
+					else if(y < 40
+							&& rnd < 20)
+						block = IRON_ORE;
+					else
+						block = STONE;
+				}
+			}
+
+			// flood below sea level (frozen over in cold biomes)
+			for(int y = height + 1; y <= SEA_LEVEL; ++y)
+				blocks[y * region_dim::BLOCK_COUNT + pos] = (y == SEA_LEVEL
+						&& (biome == ICE_PLAINS || biome == TAIGA)) ? ICE : WATER;
+
+			// carve caves beneath dry land (lava-filled near the floor)
+			if(height > SEA_LEVEL + 2)
+				for(int y = 6; y < height - 6; ++y)
+					if(is_cave(seed, w_x, y, w_z))
+						blocks[y * region_dim::BLOCK_COUNT + pos] = (y <= 10) ? LAVA : AIR;
+
+			// scatter snow or plants on dry grass
+			if(surface != GRASS
+					|| height < SEA_LEVEL
+					|| height + 1 >= (int) region_dim::BLOCK_HEIGHT)
+				continue;
+			if(biome == ICE_PLAINS) {
+				blocks[(height + 1) * region_dim::BLOCK_COUNT + pos] = SNOW;
+				continue;
+			}
+			rnd = hash(seed, PLANT, w_x, 0, w_z) % 100;
+			if(rnd < 8) {
+				blocks[(height + 1) * region_dim::BLOCK_COUNT + pos] = TALL_GRASS;
+				set_nibble(data, (height + 1) * region_dim::BLOCK_COUNT + pos, 1);
+			} else if(rnd == 8)
+				blocks[(height + 1) * region_dim::BLOCK_COUNT + pos] = FLOWER;
+			else if(rnd == 9)
+				blocks[(height + 1) * region_dim::BLOCK_COUNT + pos] = ROSE;
+		}
+
+	// plant trees far enough from the chunk edges that their leaves stay inside
+	for(unsigned int b_z = 2; b_z < region_dim::BLOCK_WIDTH - 2; ++b_z)
+		for(unsigned int b_x = 2; b_x < region_dim::BLOCK_WIDTH - 2; ++b_x) {
+			pos = b_z * region_dim::BLOCK_WIDTH + b_x;
+			switch((unsigned char) biomes[pos]) {
+				case FOREST: density = 30;
+					break;
+				case TAIGA: density = 20;
+					break;
+				case SWAMPLAND: density = 10;
+					break;
+				case EXTREME_HILLS: density = 4;
+					break;
+				case PLAINS: density = 2;
+					break;
+				default: density = 0;
+					break;
+			}
+			height = heights[pos];
+			if(!density
+					|| height < SEA_LEVEL
+					|| height + 8 >= (int) region_dim::BLOCK_HEIGHT
+					|| blocks[height * region_dim::BLOCK_COUNT + pos] != GRASS)
+				continue;
+			rnd = hash(seed, TREE, x * (int) region_dim::BLOCK_WIDTH + (int) b_x, 0, z * (int) region_dim::BLOCK_WIDTH + (int) b_z);
+			if(rnd % 1000 >= density)
+				continue;
+			place_tree(blocks, data, b_x, height + 1, b_z, (biomes[pos] == TAIGA) ? 1 : 0, rnd >> 10);
+		}
+
+	// light each column fully above its highest block
+	for(pos = 0; pos < region_dim::BLOCK_COUNT; ++pos) {
+		for(top = region_dim::BLOCK_HEIGHT - 1; top > 0; --top)
+			if(blocks[top * region_dim::BLOCK_COUNT + pos] != AIR)
+				break;
+		for(int y = top + 1; y < (int) region_dim::BLOCK_HEIGHT; ++y)
+			set_nibble(sky, y * region_dim::BLOCK_COUNT + pos, 0xf);
+		max_top = std::max(max_top, top);
+	}
+
+	// store position, biomes & every section up to the highest block
+	static_cast<int_tag *>(level->find("xPos"))->set_value(x);
+	static_cast<int_tag *>(level->find("zPos"))->set_value(z);
+	static_cast<byte_tag *>(level->find("TerrainPopulated"))->set_value(1);
+	static_cast<byte_array_tag *>(level->find("Biomes"))->set_value(biomes);
+	list_tag *sections = static_cast<list_tag *>(level->find("Sections"));
+	for(int y = 0; y <= max_top / (int) region_dim::BLOCK_WIDTH; ++y) {
+		size_t begin = y * region_dim::SECTION_BLOCK_COUNT;
+		compound_tag *sect = new compound_tag;
+		sect->push_back(new byte_tag("Y", (char) y));
+		sect->push_back(new byte_array_tag("Blocks", std::vector<char>(blocks.begin() + begin,
+				blocks.begin() + begin + region_dim::SECTION_BLOCK_COUNT)));
+		sect->push_back(new byte_array_tag("Data", std::vector<char>(data.begin() + begin / 2,
+				data.begin() + (begin + region_dim::SECTION_BLOCK_COUNT) / 2)));
+		sect->push_back(new byte_array_tag("SkyLight", std::vector<char>(sky.begin() + begin / 2,
+				sky.begin() + (begin + region_dim::SECTION_BLOCK_COUNT) / 2)));
+		sect->push_back(new byte_array_tag("BlockLight", std::vector<char>(region_dim::SECTION_BLOCK_COUNT / 2, 0)));
+		sections->push_back(sect);
+	}
+	heightmap::update(tag);
+}
+
+/*
+ * Generate a single region file at a given region x, z coord, returning its report
+ */
+world_generator::report world_generator::generate_region(const std::string &dir, int x, int z, const options &opt) {
+	report rep;
+	std::string path = raw_world::region_path(dir, x, z);
+	region_builder builder(path, x, z);
+
+	// generate each kept chunk into the builder
+	builder.set_level(opt.level);
+	builder.set_threads(1);
+	for(unsigned int c_z = 0; c_z < region_dim::CHUNK_WIDTH; ++c_z)
+		for(unsigned int c_x = 0; c_x < region_dim::CHUNK_WIDTH; ++c_x) {
+			int chunk_x = x * (int) region_dim::CHUNK_WIDTH + (int) c_x, chunk_z = z * (int) region_dim::CHUNK_WIDTH + (int) c_z;
+			if(!keep(opt, chunk_x, chunk_z))
+				continue;
+			generate_chunk(builder.add_chunk(c_x, c_z), chunk_x, chunk_z, opt.seed);
+			++rep.chunks;
+		}
+
+	// write regions holding at least one chunk
+	if(!rep.chunks)
+		return rep;
+	builder.finish();
+	rep.regions = 1;
+	rep.size = boost::filesystem::file_size(path);
+	return rep;
+}
+
+/*
+ * Returns a column's surface height & biome at a given world block x, z coord
+ */
+int world_generator::get_column(unsigned int seed, int x, int z, unsigned char &biome) {
+	int height, dist, river_height;
+	unsigned int base = fractal(seed, TERRAIN, x, z, 7, 4), mount = noise(seed, MOUNTAIN, x, z, 9),
+			temp = noise(seed, TEMPERATURE, x, z, 9), rain = noise(seed, RAINFALL, x, z, 8);
+
+	// rolling terrain, raised into mountains where the mountain noise peaks
+	height = 40 + (int) ((base * 48) >> 16);
+	if(mount > 40000)
+		height += (int) ((((mount - 40000) >> 8) * (base >> 8)) >> 9);
+
+	// carve rivers along the mid-line of the river noise
+	dist = std::abs((int) noise(seed, RIVER_PATH, x, z, 8) - 32768);
+	if(dist < 1500
+			&& height < 100
+			&& height >= SEA_LEVEL - 3) {
+		river_height = SEA_LEVEL - 3 + dist / 250;
+		if(river_height < height) {
+			biome = RIVER;
+			return river_height;
+		}
+	}
+
+	// pick a biome by height, temperature & rainfall
+	if(height < SEA_LEVEL)
+		biome = OCEAN;
+	else if(height <= SEA_LEVEL + 1)
+		biome = (temp < 16000) ? ICE_PLAINS : BEACH;
+	else if(height > 92)
+		biome = EXTREME_HILLS;
+	else if(temp < 16000)
+		biome = (rain > 32768) ? TAIGA : ICE_PLAINS;
+	else if(temp > 45000
+			&& rain < 24000)
+		biome = DESERT;
+	else if(rain > 46000
+			&& temp > 32000)
+		biome = SWAMPLAND;
+	else if(rain > 30000)
+		biome = FOREST;
+	else
+		biome = PLAINS;
+	return height;
+}
+
+/*
+ * Returns a pseudo-random value for a given seed, channel & coord
+ */
+unsigned int world_generator::hash(unsigned int seed, unsigned int channel, int x, int y, int z) {
+	unsigned long long value = ((unsigned long long) seed << 8 | channel) * 0x9e3779b97f4a7c15ULL;
+
+	// mix each coord in with its own odd multiplier
+	value ^= (unsigned long long) (unsigned int) x * 0xc2b2ae3d27d4eb4fULL;
+	value ^= (unsigned long long) (unsigned int) y * 0x165667b19e3779f9ULL;
+	value ^= (unsigned long long) (unsigned int) z * 0x27d4eb2f165667c5ULL;
+	value ^= value >> 31;
+	value *= 0xbf58476d1ce4e5b9ULL;
+	value ^= value >> 29;
+	value *= 0x94d049bb133111ebULL;
+	value ^= value >> 32;
+	return (unsigned int) value;
+}
+
+/*
+ * Returns true if a cave passes through a given world block coord
+ */
+bool world_generator::is_cave(unsigned int seed, int x, int y, int z) {
+
+	// tunnels follow the intersection of two noise mid-surfaces
+	return std::abs((int) noise(seed, CAVE_A, x, y, z, 4, 3) - 32768) < 2600
+			&& std::abs((int) noise(seed, CAVE_B, x, y, z, 4, 3) - 32768) < 2600;
+}
+
+/*
+ * Returns true if a chunk at a given chunk x, z coord is generated (chunks
+ * near the world edge are kept with a falling probability)
+ */
+bool world_generator::keep(const options &opt, int x, int z) {
+	int dist;
+
+	// measure distance (in chunks) to the nearest world edge
+	if(!opt.edge)
+		return true;
+	dist = std::min(std::min(x - opt.min_x * (int) region_dim::CHUNK_WIDTH, (opt.max_x + 1) * (int) region_dim::CHUNK_WIDTH - 1 - x),
+			std::min(z - opt.min_z * (int) region_dim::CHUNK_WIDTH, (opt.max_z + 1) * (int) region_dim::CHUNK_WIDTH - 1 - z));
+	if(dist >= (int) opt.edge)
+		return true;
+	return hash(opt.seed, EDGE, x, 0, z) % (opt.edge + 1) <= (unsigned int) dist;
+}
+
+/*
+ * Returns 2D value noise (0-65535) over a lattice of 2^shift blocks
+ */
+unsigned int world_generator::noise(unsigned int seed, unsigned int channel, int x, int z, unsigned int shift) {
+	int size = 1 << shift, c_x = world::floor_div(x, size), c_z = world::floor_div(z, size);
+	unsigned int f_x = ((x - c_x * size) << 8) >> shift, f_z = ((z - c_z * size) << 8) >> shift;
+
+	// interpolate lattice corner values
+	return lerp(lerp(hash(seed, channel, c_x, 0, c_z) & 0xffff, hash(seed, channel, c_x + 1, 0, c_z) & 0xffff, f_x),
+			lerp(hash(seed, channel, c_x, 0, c_z + 1) & 0xffff, hash(seed, channel, c_x + 1, 0, c_z + 1) & 0xffff, f_x), f_z);
+}
+
+/*
+ * Returns 3D value noise (0-65535) over a lattice of 2^shift (2^shift_y vertically) blocks
+ */
+unsigned int world_generator::noise(unsigned int seed, unsigned int channel, int x, int y, int z, unsigned int shift, unsigned int shift_y) {
+	int size = 1 << shift, size_y = 1 << shift_y, c_x = world::floor_div(x, size), c_y = world::floor_div(y, size_y),
+			c_z = world::floor_div(z, size), layer[2];
+	unsigned int f_x = ((x - c_x * size) << 8) >> shift, f_y = ((y - c_y * size_y) << 8) >> shift_y,
+			f_z = ((z - c_z * size) << 8) >> shift;
+
+	// interpolate each lattice layer, then between layers
+	for(int i = 0; i < 2; ++i)
+		layer[i] = lerp(lerp(hash(seed, channel, c_x, c_y + i, c_z) & 0xffff, hash(seed, channel, c_x + 1, c_y + i, c_z) & 0xffff, f_x),
+				lerp(hash(seed, channel, c_x, c_y + i, c_z + 1) & 0xffff, hash(seed, channel, c_x + 1, c_y + i, c_z + 1) & 0xffff, f_x), f_z);
+	return lerp(layer[0], layer[1], f_y);
+}
+
+/*
+ * Place a tree with its trunk at a given chunk block coord
+ */
+void world_generator::place_tree(std::vector<char> &blocks, std::vector<char> &data, unsigned int x, int y, unsigned int z,
+		unsigned int kind, unsigned int leaf_bits) {
+	int top = y + 3 + (leaf_bits & 1) + ((leaf_bits >> 1) & 1), radius;
+	unsigned int pos;
+
+	// leaves: two wide layers below the top, two narrow layers above
+	leaf_bits >>= 2;
+	for(int l_y = top - 2; l_y <= top + 1; ++l_y) {
+		radius = (l_y < top) ? 2 : 1;
+		for(int d_z = -radius; d_z <= radius; ++d_z)
+			for(int d_x = -radius; d_x <= radius; ++d_x) {
+
+				// trim corners (randomly on wide layers, always on the crown)
+				if(std::abs(d_x) == radius
+						&& std::abs(d_z) == radius) {
+					leaf_bits = (leaf_bits >> 1) | ((leaf_bits & 1) << 29);
+					if(l_y == top + 1
+							|| (leaf_bits & 1))
+						continue;
+				}
+				pos = (l_y * region_dim::BLOCK_WIDTH + z + d_z) * region_dim::BLOCK_WIDTH + x + d_x;
+				if(blocks[pos] == AIR
+						|| blocks[pos] == TALL_GRASS) {
+					blocks[pos] = LEAVES;
+					set_nibble(data, pos, kind);
+				}
+			}
+	}
+
+	// trunk
+	for(int l_y = y; l_y <= top; ++l_y) {
+		pos = (l_y * region_dim::BLOCK_WIDTH + z) * region_dim::BLOCK_WIDTH + x;
+		blocks[pos] = LOG;
+		set_nibble(data, pos, kind);
+	}
+}
+
+/*
+ * Generate a region & merge its report (called concurrently from worker threads)
+ */
+void world_generator::visit(size_t index) {
+	report rep = generate_region(dir, keys.at(index).first, keys.at(index).second, opt);
+
+	lock.lock();
+	result.regions += rep.regions;
+	result.chunks += rep.chunks;
+	result.size += rep.size;
+	lock.unlock();
+}
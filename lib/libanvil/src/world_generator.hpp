@@ -0,0 +1,257 @@
+/*
+ * world_generator.hpp
+ * Copyright (C) 2012 David Jolly
+ * ----------------------
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef WORLD_GENERATOR_HPP_
+#define WORLD_GENERATOR_HPP_
+
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include "chunk_tag.hpp"
+#include "compression.hpp"
+#include "region_visitor.hpp"
+
+/*
+ * Seeded synthetic world generator (terrain, biomes, rivers, caves, water,
+ * ores & trees), producing bit-identical region files for a given seed
+ * regardless of thread count
+ */
+class world_generator : private region_visitor {
+public:
+
+	/*
+	 * Water surface height
+	 */
+	static const int SEA_LEVEL = 62;
+
+	/*
+	 * Generation options
+	 */
+	class options {
+	public:
+
+		/*
+		 * World seed
+		 */
+		unsigned int seed;
+
+		/*
+		 * Inclusive region coord rectangle to generate
+		 */
+		int min_x, min_z, max_x, max_z;
+
+		/*
+		 * Width (in chunks) of the sparsely filled world edge (0 fills every chunk)
+		 */
+		unsigned int edge;
+
+		/*
+		 * Deflate level
+		 */
+		int level;
+
+		/*
+		 * Worker thread count (0 uses the hardware concurrency)
+		 */
+		unsigned int threads;
+
+		/*
+		 * Options constructor
+		 */
+		options(void) : seed(0), min_x(0), min_z(0), max_x(0), max_z(0), edge(8), level(compression::DEF_LEVEL), threads(0) { return; }
+
+		/*
+		 * Generate a square of regions centered on region 0, 0
+		 * (an even width extends one further in the negative direction)
+		 */
+		void set_size(unsigned int width) {
+			min_x = min_z = -(int) (width / 2);
+			max_x = max_z = min_x + (int) width - 1;
+		}
+
+		/*
+		 * Generate an inclusive region coord rectangle
+		 */
+		void set_bounds(int min_x, int min_z, int max_x, int max_z) {
+			this->min_x = min_x;
+			this->min_z = min_z;
+			this->max_x = max_x;
+			this->max_z = max_z;
+		}
+	};
+
+	/*
+	 * Generation report
+	 */
+	class report {
+	public:
+
+		/*
+		 * Regions & chunks written
+		 */
+		unsigned int regions, chunks;
+
+		/*
+		 * Total file size written
+		 */
+		unsigned long long size;
+
+		/*
+		 * Regions that failed to generate
+		 */
+		std::vector<std::string> errors;
+
+		/*
+		 * Report constructor
+		 */
+		report(void) : regions(0), chunks(0), size(0) { return; }
+
+		/*
+		 * Returns a string representation of a report
+		 */
+		std::string to_string(void) const;
+	};
+
+private:
+
+	/*
+	 * Block ids used by the generator
+	 */
+	enum BLOCK { AIR = 0, STONE = 1, GRASS = 2, DIRT = 3, BEDROCK = 7, WATER = 9, LAVA = 11, SAND = 12, GRAVEL = 13,
+			IRON_ORE = 15, COAL_ORE = 16, LOG = 17, LEAVES = 18, TALL_GRASS = 31, FLOWER = 37, ROSE = 38, SNOW = 78,
+			ICE = 79 };
+
+	/*
+	 * Biome ids used by the generator
+	 */
+	enum BIOME { OCEAN = 0, PLAINS = 1, DESERT = 2, EXTREME_HILLS = 3, FOREST = 4, TAIGA = 5, SWAMPLAND = 6, RIVER = 7,
+			ICE_PLAINS = 12, BEACH = 16 };
+
+	/*
+	 * Noise channels (mixed into the seed so each feature is independent)
+	 */
+	enum CHANNEL { TERRAIN, MOUNTAIN, TEMPERATURE, RAINFALL, RIVER_PATH, CAVE_A, CAVE_B, ORE, PLANT, TREE, EDGE };
+
+	/*
+	 * Generation options
+	 */
+	const options &opt;
+
+	/*
+	 * Regions to generate (by region x, z coord & path) & merged report
+	 */
+	std::vector<std::pair<int, int>> keys;
+	std::vector<std::string> paths;
+	report result;
+	std::mutex lock;
+
+	/*
+	 * Region directory
+	 */
+	std::string dir;
+
+	/*
+	 * World generator constructor
+	 */
+	world_generator(const std::string &dir, const options &opt) : opt(opt), dir(dir) { return; }
+
+	/*
+	 * Returns true if a cave passes through a given world block coord
+	 */
+	static bool is_cave(unsigned int seed, int x, int y, int z);
+
+	/*
+	 * Returns a column's surface height & biome at a given world block x, z coord
+	 */
+	static int get_column(unsigned int seed, int x, int z, unsigned char &biome);
+
+	/*
+	 * Returns a pseudo-random value for a given seed, channel & coord
+	 */
+	static unsigned int hash(unsigned int seed, unsigned int channel, int x, int y, int z);
+
+	/*
+	 * Returns 2D value noise (0-65535) over a lattice of 2^shift blocks
+	 */
+	static unsigned int noise(unsigned int seed, unsigned int channel, int x, int z, unsigned int shift);
+
+	/*
+	 * Returns 3D value noise (0-65535) over a lattice of 2^shift (2^shift_y vertically) blocks
+	 */
+	static unsigned int noise(unsigned int seed, unsigned int channel, int x, int y, int z, unsigned int shift, unsigned int shift_y);
+
+	/*
+	 * Returns fractal 2D value noise (0-65535) summed over octaves
+	 */
+	static unsigned int fractal(unsigned int seed, unsigned int channel, int x, int z, unsigned int shift, unsigned int octaves);
+
+	/*
+	 * Place a tree with its trunk at a given chunk block coord
+	 */
+	static void place_tree(std::vector<char> &blocks, std::vector<char> &data, unsigned int x, int y, unsigned int z,
+			unsigned int kind, unsigned int leaf_bits);
+
+	/*
+	 * Generate a region & merge its report (called concurrently from worker threads)
+	 */
+	void visit(size_t index);
+
+	/*
+	 * Returns true if a chunk at a given chunk x, z coord is generated (chunks
+	 * near the world edge are kept with a falling probability)
+	 */
+	static bool keep(const options &opt, int x, int z);
+
+	/*
+	 * Set a nibble within a nibble array
+	 */
+	static void set_nibble(std::vector<char> &data, unsigned int index, unsigned int value) {
+		char &byte = data.at(index >> 1);
+		byte = (index & 1) ? (char) ((byte & 0x0f) | (value << 4)) : (char) ((byte & 0xf0) | (value & 0x0f));
+	}
+
+	/*
+	 * Smoothstep interpolation between two values by a fraction (0-255)
+	 */
+	static int lerp(int a, int b, unsigned int frac) {
+		frac = (frac * frac * (3 * 256 - 2 * frac)) / (256 * 256);
+		return a + ((b - a) * (int) frac) / 256;
+	}
+
+public:
+
+	/*
+	 * Generate every region within an options rectangle in parallel
+	 */
+	static report generate(const std::string &dir, const options &opt);
+
+	/*
+	 * Fill an empty (skeleton) chunk tag with generated content at a given
+	 * chunk x, z coord
+	 */
+	static void generate_chunk(chunk_tag &tag, int x, int z, unsigned int seed);
+
+	/*
+	 * Generate a single region file at a given region x, z coord, returning its report
+	 */
+	static report generate_region(const std::string &dir, int x, int z, const options &opt);
+};
+
+#endif
@@ -0,0 +1,136 @@
+/*
+ * bounded_queue.hpp
+ * Copyright (C) 2012 David Jolly
+ * ----------------------
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BOUNDED_QUEUE_HPP_
+#define BOUNDED_QUEUE_HPP_
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+/*
+ * Fixed-capacity blocking queue connecting pipeline stages (producers block
+ * while full, consumers block while empty, and the queue closes once every
+ * producer has closed its end)
+ */
+template<class T>
+class bounded_queue {
+private:
+
+	/*
+	 * Queued items
+	 */
+	std::deque<T> items;
+
+	/*
+	 * Maximum queued item count & open producer count
+	 */
+	size_t capacity;
+	unsigned int producers;
+
+	/*
+	 * Queue lock & not-empty/not-full conditions
+	 */
+	std::mutex lock;
+	std::condition_variable not_empty, not_full;
+
+	/*
+	 * Bounded queue constructor (non-copyable)
+	 */
+	bounded_queue(const bounded_queue &other);
+
+	/*
+	 * Bounded queue assignment operator (non-copyable)
+	 */
+	bounded_queue &operator=(const bounded_queue &other);
+
+public:
+
+	/*
+	 * Bounded queue constructor
+	 */
+	bounded_queue(size_t capacity, unsigned int producers) : capacity(capacity ? capacity : 1), producers(producers) { return; }
+
+	/*
+	 * Bounded queue destructor
+	 */
+	virtual ~bounded_queue(void) { return; }
+
+	/*
+	 * Close a producer's end (consumers drain remaining items once every
+	 * producer has closed)
+	 */
+	void close(void) {
+		std::lock_guard<std::mutex> guard(lock);
+
+		if(producers
+				&& !--producers)
+			not_empty.notify_all();
+	}
+
+	/*
+	 * Returns a bounded queue's closed status
+	 */
+	bool is_closed(void) {
+		std::lock_guard<std::mutex> guard(lock);
+
+		return !producers;
+	}
+
+	/*
+	 * Remove the oldest item, blocking while empty (returns false once the
+	 * queue is closed & drained)
+	 */
+	bool pop(T &item) {
+		std::unique_lock<std::mutex> guard(lock);
+
+		while(items.empty()
+				&& producers)
+			not_empty.wait(guard);
+		if(items.empty())
+			return false;
+		item = items.front();
+		items.pop_front();
+		not_full.notify_one();
+		return true;
+	}
+
+	/*
+	 * Add an item, blocking while full
+	 */
+	void push(const T &item) {
+		std::unique_lock<std::mutex> guard(lock);
+
+		while(items.size() >= capacity)
+			not_full.wait(guard);
+		items.push_back(item);
+		not_empty.notify_one();
+	}
+
+	/*
+	 * Returns a bounded queue's queued item count
+	 */
+	size_t size(void) {
+		std::lock_guard<std::mutex> guard(lock);
+
+		return items.size();
+	}
+};
+
+#endif
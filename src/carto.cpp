@@ -17,20 +17,32 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
 #include <boost/filesystem.hpp>
+#include <cstring>
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
+#include <fstream>
 #include <iostream>
+#include <sstream>
 #include <stdexcept>
+#include <thread>
 #include "block_color.hpp"
-#include "biome_color.hpp"
+#include "tag/byte_array_tag.hpp"
 #include "carto.hpp"
+#include "decode_context.hpp"
+#include "heightmap.hpp"
 #include "region_dim.hpp"
 #include "region_file.hpp"
+#include "region_header.hpp"
+#include "terrain_color.hpp"
 
 /*
  * Cartocraft info
  */
 const std::string carto::COPYRIGHT("Copyright (C) 2012 David Jolly");
-const std::string carto::USE("carto [-v | -h] [-p REGION_FILE_DIR] [-r RENDER_HEIGHT] [-o OUTPUT_PATH]");
+const std::string carto::USE("carto [-v | -h] [-p REGION_FILE_DIR] [-r RENDER_HEIGHT] [-o OUTPUT_PATH] [-j THREAD_COUNT] [-q OCCLUSION_QUALITY] [-s SPILL_DIR] [-c COMPRESSION_LEVEL] [-f PNG_FILTER] [-i PALETTE_MODE] [-t TILE_IMAGE] [-z TILE_DIR]");
 const std::string carto::VER_NUM("Cartocraft 0.2.0");
 const std::string carto::WARRANTY("This is free software. There is NO warranty.");
 
@@ -38,6 +50,7 @@ const std::string carto::WARRANTY("This is free software. There is NO warranty."
  * Cartocraft render constants
  */
 const int carto::SAMPLE_RADII[SAMPLE_RADII_COUNT] = { 1, 1, 1, 1, 1, 2, 4, 8, 16 };
+const unsigned int carto::SAMPLE_HALO = *std::max_element(carto::SAMPLE_RADII, carto::SAMPLE_RADII + carto::SAMPLE_RADII_COUNT);
 
 /*
  * Cartocraft defaults
@@ -47,7 +60,7 @@ const std::string carto::DEF_FILE_DIR("."), carto::DEF_OUT_PATH("out.png");
 /*
  * Cartocraft flags
  */
-const std::string carto::FLAG[carto::FLAG_COUNT] = { "-p", "-r", "-o", "-h", "-v" };
+const std::string carto::FLAG[carto::FLAG_COUNT] = { "-p", "-r", "-o", "-j", "-q", "-s", "-c", "-f", "-i", "-t", "-z", "-h", "-v" };
 
 /*
  * Cartocraft constructor
@@ -55,72 +68,172 @@ const std::string carto::FLAG[carto::FLAG_COUNT] = { "-p", "-r", "-o", "-h", "-v
 carto::carto(void) {
 	offset_x = 0;
 	offset_z = 0;
-	region_count = 0;
-	region_filled = NULL;
-	heightmap = NULL;
+	canvas = NULL;
+	palette = NO_PALETTE;
+	writer = NULL;
+	write_failed = false;
+	tile_writer = NULL;
+	pyramid = NULL;
+	tiled = false;
+	occlude = false;
+	occlusion = INTEGRAL_OCCLUSION;
+	avx2 = false;
+#if defined(__SSE2__) && defined(__GNUC__)
+	__builtin_cpu_init();
+	avx2 = __builtin_cpu_supports("avx2");
+#endif
+	threads = 0;
+	next = 0;
+	bands_written = 0;
+
+	// a single reader keeps disk access sequential
+	for(unsigned int i = 0; i < STAGE_COUNT; ++i) {
+		stage_threads[i] = 0;
+		queues[i] = NULL;
+	}
+	stage_threads[READ_STAGE] = 1;
 }
 
 /*
  * Cartocraft destructor
  */
 carto::~carto(void) {
-	delete[] region_filled;
-	delete[] heightmap;
+	delete writer;
+	delete tile_writer;
+	delete pyramid;
+	delete canvas;
 }
 
 /*
- * Blend a foreground color with a given pixel at x, z coord
+ * Scale a color at a given pixel
  */
-bool carto::apply_alpha_blend(unsigned int px_x, unsigned int px_z, unsigned int fore) {
-	unsigned int back;
-	unsigned char c_back, c_fore, alpha = (unsigned char) fore;
-	unsigned n_back[image_buffer::CHANNELS - 1];
-	back = terrain.at(px_x, px_z);
+void carto::apply_scale(unsigned char *px, float amount) {
+	if(!amount)
+		return;
 
-	// iterate through all color channels
-	for(unsigned int i = 0; i < image_buffer::CHANNELS - 1; ++i) {
-		c_back = (unsigned char) (back >> (24 - (i * 8)));
-		c_fore = (unsigned char) (fore >> (24 - (i * 8)));
-		n_back[i] = c_fore * ((float) alpha / 0xff) + c_back * ((float) (0xff - alpha) / 0xff);
-	}
+	// iterate through all color channels (do not apply scaling to alpha channel)
+	for(unsigned int i = 0; i < image_buffer::CHANNELS; ++i)
+		if(i != image_buffer::ALPHA)
+			px[i] *= amount;
+}
 
-	// apply alpha-blended color
-	return terrain.set(px_x, px_z, ((n_back[0] << 24) | (n_back[1] << 16) | (n_back[2] << 8) | 0xff));
+/*
+ * Write a region's visible block columns to its canvas tile
+ */
+void carto::colorize_region(region_job &job) {
+	size_t tile;
+	unsigned char *row;
+	unsigned short *heights;
+	const column *cols;
+
+	// find the region's tile & set filled region to true
+	tile = canvas->find_tile((long long) job.x + offset_x, (long long) job.z + offset_z);
+	if(tile == tile_canvas::NO_TILE)
+		throw std::runtime_error("Region outside the canvas");
+	canvas->acquire_tile(tile);
+	region_filled.at(tile) = true;
+
+	// process each row of filled columns, copying each column's block & biome
+	// color from the terrain color table & its height (used by SSOA later)
+	for(unsigned int z = 0; z < job.columns.size() / BLOCK_WIDTH_PER_REGION; ++z) {
+		row = canvas->get_color_row(tile, z);
+		heights = canvas->get_height_row(tile, z);
+		cols = &job.columns[z * BLOCK_WIDTH_PER_REGION];
+		for(unsigned int x = 0; x < BLOCK_WIDTH_PER_REGION; ++x) {
+			if(!cols[x].filled)
+				continue;
+			heights[x] = cols[x].height;
+			memcpy(row + x * image_buffer::CHANNELS, terrain_color::COLOR[terrain_color::index(cols[x].id, cols[x].biome, cols[x].below_ground)],
+					image_buffer::CHANNELS);
+		}
+	}
 }
 
 /*
- * Scale a color at a given pixel at x, z coord
+ * Encode a tile image to a png band-by-band (by palette mode)
  */
-bool carto::apply_scale(unsigned int px_x, unsigned int px_z, float amount) {
-	unsigned int col;
-	unsigned char n_col[image_buffer::CHANNELS];
-	if(!amount)
-		return true;
-	col = terrain.at(px_x, px_z);
+int carto::encode_tile_image(const std::string &in_path, const std::string &out_path) {
+	color_palette colors;
+	png_writer::options opt = png_opt;
+	std::vector<unsigned char> band;
+	tile_image::reader *reader = NULL;
+	unsigned long long width, height, rows, tile_width, last;
+
+	// open the tile image
+	try {
+		reader = new tile_image::reader(in_path);
+	} catch(std::exception &exc) {
+		std::cerr << "Exception: " << exc.what() << std::endl;
+		return READ_FAILED;
+	}
+	width = reader->get_width();
+	height = reader->get_height();
+	tile_width = reader->get_tile_width();
+	std::cout << "Encoding tile image: size: (" << width << ", " << height << ")..." << std::endl;
 
-	// iterate through all color channels
-	for(unsigned int i = 0; i < image_buffer::CHANNELS; ++i) {
-		n_col[i] = (unsigned char) (col >> (24 - (i * 8)));
+	try {
+		band.resize(width * tile_width * image_buffer::CHANNELS);
+
+		// stream each band to a tile pyramid (each pyramid tile holds data
+		// where it overlaps a tile image tile)
+		if(tiled) {
+			tile_pyramid target(out_path, width, height, reader->get_fill(), png_opt);
+			std::vector<char> present(target.get_columns(), false);
+
+			for(unsigned long long z = 0; z * tile_width < height; ++z) {
+				rows = std::min(tile_width, height - z * tile_width);
+				reader->read_band(z, band.data());
+				for(unsigned long long x = 0; x < present.size(); ++x) {
+					last = (std::min((x + 1) * tile_pyramid::TILE_WIDTH, width) - 1) / tile_width;
+					present.at(x) = false;
+					for(unsigned long long i = x * tile_pyramid::TILE_WIDTH / tile_width; !present.at(x) && i <= last; ++i)
+						present.at(x) = (reader->find_tile(i, z) != tile_image::NO_TILE);
+				}
+				target.write_rows(band.data(), rows, present);
+			}
+			target.close();
+			delete reader;
+			return SUCCESS;
+		}
 
-		// do not apply scaling to alpha channel
-		if(i != image_buffer::ALPHA)
-			n_col[i] *= amount;
-	}
+		// collect & index every color of the image (a palette needs every color
+		// before the first row, so each band is decoded twice)
+		if(palette != NO_PALETTE) {
+			for(unsigned long long z = 0; z * tile_width < height; ++z) {
+				reader->read_band(z, band.data());
+				colors.add(band.data(), width * std::min(tile_width, height - z * tile_width));
+			}
+			index_colors(colors, opt);
+		}
 
-	// apply the new color
-	return terrain.set(px_x, px_z, ((n_col[0] << 24) | (n_col[1] << 16) | (n_col[2] << 8) | n_col[3]));
+		// stream each band to the png
+		png_writer writer(out_path, width, height, opt, &colors);
+		for(unsigned long long z = 0; z * tile_width < height; ++z) {
+			rows = std::min(tile_width, height - z * tile_width);
+			reader->read_band(z, band.data());
+			writer.write_rows(band.data(), rows);
+		}
+		writer.close();
+	} catch(std::exception &exc) {
+		std::cerr << "Exception: " << exc.what() << std::endl;
+		delete reader;
+		return WRITE_FAILED;
+	}
+	delete reader;
+	return SUCCESS;
 }
 
 /*
  * Returns true if a region in the image buffer is filled
  */
-bool carto::is_filled(unsigned int x, unsigned int z) {
-	unsigned int pos = z * (terrain.get_width() / BLOCK_WIDTH_PER_REGION) + x;
+bool carto::is_filled(unsigned long long x, unsigned long long z) {
+	size_t tile;
 
 	// check if position is valid
-	if(pos >= region_count)
+	if(!canvas
+			|| (tile = canvas->find_tile(x, z)) == tile_canvas::NO_TILE)
 		return false;
-	return region_filled[pos];
+	return region_filled.at(tile);
 }
 
 /*
@@ -133,6 +246,22 @@ int carto::is_flag(const std::string &arg) {
 		return RENDER_HEIGHT;
 	if(arg == FLAG[OUTPUT_PATH])
 		return OUTPUT_PATH;
+	if(arg == FLAG[THREAD_COUNT])
+		return THREAD_COUNT;
+	if(arg == FLAG[OCCLUSION_QUALITY])
+		return OCCLUSION_QUALITY;
+	if(arg == FLAG[SPILL_DIR])
+		return SPILL_DIR;
+	if(arg == FLAG[COMPRESSION_LEVEL])
+		return COMPRESSION_LEVEL;
+	if(arg == FLAG[PNG_FILTER])
+		return PNG_FILTER;
+	if(arg == FLAG[PALETTE_MODE])
+		return PALETTE_MODE;
+	if(arg == FLAG[TILE_IMAGE])
+		return TILE_IMAGE;
+	if(arg == FLAG[TILE_PYRAMID])
+		return TILE_PYRAMID;
 	if(arg == FLAG[DISP_USAGE])
 		return DISP_USAGE;
 	if(arg == FLAG[DISP_VERSION])
@@ -141,13 +270,19 @@ int carto::is_flag(const std::string &arg) {
 }
 
 /*
- * Render a series of regions and output image at specified path
+ * Render a series of regions, streaming the image to a png at a specified
+ * path band-by-band (each band's tiles are released once written, so an
+ * empty path keeps the whole canvas)
  */
-int carto::render_map(const std::string &reg_dir, unsigned int ren_height, bool ren_occlusion) {
+int carto::render_map(const std::string &reg_dir, unsigned int ren_height, bool ren_occlusion, const std::string &out_path) {
+	int res = SUCCESS;
 	std::string file;
 	std::vector<std::string> reg_files;
 	std::vector<std::string>::iterator reg_file;
-	int x, z, x_min = 0, z_min = 0, x_max = 0, z_max = 0, res;
+	std::vector<std::pair<unsigned long long, std::string>> sizes;
+	std::vector<std::vector<std::string>> bands;
+	size_t tile;
+	int x, z, x_min = 0, z_min = 0, x_max = 0, z_max = 0, ring;
 
 	// check if region directory exists
 	if(!boost::filesystem::exists(reg_dir)) {
@@ -158,7 +293,7 @@ int carto::render_map(const std::string &reg_dir, unsigned int ren_height, bool
 	// iterate through all files in region directory
 	boost::filesystem::directory_iterator end, iter(reg_dir);
 	for(; iter != end; ++iter) {
-		file = iter->path().native_file_string();
+		file = iter->path().string();
 
 		// skip directories
 		if(boost::filesystem::is_directory(*iter))
@@ -184,165 +319,648 @@ int carto::render_map(const std::string &reg_dir, unsigned int ren_height, bool
 	if(reg_files.empty())
 		return FILES_NOT_FOUND;
 
-	// calculate image size, allocate pixel buffer & filled buffer
-	terrain = image_buffer(BLOCK_WIDTH_PER_REGION * (abs(x_min) + x_max) + BLOCK_WIDTH_PER_REGION,
-				BLOCK_WIDTH_PER_REGION * (abs(z_min) + z_max) + BLOCK_WIDTH_PER_REGION);
-	terrain.fill(block_color::FILL);
-	std::cout << "Rendering map: size: (" << terrain.get_width() << ", " << terrain.get_height() << ")..." << std::endl;
-
-	// set offset and regions filled
+	// calculate image size & allocate a canvas tile for each region
 	offset_x = abs(x_min);
 	offset_z = abs(z_min);
-	region_count = (terrain.get_width() / BLOCK_WIDTH_PER_REGION) * (terrain.get_height() / BLOCK_WIDTH_PER_REGION);
-	region_filled = new bool[region_count];
-	heightmap = new unsigned int[terrain.get_width() * terrain.get_height()];
-	if(!region_filled
-			|| !heightmap)
+	delete canvas;
+	canvas = new tile_canvas(BLOCK_WIDTH_PER_REGION * ((long long) x_max - x_min + 1), BLOCK_WIDTH_PER_REGION * ((long long) z_max - z_min + 1),
+			block_color::FILL);
+	std::cout << "Rendering map: size: (" << canvas->get_width() << ", " << canvas->get_height() << ")..." << std::endl;
+	try {
+		for(reg_file = reg_files.begin(); reg_file != reg_files.end(); ++reg_file) {
+			region_file::is_region_file(*reg_file, x, z);
+			canvas->add_tile((long long) x + offset_x, (long long) z + offset_z);
+		}
+		canvas->allocate(spill_dir);
+	} catch(std::exception &exc) {
+		std::cerr << "Exception: " << exc.what() << std::endl;
 		return ALLOC_FAILED;
-	memset(region_filled, false, region_count);
-	memset(heightmap, 0, terrain.get_width() * terrain.get_height());
+	}
+	region_filled.assign(canvas->get_tile_count(), false);
+
+	// open the streaming writer (a palette needs every color before the first
+	// row, so palette output is written from the whole canvas once rendered,
+	// while tile images & tile pyramids are always written as RGBA)
+	if(!out_path.empty()) {
+		try {
+			if(tiled)
+				pyramid = new tile_pyramid(out_path, canvas->get_width(), canvas->get_height(), block_color::FILL, png_opt);
+			else if(tile_image::is_tile_image(out_path))
+				tile_writer = new tile_image::writer(out_path, canvas->get_width(), canvas->get_height(), block_color::FILL,
+						tile_image::QOI_ENCODING, BLOCK_WIDTH_PER_REGION);
+			else if(palette == NO_PALETTE)
+				writer = new png_writer(out_path, canvas->get_width(), canvas->get_height(), png_opt);
+		} catch(std::exception &exc) {
+			std::cerr << "Exception: " << exc.what() << std::endl;
+			return WRITE_FAILED;
+		}
+	}
+	write_failed = false;
+
+	// count the tiles within each band & the regions within each region's
+	// occlusion halo
+	band_pending.assign(canvas->get_height() / BLOCK_WIDTH_PER_REGION, 0);
+	for(size_t i = 0; i < canvas->get_tile_count(); ++i)
+		++band_pending.at(canvas->get_tile_z(i));
+	region_pending.assign(canvas->get_tile_count(), 0);
+	ring = (SAMPLE_HALO + BLOCK_WIDTH_PER_REGION - 1) / BLOCK_WIDTH_PER_REGION;
+	for(reg_file = reg_files.begin(); reg_file != reg_files.end(); ++reg_file) {
+		region_file::is_region_file(*reg_file, x, z);
+		for(long long i = (long long) z + offset_z - ring; i <= (long long) z + offset_z + ring; ++i)
+			for(long long j = (long long) x + offset_x - ring; j <= (long long) x + offset_x + ring; ++j)
+				if(i >= 0
+						&& j >= 0
+						&& (tile = canvas->find_tile(j, i)) != tile_canvas::NO_TILE)
+					++region_pending.at(tile);
+	}
 
-	// render image (by region)
+	// render image & occlusion (by region), starting with the largest regions
+	// so the longest tasks do not trail at the end (band-by-band when streaming,
+	// so each band finishes as early as possible)
 	for(reg_file = reg_files.begin(); reg_file != reg_files.end(); ++reg_file)
-		if((res = render_region(*reg_file, ren_height)) != SUCCESS)
-			return res;
-
-	// render occlusion & illumination (by region)
-	if(ren_occlusion)
-		for(int z = 0; z < (abs(z_min) + z_max) + 1; ++z)
-			for(int x = 0; x < (abs(x_min) + x_max) + 1; ++x)
-				if(is_filled(x, z))
-					render_region_occlusion(x * BLOCK_WIDTH_PER_REGION, z * BLOCK_WIDTH_PER_REGION);
-	return SUCCESS;
+		sizes.push_back(std::make_pair(region_size(*reg_file), *reg_file));
+	std::stable_sort(sizes.begin(), sizes.end(), is_larger);
+	render_tasks.clear();
+	if(is_streaming()) {
+		bands.resize(band_pending.size());
+		for(unsigned int i = 0; i < sizes.size(); ++i) {
+			region_file::is_region_file(sizes.at(i).second, x, z);
+			bands.at((long long) z + offset_z).push_back(sizes.at(i).second);
+		}
+		for(unsigned int i = 0; i < bands.size(); ++i)
+			render_tasks.insert(render_tasks.end(), bands.at(i).begin(), bands.at(i).end());
+	} else
+		for(unsigned int i = 0; i < sizes.size(); ++i)
+			render_tasks.push_back(sizes.at(i).second);
+	occlude = ren_occlusion;
+	run_pipeline(ren_height);
+
+	// close the streaming writer, or write the canvas
+	if(is_streaming()) {
+		if(write_failed)
+			res = WRITE_FAILED;
+		delete writer;
+		writer = NULL;
+		delete tile_writer;
+		tile_writer = NULL;
+		delete pyramid;
+		pyramid = NULL;
+	} else if(!out_path.empty()) {
+		try {
+			write(out_path);
+		} catch(std::exception &exc) {
+			std::cerr << "Exception: " << exc.what() << std::endl;
+			res = WRITE_FAILED;
+		}
+	}
+	return res;
+}
+
+/*
+ * Returns a region file's compressed size, as reported by its header
+ */
+unsigned long long carto::region_size(const std::string &reg_file) {
+	unsigned long long size = 0;
+	region_header header;
+	std::ifstream file(reg_file.c_str(), std::ios::in | std::ios::binary);
+
+	// sum the sectors of every filled chunk (unreadable headers count as empty)
+	if(!file.is_open()
+			|| !header.read_data(file))
+		return 0;
+	for(unsigned int i = 0; i < region_dim::CHUNK_COUNT; ++i)
+		if(!header.get_info_at(i).empty())
+			size += header.get_info_at(i).get_sector_count();
+	return size * region_dim::SECTOR_SIZE;
 }
 
 /*
- * Render a region file
+ * Walk a chunk's columns down to their visible blocks (CLIPPED clamps each
+ * column to the render height)
  */
-int carto::render_region(const std::string &reg_file, unsigned int ren_height) {
+template<bool CLIPPED>
+void carto::walk_chunk(column *cols, const std::vector<char> &biomes, const std::vector<int> &blocks, const std::vector<int> &heights,
+		unsigned int ren_height) {
 	bool below_ground;
-	region_file_reader reader;
-	std::vector<char> biomes;
-	std::vector<int> blocks, heights;
-	unsigned int block_height, block_id, blend_color, pos;
-	int reg_x, reg_z, ch_x, ch_z, b_x, b_z;
+	unsigned int block_height, block_id, pos;
+
+	// process each chunk block-by-block
+	for(unsigned int block_z = 0; block_z < region_dim::BLOCK_WIDTH; ++block_z)
+		for(unsigned int block_x = 0; block_x < region_dim::BLOCK_WIDTH; ++block_x) {
+			block_height = heights.at(block_z * region_dim::BLOCK_WIDTH + block_x);
+			below_ground = false;
+			if(CLIPPED
+					&& (unsigned int) block_height > ren_height) {
+				block_height = ren_height;
+				below_ground = true;
+			}
+			pos = (block_height * region_dim::BLOCK_WIDTH + block_z) * region_dim::BLOCK_WIDTH + block_x;
+			if(pos >= blocks.size()) {
+				while(pos >= blocks.size())
+					pos -= region_dim::BLOCK_HEIGHT;
+				block_id = blocks.at(pos);
+			} else {
+				block_id = blocks.at(pos);
+
+				// find the first block that is not an air block
+				while(!block_id) {
+					pos -= region_dim::BLOCK_HEIGHT;
+					block_id = blocks.at(pos);
+				}
 
-	// open region file and collect data
-	try {
-		reader = region_file_reader(reg_file);
-		reader.read();
-		std::cout << "Processing region: " << reader.get_region().get_header().to_string() << "..." << std::endl;
+				// decrease block height until reaching a non-transparent material
+				while(block_color::is_transparent(blocks.at(pos))) {
+					pos -= region_dim::BLOCK_HEIGHT;
+					--block_height;
+				}
+			}
 
-		// calculate region offsets
-		reg_x = ((abs(reader.get_x_coord() + offset_x)) * BLOCK_WIDTH_PER_REGION);
-		reg_z = ((abs(reader.get_z_coord() + offset_z)) * BLOCK_WIDTH_PER_REGION);
+			// skip unknown block ids
+			if(block_id > block_color::MAX_BLOCK) {
+				out_lock.lock();
+				std::cerr << "Warning: Unknown block id (" << block_id << "). Skipping." << std::endl;
+				out_lock.unlock();
+				continue;
+			}
 
-		// set filled region to true
-		if(!is_filled(reg_x / BLOCK_WIDTH_PER_REGION, reg_z / BLOCK_WIDTH_PER_REGION))
-			region_filled[((reg_z / BLOCK_WIDTH_PER_REGION) * (terrain.get_width() / BLOCK_WIDTH_PER_REGION) + (reg_x / BLOCK_WIDTH_PER_REGION))] = true;
+			// record the visible block
+			column &col = cols[block_z * BLOCK_WIDTH_PER_REGION + block_x];
+			col.id = block_id;
+			col.height = block_height;
+			col.biome = biomes.at(block_z * region_dim::BLOCK_WIDTH + block_x);
+			col.below_ground = below_ground;
+			col.filled = true;
+		}
+}
 
-		// render region chunk-by-chunk
+/*
+ * Walk each column of a region's inflated chunks down to its visible block
+ */
+void carto::extract_region(region_job &job, unsigned int ren_height) {
+	chunk_tag tag;
+	std::vector<char> biomes;
+	std::vector<int> blocks, heights;
+	std::vector<generic_tag *> sub_tags;
+	column_kernel walk = (ren_height < region_dim::BLOCK_HEIGHT) ? &carto::walk_chunk<true> : &carto::walk_chunk<false>;
+
+	// columns start unfilled (missing chunks & skipped blocks stay unfilled)
+	job.columns.assign(BLOCK_WIDTH_PER_REGION * BLOCK_WIDTH_PER_REGION, column());
+	try {
 		for(unsigned int chunk_z = 0; chunk_z < region_dim::CHUNK_WIDTH; ++chunk_z)
 			for(unsigned int chunk_x = 0; chunk_x < region_dim::CHUNK_WIDTH; ++chunk_x) {
+				std::vector<char> &data = job.chunks.at(chunk_z * region_dim::CHUNK_WIDTH + chunk_x);
 
 				// check if chunk exists
-				if(!reader.is_filled(chunk_x, chunk_z))
+				if(data.empty())
 					continue;
 
-				// collect chunk biome, block & heightmap data
-				biomes = reader.get_biomes_at(chunk_x, chunk_z);
-				blocks = reader.get_blocks_at(chunk_x, chunk_z);
-				heights = reader.get_heightmap_at(chunk_x, chunk_z);
+				// parse chunk (a malformed chunk drops the whole region)
+				tag.clean_root();
+				tag = chunk_tag();
+				try {
+					region_file_reader::parse_chunk_tag(data, tag);
+				} catch(std::exception &exc) {
+					job.columns.clear();
+					throw;
+				}
+				std::vector<char>().swap(data);
+
+				// collect chunk biome & block data, recomputing the heightmap
+				// from the block data (stored heightmaps may be stale or missing)
+				biomes.clear();
+				sub_tags = tag.get_sub_tag_by_name("Biomes");
+				if(!sub_tags.empty())
+					biomes = static_cast<byte_array_tag *>(sub_tags.at(0))->get_value();
+				blocks.clear();
+				sub_tags = tag.get_sub_tag_by_name("Blocks");
+				for(unsigned int i = 0; i < sub_tags.size(); ++i) {
+					std::vector<char> &sect_blocks = static_cast<byte_array_tag *>(sub_tags.at(i))->get_value();
+					blocks.insert(blocks.end(), sect_blocks.begin(), sect_blocks.end());
+				}
+				heightmap::compute(tag, heights);
 
 				// skip over empty chunks
 				if(biomes.empty()
 						|| blocks.empty()
 						|| heights.empty()) {
+					out_lock.lock();
 					std::cerr << "Warning: Chunk missing data at (" << chunk_x << ", " << chunk_z << "). Skipping." << std::endl;
+					out_lock.unlock();
 					continue;
 				}
 
-				// calculate chunk offsets
-				ch_x = reg_x + (chunk_x * region_dim::BLOCK_WIDTH);
-				ch_z = reg_z + (chunk_z * region_dim::BLOCK_WIDTH);
-
-				// process each chunk block-by-block
-				for(unsigned int block_z = 0; block_z < region_dim::BLOCK_WIDTH; ++block_z)
-					for(unsigned int block_x = 0; block_x < region_dim::BLOCK_WIDTH; ++block_x) {
-						block_height = heights.at(block_z * region_dim::BLOCK_WIDTH + block_x);
-						if((unsigned int) block_height > ren_height) {
-							block_height = ren_height;
-							below_ground = true;
-						} else
-							below_ground = false;
-						pos = (block_height * region_dim::BLOCK_WIDTH + block_z) * region_dim::BLOCK_WIDTH + block_x;
-						if(pos >= blocks.size()) {
-							while(pos >= blocks.size())
-								pos -= region_dim::BLOCK_HEIGHT;
-							block_id = blocks.at(pos);
-						} else {
-							block_id = blocks.at(pos);
-
-							// find the first block that is not an air block
-							while(!block_id) {
-								pos -= region_dim::BLOCK_HEIGHT;
-								block_id = blocks.at(pos);
-							}
-
-							// decrease block height until reaching a non-transparent material
-							while(block_color::is_transparent(blocks.at(pos))) {
-								pos -= region_dim::BLOCK_HEIGHT;
-								--block_height;
-							}
-						}
-
-						// skip unknown block ids
-						if(block_id > block_color::MAX_BLOCK) {
-							std::cerr << "Warning: Unknown block id (" << block_id << "). Skipping." << std::endl;
-							continue;
-						}
-
-						// calculate block offsets
-						b_x = ch_x + block_x;
-						b_z = ch_z + block_z;
+				// walk the chunk's columns
+				(this->*walk)(&job.columns[chunk_z * region_dim::BLOCK_WIDTH * BLOCK_WIDTH_PER_REGION + chunk_x * region_dim::BLOCK_WIDTH],
+						biomes, blocks, heights, ren_height);
+			}
 
-						// add height to global heightmap (used by SSOA later)
-						heightmap[(b_z * terrain.get_width()) + b_x] = block_height;
+	// a malformed column stops the region, keeping the columns walked so far
+	} catch(std::exception &exc) {
+		if(job.columns.empty())
+			throw;
+		out_lock.lock();
+		std::cerr << "Exception: " << exc.what() << std::endl;
+		out_lock.unlock();
+	}
+	tag.clean_root();
+	tag = chunk_tag();
+	job.chunks.clear();
+}
 
-						// use block_id to set terrain buffer color at an x, z coord
-						terrain.set(b_x, b_z, block_color::COLOR[block_id]);
+/*
+ * Finish a tile within a band, waking the band writer once the band is
+ * finished (called with the region pending lock held)
+ */
+void carto::finish_band_tile(unsigned long long band) {
+	if(is_streaming()
+			&& !--band_pending.at(band))
+		band_ready.notify_all();
+}
 
-						// scale colors based off biome type
-						blend_color = biome_color::BLEND_COLOR[(int) biomes.at((block_z * region_dim::BLOCK_WIDTH) + block_x)];
-						if(blend_color
-								&& !below_ground)
-							apply_alpha_blend(b_x, b_z, blend_color);
-					}
+/*
+ * Release a finished region, queueing occlusion for each region whose
+ * halo is now complete
+ */
+void carto::finish_region(const region_job &job) {
+	size_t tile;
+	std::vector<std::pair<long long, long long>> ready;
+	long long ring = (SAMPLE_HALO + BLOCK_WIDTH_PER_REGION - 1) / BLOCK_WIDTH_PER_REGION, reg_x, reg_z;
+
+	// calculate region tile coords
+	reg_x = (long long) job.x + offset_x;
+	reg_z = (long long) job.z + offset_z;
+
+	// release this region from every halo it falls within (a tile left
+	// unoccluded is finished as soon as its halo is)
+	lock.lock();
+	for(long long z = reg_z - ring; z <= reg_z + ring; ++z)
+		for(long long x = reg_x - ring; x <= reg_x + ring; ++x)
+			if(z >= 0
+					&& x >= 0
+					&& (tile = canvas->find_tile(x, z)) != tile_canvas::NO_TILE
+					&& !--region_pending.at(tile)) {
+				if(occlude
+						&& region_filled.at(tile))
+					ready.push_back(std::make_pair(x, z));
+				else
+					finish_band_tile(z);
 			}
+	lock.unlock();
 
-	// catch all reader exceptions
-	} catch(std::exception &exc) {
-		std::cerr << "Exception: " << exc.what() << std::endl;
-		return REGION_FILE_DIR;
+	// queue occlusion outside the lock (pushing may block)
+	for(unsigned int i = 0; i < ready.size(); ++i)
+		queues[OCCLUSION_STAGE]->push(new region_job(std::string(), ready.at(i).first - offset_x, ready.at(i).second - offset_z));
+}
+
+/*
+ * Returns a maps raw pixel buffer, (channel order: RGBA)
+ */
+void carto::get_pixel_buffer(std::vector<unsigned char> &buffer) {
+
+	// assemble the canvas row-by-row
+	buffer.clear();
+	if(!canvas)
+		return;
+	buffer.resize(canvas->get_width() * canvas->get_height() * image_buffer::CHANNELS);
+	for(unsigned long long z = 0; z < canvas->get_height(); ++z)
+		canvas->read_colors(0, z, canvas->get_width(), &buffer[z * canvas->get_width() * image_buffer::CHANNELS]);
+}
+
+/*
+ * Index a histogram's colors by palette mode, or fall back to true color
+ * (dropping alpha when every color is opaque)
+ */
+void carto::index_colors(color_palette &colors, png_writer::options &opt) {
+
+	// index the colors (quantizing them if allowed), or fall back to true color
+	if(colors.build(color_palette::MAX_COLORS, palette == QUANTIZED_PALETTE))
+		opt.color = png_writer::INDEXED_COLOR;
+	else if(colors.is_opaque())
+		opt.color = png_writer::RGB_COLOR;
+	std::cout << "Palette: " << colors.get_count() << " colors, " << (colors.get_colors().empty() ? "true color" : "indexed") << std::endl;
+}
+
+/*
+ * Inflate each chunk of a region's file data
+ */
+void carto::inflate_region(region_job &job) {
+	unsigned int length, offset;
+	region_header header;
+	decode_context context;
+	const unsigned char *prefix;
+
+	// read header entries from the file data
+	std::stringstream stream(std::string(job.file.begin(), job.file.end()));
+	if(!header.read_data(stream))
+		throw std::runtime_error("Failed to read header data");
+
+	// inflate each chunk's payload (its length counts the type byte)
+	job.chunks.resize(region_dim::CHUNK_COUNT);
+	for(unsigned int i = 0; i < region_dim::CHUNK_COUNT; ++i) {
+		chunk_info &info = header.get_info_at(i);
+		if(info.empty())
+			continue;
+		offset = info.get_sector() * region_dim::SECTOR_SIZE;
+		if(offset + sizeof(int) + sizeof(char) > job.file.size())
+			throw std::runtime_error("Failed to read chunk data");
+		prefix = reinterpret_cast<const unsigned char *>(&job.file[offset]);
+		length = (prefix[0] << 24) | (prefix[1] << 16) | (prefix[2] << 8) | prefix[3];
+		if(length)
+			--length;
+		if(prefix[sizeof(int)] != chunk_info::ZLIB
+				&& prefix[sizeof(int)] != chunk_info::GZIP)
+			throw std::runtime_error("Unknown compression type");
+		if(!context.inflate_(&job.file[offset + sizeof(int) + sizeof(char)],
+				std::min((size_t) length, job.file.size() - offset - sizeof(int) - sizeof(char))))
+			throw std::runtime_error("Failed to inflate chunk data");
+		job.chunks.at(i).swap(context.get_data());
 	}
-	return SUCCESS;
+	std::vector<char>().swap(job.file);
+}
+
+/*
+ * Read a region file's data in one call
+ */
+void carto::read_region(region_job &job) {
+	size_t count = 0;
+	std::ifstream file(job.path.c_str(), std::ios::in | std::ios::binary);
+
+	// attempt to open file & parse the filename for coordinants
+	if(!file.is_open())
+		throw std::runtime_error("Failed to open input file");
+	if(!region_file::is_region_file(job.path, job.x, job.z))
+		throw std::runtime_error("Malformated region filename");
+
+	// read file data
+	file.seekg(0, std::ios::end);
+	job.file.resize((size_t) file.tellg());
+	file.seekg(0, std::ios::beg);
+	file.read(job.file.data(), job.file.size());
+	if(file.gcount() != (std::streamsize) job.file.size()
+			|| job.file.size() < region_dim::HEADER_OFFSET)
+		throw std::runtime_error("Failed to read header data");
+	for(unsigned int i = 0; i < region_dim::CHUNK_COUNT; ++i)
+		if(job.file[i * sizeof(int)]
+				|| job.file[i * sizeof(int) + 1]
+				|| job.file[i * sizeof(int) + 2]
+				|| job.file[i * sizeof(int) + 3])
+			++count;
+	out_lock.lock();
+	std::cout << "Processing region: Count: " << count << "/" << region_dim::CHUNK_COUNT << "..." << std::endl;
+	out_lock.unlock();
+}
+
+/*
+ * Calculate a row's occlusion scales at a radius from the summed-area table
+ * rows bounding its boxes (BORDER clamps each box to the table)
+ */
+template<bool BORDER>
+void carto::occlusion_row(const unsigned int *heights, const unsigned int *top, const unsigned int *bottom, int first, int radius,
+		int width, int rows, float *amount) {
+	int xa, xb;
+	unsigned int height, samples = (2 * radius + 1) * rows - 1;
+	float average, value;
+
+	// average the box around each block (skipping itself & blocks of height zero)
+	for(unsigned int x = 0; x < BLOCK_WIDTH_PER_REGION; ++x) {
+		height = heights[x];
+		xa = first + (int) x - radius;
+		xb = first + (int) x + radius + 1;
+		if(BORDER) {
+			xa = std::max(xa, 0);
+			xb = std::min(xb, width - 1);
+			samples = (xb - xa) * rows - 1;
+			if(!samples)
+				samples = 1;
+		}
+		average = (float) (bottom[xb] - bottom[xa] - top[xb] + top[xa] - height) / samples;
+		value = height - average;
+		value = (!height || value >= 0) ? 0 : fabs(((region_dim::BLOCK_HEIGHT - 1) + 4 * value) / (float) (region_dim::BLOCK_HEIGHT - 1));
+
+		// a zero scale leaves the block unchanged
+		amount[x] = value ? value : 1;
+	}
+}
+
+#ifdef __SSE2__
+/*
+ * Calculate an interior row's occlusion scales, four blocks at a time
+ */
+void carto::occlusion_row_sse2(const unsigned int *heights, const unsigned int *top, const unsigned int *bottom, int first, int radius,
+		int /* width */, int rows, float *amount) {
+	__m128i height, sum;
+	__m128 keep, value;
+	const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1), four = _mm_set1_ps(4),
+			max = _mm_set1_ps(region_dim::BLOCK_HEIGHT - 1), sign = _mm_set1_ps(-0.0f),
+			samples = _mm_set1_ps((float) (unsigned int) ((2 * radius + 1) * rows - 1));
+	const unsigned int *top_a = top + first - radius, *top_b = top + first + radius + 1,
+			*bottom_a = bottom + first - radius, *bottom_b = bottom + first + radius + 1;
+
+	for(unsigned int x = 0; x < BLOCK_WIDTH_PER_REGION; x += 4) {
+		height = _mm_loadu_si128(reinterpret_cast<const __m128i *>(heights + x));
+		sum = _mm_sub_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(bottom_b + x)),
+				_mm_loadu_si128(reinterpret_cast<const __m128i *>(bottom_a + x)));
+		sum = _mm_sub_epi32(sum, _mm_loadu_si128(reinterpret_cast<const __m128i *>(top_b + x)));
+		sum = _mm_add_epi32(sum, _mm_loadu_si128(reinterpret_cast<const __m128i *>(top_a + x)));
+		sum = _mm_sub_epi32(sum, height);
+
+		// average & scale (blocks of height zero or above the average keep a scale of one)
+		value = _mm_sub_ps(_mm_cvtepi32_ps(height), _mm_div_ps(_mm_cvtepi32_ps(sum), samples));
+		keep = _mm_andnot_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(height, _mm_setzero_si128())), _mm_cmplt_ps(value, zero));
+		value = _mm_andnot_ps(sign, _mm_div_ps(_mm_add_ps(max, _mm_mul_ps(four, value)), max));
+		keep = _mm_and_ps(keep, _mm_cmpneq_ps(value, zero));
+		_mm_storeu_ps(amount + x, _mm_or_ps(_mm_and_ps(keep, value), _mm_andnot_ps(keep, one)));
+	}
+}
+
+#ifdef __GNUC__
+/*
+ * Calculate an interior row's occlusion scales, eight blocks at a time
+ */
+__attribute__((target("avx2")))
+void carto::occlusion_row_avx2(const unsigned int *heights, const unsigned int *top, const unsigned int *bottom, int first, int radius,
+		int /* width */, int rows, float *amount) {
+	__m256i height, sum;
+	__m256 keep, value;
+	const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1), four = _mm256_set1_ps(4),
+			max = _mm256_set1_ps(region_dim::BLOCK_HEIGHT - 1), sign = _mm256_set1_ps(-0.0f),
+			samples = _mm256_set1_ps((float) (unsigned int) ((2 * radius + 1) * rows - 1));
+	const unsigned int *top_a = top + first - radius, *top_b = top + first + radius + 1,
+			*bottom_a = bottom + first - radius, *bottom_b = bottom + first + radius + 1;
+
+	for(unsigned int x = 0; x < BLOCK_WIDTH_PER_REGION; x += 8) {
+		height = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(heights + x));
+		sum = _mm256_sub_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(bottom_b + x)),
+				_mm256_loadu_si256(reinterpret_cast<const __m256i *>(bottom_a + x)));
+		sum = _mm256_sub_epi32(sum, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(top_b + x)));
+		sum = _mm256_add_epi32(sum, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(top_a + x)));
+		sum = _mm256_sub_epi32(sum, height);
+
+		// average & scale (blocks of height zero or above the average keep a scale of one)
+		value = _mm256_sub_ps(_mm256_cvtepi32_ps(height), _mm256_div_ps(_mm256_cvtepi32_ps(sum), samples));
+		keep = _mm256_andnot_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(height, _mm256_setzero_si256())), _mm256_cmp_ps(value, zero, _CMP_LT_OQ));
+		value = _mm256_andnot_ps(sign, _mm256_div_ps(_mm256_add_ps(max, _mm256_mul_ps(four, value)), max));
+		keep = _mm256_and_ps(keep, _mm256_cmp_ps(value, zero, _CMP_NEQ_UQ));
+		_mm256_storeu_ps(amount + x, _mm256_blendv_ps(one, value, keep));
+	}
+}
+#endif
+#endif
+
+/*
+ * Release the canvas tiles of a band
+ */
+void carto::release_band(unsigned long long band) {
+	size_t tile;
+
+	for(unsigned long long x = 0; x < canvas->get_width() / BLOCK_WIDTH_PER_REGION; ++x)
+		if((tile = canvas->find_tile(x, band)) != tile_canvas::NO_TILE)
+			canvas->release_tile(tile);
+}
+
+/*
+ * Read the heights of a region & its halo (bounded by the canvas), from the
+ * region's tile & its neighbors
+ */
+void carto::read_halo(unsigned long long off_x, unsigned long long off_z, std::vector<unsigned int> &halo, unsigned long long &x0,
+		unsigned long long &z0, unsigned long long &x1, unsigned long long &z1) {
+
+	// bound the region & its halo by the canvas (samples outside the canvas are skipped)
+	x0 = (off_x > SAMPLE_HALO) ? off_x - SAMPLE_HALO : 0;
+	z0 = (off_z > SAMPLE_HALO) ? off_z - SAMPLE_HALO : 0;
+	x1 = std::min(off_x + BLOCK_WIDTH_PER_REGION + SAMPLE_HALO, canvas->get_width());
+	z1 = std::min(off_z + BLOCK_WIDTH_PER_REGION + SAMPLE_HALO, canvas->get_height());
+
+	// read each row of heights (missing neighbors read as zero)
+	halo.resize((x1 - x0) * (z1 - z0));
+	for(unsigned long long z = z0; z < z1; ++z)
+		canvas->read_heights(x0, z, x1 - x0, &halo[(z - z0) * (x1 - x0)]);
 }
 
 /*
  * Render screen-space ambient occlusion (SSAO) at a given region
  */
-void carto::render_region_occlusion(unsigned int off_x, unsigned int off_z) {
-	int br_x, br_z;
-	unsigned int samples;
-	float average, value = 0;
+void carto::render_region_occlusion(unsigned long long off_x, unsigned long long off_z) {
+	out_lock.lock();
 	std::cout << "Rendering occlusion: (" << off_x << ", " << off_z << ")..." << std::endl;
+	out_lock.unlock();
+
+	// render occlusion at the selected quality
+	switch(occlusion) {
+		case INTEGRAL_OCCLUSION:
+			render_region_occlusion_integral(off_x, off_z);
+			break;
+		case SAMPLED_OCCLUSION:
+			render_region_occlusion_sampled(off_x, off_z);
+			break;
+	}
+}
+
+/*
+ * Render screen-space ambient occlusion (SSAO) at a given region, using
+ * summed-area tables over the region & its halo
+ */
+void carto::render_region_occlusion_integral(unsigned long long off_x, unsigned long long off_z) {
+	size_t tile;
+	int first, radius = 0, za, zb;
+	unsigned long long x0, z0, x1, z1;
+	unsigned int halo_width, sum, width;
+	occlusion_kernel kernel = &occlusion_row<true>;
+	std::vector<unsigned int> halo, table;
+	std::vector<float> amount(BLOCK_WIDTH_PER_REGION);
+
+	// read the region's heights & halo
+	tile = canvas->find_tile(off_x / BLOCK_WIDTH_PER_REGION, off_z / BLOCK_WIDTH_PER_REGION);
+	if(tile == tile_canvas::NO_TILE)
+		return;
+	read_halo(off_x, off_z, halo, x0, z0, x1, z1);
+	halo_width = x1 - x0;
+	first = off_x - x0;
+
+	// pick the row kernel once per region (only regions whose halo crosses the
+	// canvas edge need boxes clamped)
+	if(first == (int) SAMPLE_HALO
+			&& halo_width == BLOCK_WIDTH_PER_REGION + 2 * SAMPLE_HALO) {
+		kernel = &occlusion_row<false>;
+#ifdef __SSE2__
+		kernel = &occlusion_row_sse2;
+#ifdef __GNUC__
+		if(avx2)
+			kernel = &occlusion_row_avx2;
+#endif
+#endif
+	}
+
+	// build a summed-area table of heights, with a leading row & column of zeros
+	// (sums stay exact, so averages match the sampled implementation)
+	width = halo_width + 1;
+	table.assign(width * (z1 - z0 + 1), 0);
+	for(unsigned int z = 0; z < z1 - z0; ++z) {
+		const unsigned int *row = &halo[z * halo_width];
+		unsigned int *above = &table[z * width], *below = &table[(z + 1) * width];
+
+		sum = 0;
+		for(unsigned int x = 0; x < halo_width; ++x) {
+			sum += row[x];
+			below[x + 1] = above[x + 1] + sum;
+		}
+	}
+
+	// iterate through each row, applying each radius' occlusion in turn
+	for(unsigned int z = 0; z < BLOCK_WIDTH_PER_REGION; ++z) {
+		const unsigned int *row = &halo[(off_z + z - z0) * halo_width + first];
+		unsigned char *pixels = canvas->get_color_row(tile, z);
+
+		for(unsigned int r = 0; r < SAMPLE_RADII_COUNT; ++r) {
+
+			// calculate occlusion values once per distinct radius
+			if(!r
+					|| SAMPLE_RADII[r] != radius) {
+				radius = SAMPLE_RADII[r];
+				za = std::max((long long) (off_z + z) - radius, (long long) z0) - z0;
+				zb = std::min(off_z + z + radius + 1, z1) - z0;
+				const unsigned int *top = &table[za * width], *bottom = &table[zb * width];
+
+				kernel(row, top, bottom, first, radius, width, zb - za, amount.data());
+			}
+
+			// apply occlusion values to the row (alpha is left unscaled)
+			for(unsigned int x = 0; x < BLOCK_WIDTH_PER_REGION; ++x) {
+				unsigned char *px = pixels + x * image_buffer::CHANNELS;
+				px[image_buffer::RED] = (int) (px[image_buffer::RED] * amount[x]);
+				px[image_buffer::GREEN] = (int) (px[image_buffer::GREEN] * amount[x]);
+				px[image_buffer::BLUE] = (int) (px[image_buffer::BLUE] * amount[x]);
+			}
+		}
+	}
+}
+
+/*
+ * Render screen-space ambient occlusion (SSAO) at a given region, sampling
+ * each block's neighbors (reference implementation)
+ */
+void carto::render_region_occlusion_sampled(unsigned long long off_x, unsigned long long off_z) {
+	size_t tile;
+	long long br_x, br_z;
+	unsigned int halo_width, samples, height;
+	unsigned long long x0, z0, x1, z1;
+	float average, value = 0;
+	std::vector<unsigned int> halo;
+
+	// read the region's heights & halo
+	tile = canvas->find_tile(off_x / BLOCK_WIDTH_PER_REGION, off_z / BLOCK_WIDTH_PER_REGION);
+	if(tile == tile_canvas::NO_TILE)
+		return;
+	read_halo(off_x, off_z, halo, x0, z0, x1, z1);
+	halo_width = x1 - x0;
 
 	// iterate through each block and calculate occlusion value
 	for(unsigned int z = 0; z < BLOCK_WIDTH_PER_REGION; ++z)
 		for(unsigned int x = 0; x < BLOCK_WIDTH_PER_REGION; ++x) {
+			height = halo[(off_z + z - z0) * halo_width + (off_x + x - x0)];
 
 			// skip all blocks of height zero
-			if(!heightmap[((off_z + z) * terrain.get_width()) + (off_x + x)])
+			if(!height)
 				continue;
 
 			// iterate through the various sampling radii
@@ -350,17 +968,17 @@ void carto::render_region_occlusion(unsigned int off_x, unsigned int off_z) {
 				average = 0;
 				samples = 0;
 
-				// iterate through surrounding block heights
+				// iterate through surrounding block heights (the halo covers every
+				// sample within the canvas)
 				for(int i = -SAMPLE_RADII[r]; i <= SAMPLE_RADII[r]; ++i)
 					for(int j = -SAMPLE_RADII[r]; j <= SAMPLE_RADII[r]; ++j) {
 						br_x = off_x + x + i;
 						br_z = off_z + z + j;
 						if((!i && !j)
-								|| br_x < 0 || (unsigned int) br_x >= terrain.get_width()
-								|| br_z < 0 || (unsigned int) br_z >= terrain.get_height()
-								|| (heightmap[(br_z * terrain.get_width()) + br_x] - heightmap[((off_z + z) * terrain.get_width()) + (off_x + x)] < 0))
+								|| br_x < (long long) x0 || br_x >= (long long) x1
+								|| br_z < (long long) z0 || br_z >= (long long) z1)
 							continue;
-						average += heightmap[(br_z * terrain.get_width()) + br_x];
+						average += halo[(br_z - z0) * halo_width + (br_x - x0)];
 						samples++;
 					}
 
@@ -368,22 +986,330 @@ void carto::render_region_occlusion(unsigned int off_x, unsigned int off_z) {
 				if(!samples)
 					samples = 1;
 				average /= samples;
-				value = heightmap[((off_z + z) * terrain.get_width()) + (off_x + x)] - average;
+				value = height - average;
 				if(value >= 0)
 					continue;
 
 				// apply occlusion value to block
 				value = fabs(((region_dim::BLOCK_HEIGHT - 1) + 4 * value) / (float) (region_dim::BLOCK_HEIGHT - 1));
-				apply_scale(off_x + x, off_z + z, value);
+				apply_scale(canvas->get_color_row(tile, z) + x * image_buffer::CHANNELS, value);
+			}
+		}
+}
+
+/*
+ * Run the pipeline stages over every region file, each stage on its own
+ * worker threads (the calling thread included)
+ */
+void carto::run_pipeline(unsigned int ren_height) {
+	unsigned int count[STAGE_COUNT];
+	std::vector<std::thread> workers;
+
+	// each queue holds one region per consumer, bounding the regions in flight
+	for(unsigned int stage = READ_STAGE; stage < STAGE_COUNT; ++stage) {
+		count[stage] = stage_thread_count(stage);
+		if(count[stage] > render_tasks.size())
+			count[stage] = render_tasks.size();
+		if(!count[stage])
+			count[stage] = 1;
+		if(stage != READ_STAGE)
+			queues[stage] = new bounded_queue<region_job *>(count[stage], count[stage - 1]);
+	}
+
+	// start every stage's workers (& the band writer when streaming), running
+	// an occlusion worker on the calling thread
+	next = 0;
+	bands_written = 0;
+	for(unsigned int stage = READ_STAGE; stage < STAGE_COUNT; ++stage)
+		for(unsigned int i = (stage == OCCLUSION_STAGE) ? 1 : 0; i < count[stage]; ++i)
+			workers.push_back(std::thread(&carto::run, this, stage, ren_height));
+	if(is_streaming())
+		workers.push_back(std::thread(&carto::write_bands, this));
+	run(OCCLUSION_STAGE, ren_height);
+	for(unsigned int i = 0; i < workers.size(); ++i)
+		workers.at(i).join();
+
+	// free queues
+	for(unsigned int stage = READ_STAGE; stage < STAGE_COUNT; ++stage) {
+		delete queues[stage];
+		queues[stage] = NULL;
+	}
+}
+
+/*
+ * Worker thread entry point
+ */
+void carto::run(unsigned int stage, unsigned int ren_height) {
+	int x, z;
+	region_job *job = NULL;
+	unsigned long long reach = (SAMPLE_HALO + BLOCK_WIDTH_PER_REGION - 1) / BLOCK_WIDTH_PER_REGION + STREAM_LOOKAHEAD;
+
+	for(;;) {
+
+		// claim the next region file (when streaming, once the band writer is
+		// within reach of its band, so only a few bands of tiles are resident)
+		if(stage == READ_STAGE) {
+			std::unique_lock<std::mutex> guard(lock);
+			while(is_streaming()
+					&& next < render_tasks.size()
+					&& region_file::is_region_file(render_tasks.at(next), x, z)
+					&& (unsigned long long) ((long long) z + offset_z) > bands_written + reach)
+				band_written.wait(guard);
+			if(next >= render_tasks.size())
+				break;
+			job = new region_job(render_tasks.at(next++), 0, 0);
+			guard.unlock();
+			region_file::is_region_file(job->path, x, z);
+			job->x = x;
+			job->z = z;
+
+		// or the next region from the previous stage
+		} else if(!queues[stage]->pop(job))
+			break;
+
+		// run the stage over the region (a failed region is passed on empty)
+		try {
+			if(!job->failed)
+				switch(stage) {
+					case READ_STAGE:
+						read_region(*job);
+						break;
+					case INFLATE_STAGE:
+						inflate_region(*job);
+						break;
+					case EXTRACT_STAGE:
+						extract_region(*job, ren_height);
+						break;
+					case COLORIZE_STAGE:
+						colorize_region(*job);
+						break;
+					case OCCLUSION_STAGE:
+						render_region_occlusion(((long long) job->x + offset_x) * BLOCK_WIDTH_PER_REGION,
+								((long long) job->z + offset_z) * BLOCK_WIDTH_PER_REGION);
+						break;
+				}
+		} catch(std::exception &exc) {
+			out_lock.lock();
+			std::cerr << "Exception: " << exc.what() << std::endl;
+			out_lock.unlock();
+			job->failed = true;
+			std::vector<char>().swap(job->file);
+			job->chunks.clear();
+			job->columns.clear();
+		}
+
+		// pass the region on to the next stage
+		if(stage == COLORIZE_STAGE)
+			finish_region(*job);
+		else if(stage == OCCLUSION_STAGE) {
+			lock.lock();
+			finish_band_tile((long long) job->z + offset_z);
+			lock.unlock();
+		}
+		if(stage >= COLORIZE_STAGE)
+			delete job;
+		else
+			queues[stage + 1]->push(job);
+	}
+
+	// close this worker's end of the next stage's queue
+	if(stage < OCCLUSION_STAGE)
+		queues[stage + 1]->close();
+}
+
+/*
+ * Sets a maps png compression level (0-9)
+ */
+void carto::set_compression(int level) {
+
+	// check for valid level
+	if(level < 0
+			|| level > 9)
+		throw std::out_of_range("compression level out-of-range");
+	png_opt.level = level;
+}
+
+/*
+ * Sets a maps png filter strategy
+ */
+void carto::set_filter(unsigned int filter) {
+
+	// check for valid strategy
+	if(filter >= png_writer::FILTER_COUNT)
+		throw std::out_of_range("filter strategy out-of-range");
+	png_opt.filter = filter;
+}
+
+/*
+ * Sets a maps png palette mode
+ */
+void carto::set_palette(unsigned int palette) {
+
+	// check for valid mode
+	if(palette >= PALETTE_COUNT)
+		throw std::out_of_range("palette mode out-of-range");
+	this->palette = palette;
+}
+
+/*
+ * Sets a maps occlusion quality
+ */
+void carto::set_occlusion(unsigned int occlusion) {
+
+	// check for valid quality
+	if(occlusion >= OCCLUSION_COUNT)
+		throw std::out_of_range("occlusion quality out-of-range");
+	this->occlusion = occlusion;
+}
+
+/*
+ * Sets a stage's worker thread count (0 uses the worker thread count)
+ */
+void carto::set_stage_threads(unsigned int stage, unsigned int threads) {
+
+	// check for valid stage
+	if(stage >= STAGE_COUNT)
+		throw std::out_of_range("stage out-of-range");
+	stage_threads[stage] = threads;
+}
+
+/*
+ * Returns a stage's worker thread count
+ */
+unsigned int carto::stage_thread_count(unsigned int stage) {
+	unsigned int count = stage_threads[stage];
+
+	// fall back to the worker thread count, then the hardware concurrency
+	if(!count)
+		count = threads;
+	if(!count)
+		count = std::thread::hardware_concurrency();
+	if(!count)
+		count = 1;
+	return count;
+}
+
+/*
+ * Write rendered regions to file as a png (after rendering into the canvas),
+ * indexed by palette mode & dropping alpha when every color is opaque
+ */
+void carto::write(const std::string &path) {
+	color_palette colors;
+	png_writer::options opt = png_opt;
+	std::vector<unsigned char> row;
+
+	if(!canvas)
+		return;
+
+	// tile pyramids & tile images hold the canvas' tiles as they are
+	if(tiled) {
+		tile_pyramid target(path, canvas->get_width(), canvas->get_height(), block_color::FILL, png_opt);
+
+		for(unsigned long long band = 0; band < canvas->get_height() / BLOCK_WIDTH_PER_REGION; ++band)
+			write_pyramid_band(target, band, row);
+		target.close();
+		return;
+	}
+	if(tile_image::is_tile_image(path)) {
+		canvas->write_tile_image(path);
+		return;
+	}
+
+	// collect & index every color of the canvas
+	if(palette != NO_PALETTE) {
+		row.resize(canvas->get_width() * image_buffer::CHANNELS);
+		for(unsigned long long z = 0; z < canvas->get_height(); ++z) {
+			canvas->read_colors(0, z, canvas->get_width(), row.data());
+			colors.add(row.data(), canvas->get_width());
+		}
+		index_colors(colors, opt);
+	}
+	canvas->write(path, opt, &colors);
+}
+
+/*
+ * Band writer thread entry point (writes each band once finished, in
+ * order, releasing the band above it & letting the read stage move on)
+ */
+void carto::write_bands(void) {
+	size_t tile;
+	std::vector<unsigned char> row(writer ? canvas->get_width() * image_buffer::CHANNELS : 0), rows;
+
+	for(unsigned long long band = 0; band < band_pending.size(); ++band) {
+
+		// wait for every tile within the band to finish
+		std::unique_lock<std::mutex> guard(lock);
+		while(band_pending.at(band))
+			band_ready.wait(guard);
+		guard.unlock();
+
+		// write the band's tiles or rows (a failed writer keeps releasing bands)
+		try {
+			if(tile_writer) {
+				for(unsigned long long x = 0; !write_failed && x < canvas->get_width() / BLOCK_WIDTH_PER_REGION; ++x)
+					if((tile = canvas->find_tile(x, band)) != tile_canvas::NO_TILE)
+						canvas->write_tile(*tile_writer, tile);
+				if(!write_failed
+						&& band + 1 == band_pending.size())
+					tile_writer->close();
+			} else if(pyramid) {
+				if(!write_failed)
+					write_pyramid_band(*pyramid, band, rows);
+				if(!write_failed
+						&& band + 1 == band_pending.size())
+					pyramid->close();
+			} else {
+				for(unsigned long long z = band * BLOCK_WIDTH_PER_REGION; !write_failed && z < (band + 1) * BLOCK_WIDTH_PER_REGION; ++z) {
+					canvas->read_colors(0, z, canvas->get_width(), row.data());
+					writer->write_rows(row.data(), 1);
+				}
+				if(!write_failed
+						&& !writer->get_remaining())
+					writer->close();
 			}
+		} catch(std::exception &exc) {
+			out_lock.lock();
+			std::cerr << "Exception: " << exc.what() << std::endl;
+			out_lock.unlock();
+			write_failed = true;
 		}
+
+		// the band's occlusion no longer reads the band above it
+		if(band)
+			release_band(band - 1);
+
+		// let the read stage claim regions further down
+		lock.lock();
+		bands_written = band + 1;
+		lock.unlock();
+		band_written.notify_all();
+	}
+	if(!band_pending.empty())
+		release_band(band_pending.size() - 1);
+}
+
+/*
+ * Write a band's rows to a tile pyramid (with the tile columns holding
+ * regions)
+ */
+void carto::write_pyramid_band(tile_pyramid &target, unsigned long long band, std::vector<unsigned char> &rows) {
+	std::vector<char> present(target.get_columns(), false);
+
+	// each region tile spans whole pyramid tiles
+	rows.resize(canvas->get_width() * BLOCK_WIDTH_PER_REGION * image_buffer::CHANNELS);
+	for(unsigned long long z = 0; z < BLOCK_WIDTH_PER_REGION; ++z)
+		canvas->read_colors(0, band * BLOCK_WIDTH_PER_REGION + z, canvas->get_width(),
+				&rows[z * canvas->get_width() * image_buffer::CHANNELS]);
+	for(size_t x = 0; x < present.size(); ++x)
+		present.at(x) = (canvas->find_tile(x * tile_pyramid::TILE_WIDTH / BLOCK_WIDTH_PER_REGION, band) != tile_canvas::NO_TILE);
+	target.write_rows(rows.data(), BLOCK_WIDTH_PER_REGION, present);
 }
 
 int main(int argc, char *argv[]) {
 	int flag, res;
 	unsigned int height = carto::DEF_HEIGHT;
-	std::string reg_dir = carto::DEF_FILE_DIR, out = carto::DEF_OUT_PATH;
-	carto::carto map;
+	std::string reg_dir = carto::DEF_FILE_DIR, out = carto::DEF_OUT_PATH, tile_path, tile_dir;
+	carto map;
 
 	// parse user input
 	for(int i = 1; i < argc; ++i) {
@@ -433,6 +1359,74 @@ int main(int argc, char *argv[]) {
 				case carto::OUTPUT_PATH:
 					out = argv[++i];
 					break;
+
+				// collect worker thread count (0 uses the hardware concurrency)
+				case carto::THREAD_COUNT:
+					if(atoi(argv[++i]) < 0) {
+						std::cerr << "Exception: Thread count must be non-negative" << std::endl;
+						return carto::MALFORMED_FLAG;
+					}
+					map.set_threads(atoi(argv[i]));
+					break;
+
+				// collect occlusion quality
+				case carto::OCCLUSION_QUALITY:
+					if(atoi(argv[++i]) < 0
+							|| atoi(argv[i]) >= (int) carto::OCCLUSION_COUNT) {
+						std::cerr << "Exception: Occlusion quality must be 0 (none), 1 (integral) or 2 (sampled)" << std::endl;
+						return carto::MALFORMED_FLAG;
+					}
+					map.set_occlusion(atoi(argv[i]));
+					break;
+
+				// collect canvas spill directory
+				case carto::SPILL_DIR:
+					if(!boost::filesystem::is_directory(argv[++i])) {
+						std::cerr << "Exception: Directory does not exist: " << argv[i] << std::endl;
+						return carto::NOT_A_DIRECTORY;
+					}
+					map.set_spill_dir(argv[i]);
+					break;
+
+				// collect png compression level
+				case carto::COMPRESSION_LEVEL:
+					if(atoi(argv[++i]) < 0
+							|| atoi(argv[i]) > 9) {
+						std::cerr << "Exception: Compression level must be 0 (fastest) to 9 (smallest)" << std::endl;
+						return carto::MALFORMED_FLAG;
+					}
+					map.set_compression(atoi(argv[i]));
+					break;
+
+				// collect png filter strategy
+				case carto::PNG_FILTER:
+					if(atoi(argv[++i]) < 0
+							|| atoi(argv[i]) >= (int) png_writer::FILTER_COUNT) {
+						std::cerr << "Exception: Png filter must be 0 (none), 1 (sub), 2 (up), 3 (average), 4 (paeth) or 5 (adaptive)" << std::endl;
+						return carto::MALFORMED_FLAG;
+					}
+					map.set_filter(atoi(argv[i]));
+					break;
+
+				// collect tile pyramid directory (instead of the output path)
+				case carto::TILE_PYRAMID:
+					tile_dir = argv[++i];
+					break;
+
+				// collect tile image to encode (instead of rendering)
+				case carto::TILE_IMAGE:
+					tile_path = argv[++i];
+					break;
+
+				// collect png palette mode
+				case carto::PALETTE_MODE:
+					if(atoi(argv[++i]) < 0
+							|| atoi(argv[i]) >= (int) carto::PALETTE_COUNT) {
+						std::cerr << "Exception: Palette mode must be 0 (none), 1 (exact) or 2 (quantized)" << std::endl;
+						return carto::MALFORMED_FLAG;
+					}
+					map.set_palette(atoi(argv[i]));
+					break;
 				default:
 					std::cerr << "Exception: Unsupported flag: " << argv[i] << std::endl;
 					return carto::MALFORMED_FLAG;
@@ -444,13 +1438,21 @@ int main(int argc, char *argv[]) {
 		}
 	}
 
-	// pass in user inputs to render
-	if((res = map.render_map(reg_dir, height, true)))
-		return res;
+	// write a tile pyramid in place of the output file
+	if(!tile_dir.empty()) {
+		out = tile_dir;
+		map.set_tiled(true);
+	}
 
-	// write rendered map to file
+	// pass in user inputs to render, writing the rendered map to file as it
+	// finishes (or encode a tile image rendered earlier)
 	std::cout << "Writing to file: " << out << "..." << std::endl;
-	map.write(out);
+	if(!tile_path.empty())
+		res = map.encode_tile_image(tile_path, out);
+	else
+		res = map.render_map(reg_dir, height, map.get_occlusion() != carto::NO_OCCLUSION, out);
+	if(res)
+		return res;
 
 	std::cout << "DONE." << std::endl;
 
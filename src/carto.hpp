@@ -20,48 +20,353 @@
 #ifndef CARTO_HPP_
 #define CARTO_HPP_
 
+#include <condition_variable>
+#include <mutex>
 #include <string>
+#include <utility>
 #include <vector>
+#include "bounded_queue.hpp"
 #include "image_buffer.hpp"
+#include "png_writer.hpp"
 #include "region_file_reader.hpp"
+#include "tile_canvas.hpp"
+#include "tile_image.hpp"
+#include "tile_pyramid.hpp"
 
 class carto {
+public:
+
+	/*
+	 * Cartocraft render stages (each region flows through the pipeline stages
+	 * in order, with occlusion running once its neighbors are colorized)
+	 */
+	enum STAGE { READ_STAGE, INFLATE_STAGE, EXTRACT_STAGE, COLORIZE_STAGE, OCCLUSION_STAGE };
+	static const unsigned int STAGE_COUNT = 5;
+
 private:
 
 	/*
-	 * Image buffer (stored with byte-order: RGBA)
+	 * Visible block of a region column
+	 */
+	class column {
+	public:
+
+		/*
+		 * Block id & height
+		 */
+		unsigned short id, height;
+
+		/*
+		 * Biome id
+		 */
+		char biome;
+
+		/*
+		 * Column clamped by the render height & column filled
+		 */
+		bool below_ground, filled;
+
+		/*
+		 * Column constructor
+		 */
+		column(void) : id(0), height(0), biome(0), below_ground(false), filled(false) { return; }
+	};
+
+	/*
+	 * Region passed between pipeline stages (each stage consumes the data
+	 * produced by the previous one)
+	 */
+	class region_job {
+	public:
+
+		/*
+		 * Region file path & region x, z coord
+		 */
+		std::string path;
+		int x, z;
+
+		/*
+		 * Region file data
+		 */
+		std::vector<char> file;
+
+		/*
+		 * Inflated chunk data (empty for missing chunks)
+		 */
+		std::vector<std::vector<char>> chunks;
+
+		/*
+		 * Visible block columns
+		 */
+		std::vector<column> columns;
+
+		/*
+		 * Region failed an earlier stage (passed on empty so its neighbors'
+		 * occlusion is not held back)
+		 */
+		bool failed;
+
+		/*
+		 * Region job constructor
+		 */
+		region_job(const std::string &path, int x, int z) : path(path), x(x), z(z), failed(false) { return; }
+	};
+
+	/*
+	 * Sparse canvas of region tiles (colors stored with byte-order: RGBA)
+	 */
+	tile_canvas *canvas;
+
+	/*
+	 * Canvas spill directory (empty renders in memory)
+	 */
+	std::string spill_dir;
+
+	/*
+	 * Region tile coord offsets
+	 */
+	unsigned int offset_x, offset_z;
+
+	/*
+	 * Tile region filled & unfinished regions within each tile's occlusion halo
+	 */
+	std::vector<char> region_filled;
+	std::vector<unsigned int> region_pending;
+
+	/*
+	 * Streaming png writer (set while rendering straight to file), its
+	 * encoding options & write failed
+	 */
+	png_writer *writer;
+	png_writer::options png_opt;
+	bool write_failed;
+
+	/*
+	 * Streaming tile image writer (set while rendering straight to a tile image)
+	 */
+	tile_image::writer *tile_writer;
+
+	/*
+	 * Streaming tile pyramid writer (set while rendering straight to a tile
+	 * pyramid) & tile pyramid output
+	 */
+	tile_pyramid *pyramid;
+	bool tiled;
+
+	/*
+	 * Png palette mode
+	 */
+	unsigned int palette;
+
+	/*
+	 * Unfinished tiles within each band (row of region tiles), bands written &
+	 * band finished & written conditions (signaled under the region pending lock)
+	 */
+	std::vector<unsigned int> band_pending;
+	unsigned long long bands_written;
+	std::condition_variable band_ready, band_written;
+
+	/*
+	 * Render occlusion & occlusion quality
+	 */
+	bool occlude;
+	unsigned int occlusion;
+
+	/*
+	 * AVX2 supported by the CPU
+	 */
+	bool avx2;
+
+	/*
+	 * Worker thread count (0 uses the hardware concurrency)
+	 */
+	unsigned int threads;
+
+	/*
+	 * Per-stage worker thread counts (0 uses the worker thread count)
+	 */
+	unsigned int stage_threads[STAGE_COUNT];
+
+	/*
+	 * Queues feeding each pipeline stage (none feeds the read stage)
+	 */
+	bounded_queue<region_job *> *queues[STAGE_COUNT];
+
+	/*
+	 * Region files to render, next task to claim & region pending lock
+	 */
+	std::vector<std::string> render_tasks;
+	size_t next;
+	std::mutex lock;
+
+	/*
+	 * Console output lock
+	 */
+	std::mutex out_lock;
+
+	/*
+	 * Cartocraft constructor (non-copyable)
+	 */
+	carto(const carto &other);
+
+	/*
+	 * Cartocraft assignment operator (non-copyable)
+	 */
+	carto &operator=(const carto &other);
+
+	/*
+	 * Scale a color at a given pixel
+	 */
+	static void apply_scale(unsigned char *px, float amount);
+
+	/*
+	 * Chunk column walk & occlusion row kernels
+	 */
+	typedef void (carto::*column_kernel)(column *cols, const std::vector<char> &biomes, const std::vector<int> &blocks,
+			const std::vector<int> &heights, unsigned int ren_height);
+	typedef void (*occlusion_kernel)(const unsigned int *heights, const unsigned int *top, const unsigned int *bottom, int first,
+			int radius, int width, int rows, float *amount);
+
+	/*
+	 * Write a region's visible block columns to its canvas tile
+	 */
+	void colorize_region(region_job &job);
+
+	/*
+	 * Walk each column of a region's inflated chunks down to its visible block
+	 */
+	void extract_region(region_job &job, unsigned int ren_height);
+
+	/*
+	 * Finish a tile within a band, waking the band writer once the band is
+	 * finished (called with the region pending lock held)
+	 */
+	void finish_band_tile(unsigned long long band);
+
+	/*
+	 * Release a finished region, queueing occlusion for each region whose
+	 * halo is now complete
+	 */
+	void finish_region(const region_job &job);
+
+	/*
+	 * Index a histogram's colors by palette mode, or fall back to true color
+	 * (dropping alpha when every color is opaque)
+	 */
+	void index_colors(color_palette &colors, png_writer::options &opt);
+
+	/*
+	 * Inflate each chunk of a region's file data
+	 */
+	void inflate_region(region_job &job);
+
+	/*
+	 * Returns true if a sized region file is larger than another
+	 */
+	static bool is_larger(const std::pair<unsigned long long, std::string> &a, const std::pair<unsigned long long, std::string> &b) { return a.first > b.first; }
+
+	/*
+	 * Returns true if a streaming writer is set
+	 */
+	bool is_streaming(void) { return writer || tile_writer || pyramid; }
+
+	/*
+	 * Returns a region file's compressed size, as reported by its header
+	 */
+	static unsigned long long region_size(const std::string &reg_file);
+
+	/*
+	 * Read a region file's data in one call
 	 */
-	image_buffer terrain;
+	void read_region(region_job &job);
 
 	/*
-	 * Image buffer region filled
+	 * Calculate a row's occlusion scales at a radius from the summed-area table
+	 * rows bounding its boxes (BORDER clamps each box to the table)
 	 */
-	bool *region_filled;
+	template<bool BORDER>
+	static void occlusion_row(const unsigned int *heights, const unsigned int *top, const unsigned int *bottom, int first, int radius,
+			int width, int rows, float *amount);
 
+#ifdef __SSE2__
 	/*
-	 * Image buffer width, height, region count & heightmap
+	 * Calculate an interior row's occlusion scales, four blocks at a time
 	 */
-	unsigned int offset_x, offset_z, region_count, *heightmap;
+	static void occlusion_row_sse2(const unsigned int *heights, const unsigned int *top, const unsigned int *bottom, int first, int radius,
+			int width, int rows, float *amount);
 
 	/*
-	 * Blend a foreground color with a given pixel at x, z coord
+	 * Calculate an interior row's occlusion scales, eight blocks at a time
+	 * (used when the CPU supports AVX2)
 	 */
-	bool apply_alpha_blend(unsigned int px_x, unsigned int px_z, unsigned int fore);
+	static void occlusion_row_avx2(const unsigned int *heights, const unsigned int *top, const unsigned int *bottom, int first, int radius,
+			int width, int rows, float *amount);
+#endif
 
 	/*
-	 * Scale a color at a given pixel at x, z coord
+	 * Release the canvas tiles of a band
 	 */
-	bool apply_scale(unsigned int px_x, unsigned int px_z, float amount);
+	void release_band(unsigned long long band);
 
 	/*
-	 * Render a region file
+	 * Read the heights of a region & its halo (bounded by the canvas), from the
+	 * region's tile & its neighbors
 	 */
-	int render_region(const std::string &reg_file, unsigned int ren_height);
+	void read_halo(unsigned long long off_x, unsigned long long off_z, std::vector<unsigned int> &halo, unsigned long long &x0,
+			unsigned long long &z0, unsigned long long &x1, unsigned long long &z1);
 
 	/*
 	 * Render screen-space ambient occlusion (SSAO) at a given region
 	 */
-	void render_region_occlusion(unsigned int off_x, unsigned int off_z);
+	void render_region_occlusion(unsigned long long off_x, unsigned long long off_z);
+
+	/*
+	 * Render screen-space ambient occlusion (SSAO) at a given region, using
+	 * summed-area tables over the region & its halo
+	 */
+	void render_region_occlusion_integral(unsigned long long off_x, unsigned long long off_z);
+
+	/*
+	 * Render screen-space ambient occlusion (SSAO) at a given region, sampling
+	 * each block's neighbors (reference implementation)
+	 */
+	void render_region_occlusion_sampled(unsigned long long off_x, unsigned long long off_z);
+
+	/*
+	 * Run the pipeline stages over every region file, each stage on its own
+	 * worker threads (the calling thread included)
+	 */
+	void run_pipeline(unsigned int ren_height);
+
+	/*
+	 * Returns a stage's worker thread count
+	 */
+	unsigned int stage_thread_count(unsigned int stage);
+
+	/*
+	 * Walk a chunk's columns down to their visible blocks (CLIPPED clamps each
+	 * column to the render height)
+	 */
+	template<bool CLIPPED>
+	void walk_chunk(column *cols, const std::vector<char> &biomes, const std::vector<int> &blocks, const std::vector<int> &heights,
+			unsigned int ren_height);
+
+	/*
+	 * Worker thread entry point
+	 */
+	void run(unsigned int stage, unsigned int ren_height);
+
+	/*
+	 * Band writer thread entry point (writes each band once finished, in
+	 * order, releasing the band above it & letting the read stage move on)
+	 */
+	void write_bands(void);
+
+	/*
+	 * Write a band's rows to a tile pyramid (with the tile columns holding
+	 * regions)
+	 */
+	void write_pyramid_band(tile_pyramid &target, unsigned long long band, std::vector<unsigned char> &rows);
 
 public:
 
@@ -76,6 +381,8 @@ public:
 	static const int FILES_NOT_FOUND = -5;
 	static const int ALLOC_FAILED = -6;
 	static const int REGION_FILE_EXC = -7;
+	static const int WRITE_FAILED = -8;
+	static const int READ_FAILED = -9;
 
 	/*
 	 * Cartocraft info
@@ -86,10 +393,14 @@ public:
 	static const std::string WARRANTY;
 
 	/*
-	 * Cartocraft render constants
+	 * Cartocraft render constants (the sample halo is the widest sample radius,
+	 * derived from the sample radii; when streaming, regions are read at most
+	 * a lookahead of bands past the halo of the band being written)
 	 */
 	static const unsigned int SAMPLE_RADII_COUNT = 9;
 	static const int SAMPLE_RADII[SAMPLE_RADII_COUNT];
+	static const unsigned int SAMPLE_HALO;
+	static const unsigned int STREAM_LOOKAHEAD = 1;
 
 	/*
 	 * Cartocraft defaults
@@ -101,9 +412,23 @@ public:
 	/*
 	 * Cartocraft flags
 	 */
-	enum FLAGS { NOT_FLAG = -1, REGION_FILE_DIR, RENDER_HEIGHT, OUTPUT_PATH, DISP_USAGE, DISP_VERSION };
+	enum FLAGS { NOT_FLAG = -1, REGION_FILE_DIR, RENDER_HEIGHT, OUTPUT_PATH, THREAD_COUNT, OCCLUSION_QUALITY, SPILL_DIR,
+			COMPRESSION_LEVEL, PNG_FILTER, PALETTE_MODE, TILE_IMAGE, TILE_PYRAMID, DISP_USAGE, DISP_VERSION };
 	static const std::string FLAG[];
-	static const unsigned int FLAG_COUNT = 5;
+	static const unsigned int FLAG_COUNT = 13;
+
+	/*
+	 * Cartocraft occlusion qualities
+	 */
+	enum OCCLUSION { NO_OCCLUSION, INTEGRAL_OCCLUSION, SAMPLED_OCCLUSION };
+	static const unsigned int OCCLUSION_COUNT = 3;
+
+	/*
+	 * Cartocraft palette modes (an exact palette falls back to true color
+	 * past 256 colors, a quantized palette never does)
+	 */
+	enum PALETTE { NO_PALETTE, EXACT_PALETTE, QUANTIZED_PALETTE };
+	static const unsigned int PALETTE_COUNT = 3;
 
 	/*
 	 * Cartocraft constructor
@@ -115,25 +440,67 @@ public:
 	 */
 	virtual ~carto(void);
 
+	/*
+	 * Encode a tile image to a png (by palette mode) or a tile pyramid,
+	 * band-by-band
+	 */
+	int encode_tile_image(const std::string &in_path, const std::string &out_path);
+
 	/*
 	 * Returns a maps height
 	 */
-	unsigned int get_height(void) { return terrain.get_height(); }
+	unsigned long long get_height(void) { return canvas ? canvas->get_height() : 0; }
 
 	/*
-	 * Returns a maps raw pixel buffer, (channel order: RGBA)
+	 * Returns a maps png compression level
 	 */
-	std::vector<unsigned char> &get_pixel_buffer(void) { return terrain.get_raw(); }
+	int get_compression(void) { return png_opt.level; }
+
+	/*
+	 * Returns a maps png filter strategy
+	 */
+	unsigned int get_filter(void) { return png_opt.filter; }
+
+	/*
+	 * Returns a maps png palette mode
+	 */
+	unsigned int get_palette(void) { return palette; }
+
+	/*
+	 * Returns true if a map is written as a tile pyramid
+	 */
+	bool get_tiled(void) { return tiled; }
+
+	/*
+	 * Returns a maps raw pixel buffer, (channel order: RGBA, after rendering
+	 * into the canvas)
+	 */
+	void get_pixel_buffer(std::vector<unsigned char> &buffer);
+
+	/*
+	 * Returns a maps canvas spill directory
+	 */
+	const std::string &get_spill_dir(void) { return spill_dir; }
+
+	/*
+	 * Returns a maps occlusion quality
+	 */
+	unsigned int get_occlusion(void) { return occlusion; }
+
+	/*
+	 * Returns a maps worker thread count
+	 */
+	unsigned int get_threads(void) { return threads; }
 
 	/*
 	 * Returns a maps width
 	 */
-	unsigned int get_width(void) { return terrain.get_width(); }
+	unsigned long long get_width(void) { return canvas ? canvas->get_width() : 0; }
 
 	/*
 	 * Returns true if a region in the image buffer is filled
 	 */
-	bool is_filled(unsigned int x, unsigned int z);
+	bool is_filled(unsigned long long x, unsigned long long z);
 
 	/*
 	 * Returns an integer corresponding to a flag, or NOT_FLAG
@@ -141,14 +508,65 @@ public:
 	static int is_flag(const std::string &arg);
 
 	/*
-	 * Render a series of regions and output image at specified path
+	 * Render a series of regions into the canvas
+	 */
+	int render_map(const std::string &reg_dir, unsigned int ren_height, bool ren_occlusion) { return render_map(reg_dir, ren_height, ren_occlusion, std::string()); }
+
+	/*
+	 * Render a series of regions, streaming the image to a png (or a tile
+	 * image, by extension, or a tile pyramid directory) at a specified path
+	 * band-by-band (each band's tiles are released once written, so an empty
+	 * path keeps the whole canvas)
+	 */
+	int render_map(const std::string &reg_dir, unsigned int ren_height, bool ren_occlusion, const std::string &out_path);
+
+	/*
+	 * Sets a maps png compression level (0-9)
+	 */
+	void set_compression(int level);
+
+	/*
+	 * Sets a maps png filter strategy
+	 */
+	void set_filter(unsigned int filter);
+
+	/*
+	 * Sets a maps occlusion quality
+	 */
+	void set_occlusion(unsigned int occlusion);
+
+	/*
+	 * Sets a maps png palette mode
+	 */
+	void set_palette(unsigned int palette);
+
+	/*
+	 * Sets a maps canvas spill directory (empty renders in memory)
+	 */
+	void set_spill_dir(const std::string &spill_dir) { this->spill_dir = spill_dir; }
+
+	/*
+	 * Sets a maps output to a z/x/y tile pyramid (the output path names its
+	 * directory)
+	 */
+	void set_tiled(bool tiled) { this->tiled = tiled; }
+
+	/*
+	 * Sets a maps worker thread count (0 uses the hardware concurrency)
+	 */
+	void set_threads(unsigned int threads) { this->threads = threads; png_opt.threads = threads; }
+
+	/*
+	 * Sets a stage's worker thread count (0 uses the worker thread count)
 	 */
-	int render_map(const std::string &reg_dir, unsigned int ren_height, bool ren_occlusion);
+	void set_stage_threads(unsigned int stage, unsigned int threads);
 
 	/*
-	 * Write rendered regions to file as a png
+	 * Write rendered regions to file as a png (after rendering into the canvas),
+	 * indexed by palette mode & dropping alpha when every color is opaque, as
+	 * a tile image (by extension) or as a tile pyramid
 	 */
-	void write(const std::string &path) { terrain.write(path); }
+	void write(const std::string &path);
 };
 
 #endif
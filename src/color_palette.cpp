@@ -0,0 +1,221 @@
+/*
+ * color_palette.cpp
+ * Copyright (C) 2012 David Jolly
+ * ----------------------
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <stdexcept>
+#include "color_palette.hpp"
+
+/*
+ * Perceptual channel weights (red, green, blue & alpha)
+ */
+const unsigned int color_palette::WEIGHT[4] = { 3, 4, 2, 4 };
+
+/*
+ * Add a series of RGBA pixels to the histogram
+ */
+void color_palette::add(const unsigned char *px, size_t count) {
+	unsigned int color, last = 0;
+	unsigned long long *total = NULL;
+
+	// count each pixel (runs of a color share one lookup)
+	for(size_t i = 0; i < count; ++i, px += 4) {
+		color = (px[0] << 24) | (px[1] << 16) | (px[2] << 8) | px[3];
+		if(!total
+				|| color != last) {
+			total = &counts[color];
+			last = color;
+			if(px[3] != 0xff)
+				opaque = false;
+		}
+		++*total;
+	}
+}
+
+/*
+ * Build the palette, returning false (& leaving it empty) if the histogram
+ * holds too many colors & quantization is disabled
+ */
+bool color_palette::build(unsigned int max_colors, bool quantize) {
+	std::unordered_map<unsigned int, unsigned long long>::const_iterator iter;
+
+	// check for valid color count
+	if(!max_colors
+			|| max_colors > MAX_COLORS)
+		throw std::out_of_range("palette color count out-of-range");
+	colors.clear();
+	indices.clear();
+
+	// use every color when they all fit (sorted, so the palette does not
+	// depend on the histogram's order)
+	if(counts.size() <= max_colors) {
+		for(iter = counts.begin(); iter != counts.end(); ++iter)
+			colors.push_back(iter->first);
+		std::sort(colors.begin(), colors.end());
+		for(unsigned int i = 0; i < colors.size(); ++i)
+			indices.insert(std::make_pair(colors.at(i), (unsigned char) i));
+		return true;
+	}
+
+	// or quantize them
+	if(!quantize)
+		return false;
+	this->quantize(max_colors);
+	return true;
+}
+
+/*
+ * Returns the perceptually weighted squared distance between two colors
+ */
+unsigned int color_palette::distance(unsigned int a, unsigned int b) {
+	int diff;
+	unsigned int dist = 0;
+
+	for(unsigned int i = 0; i < 4; ++i) {
+		diff = (int) ((a >> (24 - i * 8)) & 0xff) - (int) ((b >> (24 - i * 8)) & 0xff);
+		dist += WEIGHT[i] * diff * diff;
+	}
+	return dist;
+}
+
+/*
+ * Convert a series of RGBA pixels (each in the histogram) to palette indices
+ */
+void color_palette::map(const unsigned char *px, size_t count, unsigned char *out) const {
+	unsigned int color, last = 0;
+	unsigned char index = 0;
+	std::unordered_map<unsigned int, unsigned char>::const_iterator iter;
+
+	// look up each pixel (runs of a color share one lookup)
+	for(size_t i = 0; i < count; ++i, px += 4) {
+		color = (px[0] << 24) | (px[1] << 16) | (px[2] << 8) | px[3];
+		if(!i
+				|| color != last) {
+			if((iter = indices.find(color)) == indices.end())
+				throw std::runtime_error("Color missing from palette");
+			index = iter->second;
+			last = color;
+		}
+		out[i] = index;
+	}
+}
+
+/*
+ * Returns a box of histogram entries' widest perceptually weighted channel
+ * range (zero for boxes that cannot be split) & that channel
+ */
+unsigned long long color_palette::measure(const std::vector<entry> &entries, const std::pair<size_t, size_t> &box, unsigned int &channel) {
+	unsigned int lo[4] = { 0xff, 0xff, 0xff, 0xff }, hi[4] = { 0 }, value;
+	unsigned long long score, best = 0;
+
+	// find each channel's range
+	if(box.second - box.first < 2)
+		return 0;
+	for(size_t j = box.first; j < box.second; ++j)
+		for(unsigned int i = 0; i < 4; ++i) {
+			value = (entries.at(j).first >> (24 - i * 8)) & 0xff;
+			lo[i] = std::min(lo[i], value);
+			hi[i] = std::max(hi[i], value);
+		}
+
+	// pick the widest weighted range
+	for(unsigned int i = 0; i < 4; ++i) {
+		score = (unsigned long long) (hi[i] - lo[i]) * WEIGHT[i];
+		if(score > best) {
+			best = score;
+			channel = i;
+		}
+	}
+	return best;
+}
+
+/*
+ * Quantize the histogram into at most a given color count by median cut
+ * (boxes are split along their widest perceptually weighted channel)
+ */
+void color_palette::quantize(unsigned int max_colors) {
+	size_t best, end, split;
+	unsigned int color, dist, best_dist;
+	unsigned long long half, sum, total, mean[4];
+	std::vector<entry> entries(counts.begin(), counts.end());
+	std::vector<std::pair<size_t, size_t>> boxes;
+	std::vector<unsigned long long> scores;
+	std::vector<unsigned int> channels;
+
+	// start with a single box holding every color (sorted, so the palette does
+	// not depend on the histogram's order)
+	std::sort(entries.begin(), entries.end());
+	boxes.push_back(std::make_pair(0, entries.size()));
+	channels.push_back(0);
+	scores.push_back(measure(entries, boxes.back(), channels.back()));
+	while(boxes.size() < max_colors) {
+
+		// find the box with the widest weighted channel
+		best = std::max_element(scores.begin(), scores.end()) - scores.begin();
+		if(!scores.at(best))
+			break;
+		std::pair<size_t, size_t> &box = boxes.at(best);
+
+		// split it at the pixel median of that channel (leaving each half at
+		// least one color)
+		std::sort(entries.begin() + box.first, entries.begin() + box.second, channel_order(24 - channels.at(best) * 8));
+		total = 0;
+		for(size_t j = box.first; j < box.second; ++j)
+			total += entries.at(j).second;
+		half = total / 2;
+		sum = entries.at(box.first).second;
+		for(split = box.first + 1; split < box.second - 1 && sum < half; ++split)
+			sum += entries.at(split).second;
+		end = box.second;
+		box.second = split;
+
+		// measure both halves
+		scores.at(best) = measure(entries, box, channels.at(best));
+		boxes.push_back(std::make_pair(split, end));
+		channels.push_back(0);
+		scores.push_back(measure(entries, boxes.back(), channels.back()));
+	}
+
+	// each box's color is the pixel-weighted mean of its colors
+	for(size_t k = 0; k < boxes.size(); ++k) {
+		total = 0;
+		for(unsigned int i = 0; i < 4; ++i)
+			mean[i] = 0;
+		for(size_t j = boxes.at(k).first; j < boxes.at(k).second; ++j) {
+			total += entries.at(j).second;
+			for(unsigned int i = 0; i < 4; ++i)
+				mean[i] += ((entries.at(j).first >> (24 - i * 8)) & 0xff) * entries.at(j).second;
+		}
+		color = 0;
+		for(unsigned int i = 0; i < 4; ++i)
+			color |= (unsigned int) ((mean[i] + total / 2) / total) << (24 - i * 8);
+		colors.push_back(color);
+	}
+
+	// map each color to its nearest palette color
+	for(size_t j = 0; j < entries.size(); ++j) {
+		best_dist = distance(entries.at(j).first, colors.front());
+		color = 0;
+		for(unsigned int i = 1; i < colors.size() && best_dist; ++i)
+			if((dist = distance(entries.at(j).first, colors.at(i))) < best_dist) {
+				best_dist = dist;
+				color = i;
+			}
+		indices.insert(std::make_pair(entries.at(j).first, (unsigned char) color));
+	}
+}
@@ -0,0 +1,162 @@
+/*
+ * color_palette.hpp
+ * Copyright (C) 2012 David Jolly
+ * ----------------------
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef COLOR_PALETTE_HPP_
+#define COLOR_PALETTE_HPP_
+
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/*
+ * Color palette built from a histogram of RGBA pixels (exact when the pixels
+ * hold few enough colors, otherwise optionally quantized by median cut)
+ */
+class color_palette {
+private:
+
+	/*
+	 * Histogram entry (color & pixel count)
+	 */
+	typedef std::pair<unsigned int, unsigned long long> entry;
+
+	/*
+	 * Orders histogram entries by a single channel
+	 */
+	class channel_order {
+	public:
+
+		/*
+		 * Channel shift
+		 */
+		unsigned int shift;
+
+		/*
+		 * Channel order constructor
+		 */
+		channel_order(unsigned int shift) : shift(shift) { return; }
+
+		/*
+		 * Returns true if an entry's channel is less than another's
+		 */
+		bool operator()(const entry &a, const entry &b) const { return ((a.first >> shift) & 0xff) < ((b.first >> shift) & 0xff); }
+	};
+
+	/*
+	 * Pixel count by color (stored as RGBA)
+	 */
+	std::unordered_map<unsigned int, unsigned long long> counts;
+
+	/*
+	 * Palette index by color (for every color in the histogram)
+	 */
+	std::unordered_map<unsigned int, unsigned char> indices;
+
+	/*
+	 * Palette colors (stored as RGBA)
+	 */
+	std::vector<unsigned int> colors;
+
+	/*
+	 * Every color is opaque
+	 */
+	bool opaque;
+
+	/*
+	 * Color palette constructor (non-copyable)
+	 */
+	color_palette(const color_palette &other);
+
+	/*
+	 * Color palette assignment operator (non-copyable)
+	 */
+	color_palette &operator=(const color_palette &other);
+
+	/*
+	 * Returns the perceptually weighted squared distance between two colors
+	 */
+	static unsigned int distance(unsigned int a, unsigned int b);
+
+	/*
+	 * Returns a box of histogram entries' widest perceptually weighted channel
+	 * range (zero for boxes that cannot be split) & that channel
+	 */
+	static unsigned long long measure(const std::vector<entry> &entries, const std::pair<size_t, size_t> &box, unsigned int &channel);
+
+	/*
+	 * Quantize the histogram into at most a given color count by median cut
+	 * (boxes are split along their widest perceptually weighted channel)
+	 */
+	void quantize(unsigned int max_colors);
+
+public:
+
+	/*
+	 * Largest palette (8-bit indices)
+	 */
+	static const unsigned int MAX_COLORS = 256;
+
+	/*
+	 * Perceptual channel weights (red, green, blue & alpha)
+	 */
+	static const unsigned int WEIGHT[4];
+
+	/*
+	 * Color palette constructor
+	 */
+	color_palette(void) : opaque(true) { return; }
+
+	/*
+	 * Color palette destructor
+	 */
+	virtual ~color_palette(void) { return; }
+
+	/*
+	 * Add a series of RGBA pixels to the histogram
+	 */
+	void add(const unsigned char *px, size_t count);
+
+	/*
+	 * Build the palette, returning false (& leaving it empty) if the histogram
+	 * holds too many colors & quantization is disabled
+	 */
+	bool build(unsigned int max_colors, bool quantize);
+
+	/*
+	 * Returns a palette's colors (stored as RGBA)
+	 */
+	const std::vector<unsigned int> &get_colors(void) const { return colors; }
+
+	/*
+	 * Returns the histogram's distinct color count
+	 */
+	size_t get_count(void) const { return counts.size(); }
+
+	/*
+	 * Returns true if every color in the histogram is opaque
+	 */
+	bool is_opaque(void) const { return opaque; }
+
+	/*
+	 * Convert a series of RGBA pixels (each in the histogram) to palette indices
+	 */
+	void map(const unsigned char *px, size_t count, unsigned char *out) const;
+};
+
+#endif
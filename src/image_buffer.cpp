@@ -17,6 +17,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <stdexcept>
 #include "image_buffer.hpp"
 #include "lode/lodepng.hpp"
 
@@ -131,6 +132,26 @@ void image_buffer::fill(unsigned int col) {
 	}
 }
 
+/*
+ * Read image buffer from a tile image file
+ */
+void image_buffer::read_tile_image(const std::string &path) {
+	tile_image::reader reader(path);
+	unsigned int tile_width = reader.get_tile_width();
+
+	// check for valid dimensions
+	if(reader.get_width() > 0xffffffff / reader.get_height() / CHANNELS)
+		throw std::out_of_range("Tile image dimensions out-of-range");
+	width = reader.get_width();
+	height = reader.get_height();
+	count = width * height * CHANNELS;
+	px.resize(count);
+
+	// read each band of tiles into place
+	for(unsigned int z = 0; (unsigned long long) z * tile_width < height; ++z)
+		reader.read_band(z, &px[(size_t) z * tile_width * width * CHANNELS]);
+}
+
 /*
  * Set a pixel at a given coord x, z
  */
@@ -161,3 +182,28 @@ void image_buffer::write(const std::string &path) {
 	encoder.encode(output, &px[0], width, height);
 	LodePNG::saveFile(output, path.c_str());
 }
+
+/*
+ * Write image buffer to file as a png, encoded in parallel
+ */
+void image_buffer::write(const std::string &path, const png_writer::options &opt) {
+	png_writer writer(path, width, height, opt);
+
+	// write every row & finish the file
+	writer.write_rows(&px[0], height);
+	writer.close();
+}
+
+/*
+ * Write image buffer to file as a tile image
+ */
+void image_buffer::write_tile_image(const std::string &path, unsigned int encoding) {
+	tile_image::writer writer(path, width, height, 0, encoding);
+	unsigned int tile_width = tile_image::DEF_TILE_WIDTH;
+
+	// write every tile & finish the file
+	for(unsigned int z = 0; z < height; z += tile_width)
+		for(unsigned int x = 0; x < width; x += tile_width)
+			writer.write_tile(x / tile_width, z / tile_width, &px[((size_t) z * width + x) * CHANNELS], width);
+	writer.close();
+}
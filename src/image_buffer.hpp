@@ -22,6 +22,8 @@
 
 #include <string>
 #include <vector>
+#include "png_writer.hpp"
+#include "tile_image.hpp"
 
 class image_buffer {
 private:
@@ -129,6 +131,11 @@ public:
 	 */
 	unsigned int get_width(void) { return width; }
 
+	/*
+	 * Read image buffer from a tile image file
+	 */
+	void read_tile_image(const std::string &path);
+
 	/*
 	 * Set a pixel at a given coord x, z
 	 */
@@ -138,6 +145,16 @@ public:
 	 * Write image buffer to file as a png
 	 */
 	void write(const std::string &path);
+
+	/*
+	 * Write image buffer to file as a png, encoded in parallel
+	 */
+	void write(const std::string &path, const png_writer::options &opt);
+
+	/*
+	 * Write image buffer to file as a tile image
+	 */
+	void write_tile_image(const std::string &path, unsigned int encoding = tile_image::QOI_ENCODING);
 };
 
 #endif
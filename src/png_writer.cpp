@@ -0,0 +1,419 @@
+/*
+ * png_writer.cpp
+ * Copyright (C) 2012 David Jolly
+ * ----------------------
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+#include <zlib.h>
+#include "png_writer.hpp"
+
+/*
+ * Png writer constructor (writes the signature & header)
+ */
+png_writer::png_writer(const std::string &path, unsigned long long width, unsigned long long height, const options &opt,
+		const color_palette *palette) : opt(opt), palette(palette), width(width), height(height), rows(0), pending_rows(0), tail(0), adler(1),
+		open(false), next(0) {
+	bool opaque = true;
+	unsigned char header[13] = { 0 };
+	std::vector<unsigned char> entries, alphas;
+	static const unsigned char SIGNATURE[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+
+	// check for valid dimensions (png dimensions are 31-bit) & options
+	if(!width
+			|| !height
+			|| width > 0x7fffffff
+			|| height > 0x7fffffff)
+		throw std::out_of_range("png dimensions out-of-range");
+	if(opt.level < 0
+			|| opt.level > 9
+			|| opt.filter >= FILTER_COUNT
+			|| opt.color >= COLOR_COUNT)
+		throw std::out_of_range("png options out-of-range");
+	if(opt.color == INDEXED_COLOR
+			&& (!palette
+			|| palette->get_colors().empty()
+			|| palette->get_colors().size() > color_palette::MAX_COLORS))
+		throw std::runtime_error("Indexed color requires a palette");
+
+	// size segments & batches (batches do not depend on the thread count, so
+	// neither does the output)
+	threads = opt.threads ? opt.threads : std::thread::hardware_concurrency();
+	if(!threads)
+		threads = 1;
+	depth = (opt.color == RGBA_COLOR) ? CHANNELS : ((opt.color == RGB_COLOR) ? CHANNELS - 1 : 1);
+	stride = width * depth;
+	segment_rows = std::max((size_t) 1, SEGMENT_SIZE / (stride + 1));
+	batch_rows = segment_rows * BATCH_SEGMENTS;
+	prev.assign(stride, 0);
+
+	// open file
+	file.open(path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	if(!file.is_open())
+		throw std::runtime_error("Failed to open output file");
+	open = true;
+
+	// write signature & header (8-bit samples, no interlacing)
+	file.write((const char *) SIGNATURE, sizeof(SIGNATURE));
+	for(unsigned int i = 0; i < 4; ++i) {
+		header[i] = (unsigned char) (width >> (24 - i * 8));
+		header[i + 4] = (unsigned char) (height >> (24 - i * 8));
+	}
+	header[8] = 8;
+	header[9] = (opt.color == RGBA_COLOR) ? 6 : ((opt.color == RGB_COLOR) ? 2 : 3);
+	write_chunk("IHDR", header, sizeof(header));
+
+	// write the palette's colors & alphas (the alphas only when some color is
+	// not opaque)
+	if(opt.color == INDEXED_COLOR) {
+		for(size_t i = 0; i < palette->get_colors().size(); ++i) {
+			entries.push_back((unsigned char) (palette->get_colors().at(i) >> 24));
+			entries.push_back((unsigned char) (palette->get_colors().at(i) >> 16));
+			entries.push_back((unsigned char) (palette->get_colors().at(i) >> 8));
+			alphas.push_back((unsigned char) palette->get_colors().at(i));
+			if(alphas.back() != 0xff)
+				opaque = false;
+		}
+		write_chunk("PLTE", entries.data(), entries.size());
+		if(!opaque)
+			write_chunk("tRNS", alphas.data(), alphas.size());
+	}
+}
+
+/*
+ * Finish the image data & write the end chunk (every row must be written)
+ */
+void png_writer::close(void) {
+	int ret;
+	z_stream stream;
+	unsigned char end[16];
+
+	// check writer state
+	if(!open)
+		throw std::runtime_error("Png writer already closed");
+	if(rows != height)
+		throw std::runtime_error("Png rows missing");
+
+	// encode the remaining rows
+	encode_pending();
+	open = false;
+
+	// end the deflate stream with an empty final block
+	memset(&stream, 0, sizeof(stream));
+	if(deflateInit2(&stream, opt.level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		throw std::runtime_error("Failed to initialize deflate stream");
+	stream.next_out = end;
+	stream.avail_out = sizeof(end);
+	ret = deflate(&stream, Z_FINISH);
+	deflateEnd(&stream);
+	if(ret != Z_STREAM_END)
+		throw std::runtime_error("Failed to deflate image data");
+
+	// follow it with the adler-32 checksum & write end chunk
+	idat.assign(end, end + (sizeof(end) - stream.avail_out));
+	for(unsigned int i = 0; i < 4; ++i)
+		idat.push_back((unsigned char) (adler >> (24 - i * 8)));
+	write_chunk("IDAT", idat.data(), idat.size());
+	write_chunk("IEND", NULL, 0);
+	file.close();
+	if(file.fail())
+		throw std::runtime_error("Failed to write output file");
+}
+
+/*
+ * Convert a segment's rows to the color type
+ */
+void png_writer::convert_segment(segment &seg) {
+	const unsigned char *row;
+	unsigned char *out;
+
+	for(size_t i = seg.first; i < seg.first + seg.count; ++i) {
+		row = &pending[i * width * CHANNELS];
+		out = &converted[i * stride];
+
+		// drop each pixel's alpha
+		if(opt.color == RGB_COLOR)
+			for(unsigned long long x = 0; x < width; ++x, row += CHANNELS, out += CHANNELS - 1) {
+				out[0] = row[0];
+				out[1] = row[1];
+				out[2] = row[2];
+			}
+
+		// or look up each pixel's palette index
+		else
+			palette->map(row, width, out);
+	}
+}
+
+/*
+ * Deflate a segment's filtered rows (primed with the filtered data before it)
+ */
+void png_writer::deflate_segment(segment &seg) {
+	int ret;
+	z_stream stream;
+	size_t offset = tail + seg.first * (stride + 1), length = seg.count * (stride + 1), window = std::min(offset, WINDOW_SIZE);
+
+	// initialize a raw deflate stream, primed with the window before the segment
+	memset(&stream, 0, sizeof(stream));
+	if(deflateInit2(&stream, opt.level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		throw std::runtime_error("Failed to initialize deflate stream");
+	if(window
+			&& deflateSetDictionary(&stream, &filtered[offset - window], window) != Z_OK) {
+		deflateEnd(&stream);
+		throw std::runtime_error("Failed to prime deflate stream");
+	}
+
+	// deflate the segment, ending byte-aligned with a sync flush so the next
+	// segment's data can follow it
+	seg.data.resize(deflateBound(&stream, length) + 16);
+	stream.next_in = &filtered[offset];
+	stream.avail_in = length;
+	stream.next_out = seg.data.data();
+	stream.avail_out = seg.data.size();
+	for(;;) {
+		ret = deflate(&stream, Z_SYNC_FLUSH);
+		if(ret == Z_STREAM_ERROR
+				|| stream.avail_out)
+			break;
+		seg.data.resize(seg.data.size() * 2);
+		stream.next_out = seg.data.data() + stream.total_out;
+		stream.avail_out = seg.data.size() - stream.total_out;
+	}
+	deflateEnd(&stream);
+	if(ret == Z_STREAM_ERROR
+			|| stream.avail_in)
+		throw std::runtime_error("Failed to deflate image data");
+	seg.data.resize(stream.total_out);
+	seg.adler = adler32(adler32(0, NULL, 0), &filtered[offset], length);
+}
+
+/*
+ * Filter & deflate the pending rows, writing each segment's data in order
+ */
+void png_writer::encode_pending(void) {
+	unsigned int count;
+	unsigned int level;
+	std::vector<std::thread> workers;
+
+	if(!pending_rows)
+		return;
+
+	// split the pending rows into segments
+	segments.clear();
+	for(size_t i = 0; i < pending_rows; i += segment_rows)
+		segments.push_back(segment(i, std::min(segment_rows, pending_rows - i)));
+	filtered.resize(tail + pending_rows * (stride + 1));
+	if(opt.color != RGBA_COLOR)
+		converted.resize(batch_rows * stride);
+
+	// convert every segment, filter every segment, then deflate every segment
+	// (filtering reads the row above each segment & deflating the filtered data
+	// before it), on the calling thread & workers
+	count = std::min((size_t) threads, segments.size());
+	for(unsigned int pass = (opt.color == RGBA_COLOR) ? FILTER_PASS : CONVERT_PASS; pass < PASS_COUNT; ++pass) {
+		next = 0;
+		workers.clear();
+		for(unsigned int i = 1; i < count; ++i)
+			workers.push_back(std::thread(&png_writer::run, this, pass));
+		run(pass);
+		for(unsigned int i = 0; i < workers.size(); ++i)
+			workers.at(i).join();
+		if(!error.empty())
+			throw std::runtime_error(error);
+	}
+
+	// write the segments as a single image data chunk (led by the zlib header)
+	idat.clear();
+	if(!tail
+			&& rows == pending_rows) {
+		level = (opt.level < 2) ? 0 : ((opt.level < 6) ? 1 : ((opt.level == 6) ? 2 : 3));
+		idat.push_back(0x78);
+		idat.push_back((unsigned char) (level << 6));
+		idat.back() += 31 - ((0x78 << 8) | idat.back()) % 31;
+	}
+	for(size_t i = 0; i < segments.size(); ++i) {
+		idat.insert(idat.end(), segments.at(i).data.begin(), segments.at(i).data.end());
+		adler = adler32_combine(adler, segments.at(i).adler, segments.at(i).count * (stride + 1));
+		std::vector<unsigned char>().swap(segments.at(i).data);
+	}
+	write_chunk("IDAT", idat.data(), idat.size());
+
+	// keep the last row & the window of filtered data for the next batch
+	memcpy(prev.data(), ((opt.color == RGBA_COLOR) ? &pending[0] : &converted[0]) + (pending_rows - 1) * stride, stride);
+	if(filtered.size() > WINDOW_SIZE)
+		filtered.erase(filtered.begin(), filtered.end() - WINDOW_SIZE);
+	tail = filtered.size();
+	pending_rows = 0;
+}
+
+/*
+ * Filter a segment's rows
+ */
+void png_writer::filter_segment(segment &seg, std::vector<unsigned char> *candidates) {
+	const unsigned char *row;
+	unsigned int filter = opt.filter;
+
+	// filter indexed rows adaptively with no filter (differences between
+	// indices rarely predict anything)
+	if(opt.color == INDEXED_COLOR
+			&& filter == ADAPTIVE_FILTER)
+		filter = NONE_FILTER;
+	for(size_t i = seg.first; i < seg.first + seg.count; ++i) {
+		row = ((opt.color == RGBA_COLOR) ? &pending[0] : &converted[0]) + i * stride;
+		filter_row(row, i ? row - stride : prev.data(), stride, depth, filter, &filtered[tail + i * (stride + 1)], candidates);
+	}
+}
+
+/*
+ * Filter a row against the row above it, by filter strategy
+ */
+void png_writer::filter_row(const unsigned char *row, const unsigned char *above, size_t length, size_t depth, unsigned int filter,
+		unsigned char *out, std::vector<unsigned char> *candidates) {
+	int a, c;
+	unsigned int best = NONE_FILTER;
+	unsigned long long best_sum = 0, sum;
+
+	// filter with a single type
+	if(filter != ADAPTIVE_FILTER) {
+		out[0] = filter;
+		for(size_t i = 0; i < length; ++i) {
+			a = (i >= depth) ? row[i - depth] : 0;
+			c = (i >= depth) ? above[i - depth] : 0;
+			out[i + 1] = row[i] - predict(filter, a, above[i], c);
+		}
+		return;
+	}
+
+	// or with every type, keeping the type with the smallest sum of absolute
+	// (signed) differences
+	for(unsigned int type = NONE_FILTER; type < ADAPTIVE_FILTER; ++type) {
+		unsigned char *cand = candidates[type].data();
+
+		sum = 0;
+		for(size_t i = 0; i < length; ++i) {
+			a = (i >= depth) ? row[i - depth] : 0;
+			c = (i >= depth) ? above[i - depth] : 0;
+			cand[i] = row[i] - predict(type, a, above[i], c);
+			sum += abs((int) (signed char) cand[i]);
+		}
+		if(type == NONE_FILTER
+				|| sum < best_sum) {
+			best_sum = sum;
+			best = type;
+		}
+	}
+	out[0] = best;
+	memcpy(out + 1, candidates[best].data(), length);
+}
+
+/*
+ * Worker thread entry point (runs a pass over segments)
+ */
+void png_writer::run(unsigned int pass) {
+	size_t index;
+	std::vector<unsigned char> candidates[ADAPTIVE_FILTER];
+
+	if(pass == FILTER_PASS
+			&& opt.filter == ADAPTIVE_FILTER)
+		for(unsigned int i = 0; i < ADAPTIVE_FILTER; ++i)
+			candidates[i].resize(stride);
+	for(;;) {
+
+		// claim the next segment
+		lock.lock();
+		if(next >= segments.size()
+				|| !error.empty()) {
+			lock.unlock();
+			break;
+		}
+		index = next++;
+		lock.unlock();
+
+		// run the pass over the segment (recording the first failure)
+		try {
+			switch(pass) {
+				case CONVERT_PASS:
+					convert_segment(segments.at(index));
+					break;
+				case FILTER_PASS:
+					filter_segment(segments.at(index), candidates);
+					break;
+				case DEFLATE_PASS:
+					deflate_segment(segments.at(index));
+					break;
+			}
+		} catch(std::exception &exc) {
+			lock.lock();
+			if(error.empty())
+				error = exc.what();
+			lock.unlock();
+		}
+	}
+}
+
+/*
+ * Write a png chunk
+ */
+void png_writer::write_chunk(const char *type, const unsigned char *data, size_t length) {
+	unsigned long crc;
+	unsigned char field[4];
+
+	// write length & type
+	for(unsigned int i = 0; i < 4; ++i)
+		field[i] = (unsigned char) (length >> (24 - i * 8));
+	file.write((const char *) field, sizeof(field));
+	file.write(type, 4);
+
+	// write data & crc (over type & data)
+	if(length)
+		file.write((const char *) data, length);
+	crc = crc32(0, (const unsigned char *) type, 4);
+	if(length)
+		crc = crc32(crc, data, length);
+	for(unsigned int i = 0; i < 4; ++i)
+		field[i] = (unsigned char) (crc >> (24 - i * 8));
+	file.write((const char *) field, sizeof(field));
+	if(file.fail())
+		throw std::runtime_error("Failed to write output file");
+}
+
+/*
+ * Write a series of RGBA rows
+ */
+void png_writer::write_rows(const unsigned char *data, size_t count) {
+	size_t span, size = width * CHANNELS;
+
+	// check writer state
+	if(!open
+			|| count > height - rows)
+		throw std::out_of_range("png rows out-of-range");
+
+	// queue rows, encoding each full batch
+	while(count) {
+		span = std::min(count, batch_rows - pending_rows);
+		pending.resize(batch_rows * size);
+		memcpy(&pending[pending_rows * size], data, span * size);
+		pending_rows += span;
+		rows += span;
+		data += span * size;
+		count -= span;
+		if(pending_rows == batch_rows)
+			encode_pending();
+	}
+}
@@ -0,0 +1,276 @@
+/*
+ * png_writer.hpp
+ * Copyright (C) 2012 David Jolly
+ * ----------------------
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PNG_WRITER_HPP_
+#define PNG_WRITER_HPP_
+
+#include <cstdlib>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "color_palette.hpp"
+
+/*
+ * Streaming RGBA png writer (rows are filtered & deflated as they arrive,
+ * so an image is never held in memory whole). Rows are split into segments
+ * that are filtered & deflated in parallel, each primed with the tail of the
+ * segment before it & ended with a sync flush, so the concatenated segments
+ * form a single zlib stream (output is identical for any thread count).
+ * Rows arrive as RGBA & are written as RGBA, RGB or palette indices
+ */
+class png_writer {
+public:
+
+	/*
+	 * Png writer filter strategies (a single filter type for every row, or
+	 * the type with the smallest sum of absolute differences per row)
+	 */
+	enum FILTER { NONE_FILTER, SUB_FILTER, UP_FILTER, AVERAGE_FILTER, PAETH_FILTER, ADAPTIVE_FILTER };
+	static const unsigned int FILTER_COUNT = 6;
+
+	/*
+	 * Png writer color types (RGB drops the alpha channel, indexed writes
+	 * each pixel's palette index)
+	 */
+	enum COLOR { RGBA_COLOR, RGB_COLOR, INDEXED_COLOR };
+	static const unsigned int COLOR_COUNT = 3;
+
+	/*
+	 * Png writer constants
+	 */
+	static const unsigned int CHANNELS = 4;
+	static const int DEF_LEVEL = 6;
+	static const size_t SEGMENT_SIZE = 131072;
+	static const size_t BATCH_SEGMENTS = 32;
+	static const size_t WINDOW_SIZE = 32768;
+
+	/*
+	 * Encoding options
+	 */
+	class options {
+	public:
+
+		/*
+		 * Deflate level (0-9)
+		 */
+		int level;
+
+		/*
+		 * Filter strategy (indexed rows are left unfiltered by the adaptive
+		 * strategy)
+		 */
+		unsigned int filter;
+
+		/*
+		 * Color type
+		 */
+		unsigned int color;
+
+		/*
+		 * Worker thread count (0 uses the hardware concurrency)
+		 */
+		unsigned int threads;
+
+		/*
+		 * Options constructor
+		 */
+		options(void) : level(DEF_LEVEL), filter(ADAPTIVE_FILTER), color(RGBA_COLOR), threads(0) { return; }
+	};
+
+private:
+
+	/*
+	 * Rows deflated independently of their neighbors
+	 */
+	class segment {
+	public:
+
+		/*
+		 * First row (within the pending rows) & row count
+		 */
+		size_t first, count;
+
+		/*
+		 * Deflated data & adler-32 checksum of the filtered data
+		 */
+		std::vector<unsigned char> data;
+		unsigned long adler;
+
+		/*
+		 * Segment constructor
+		 */
+		segment(size_t first, size_t count) : first(first), count(count), adler(0) { return; }
+	};
+
+	/*
+	 * Output file
+	 */
+	std::ofstream file;
+
+	/*
+	 * Encoding options & palette (for indexed color)
+	 */
+	options opt;
+	const color_palette *palette;
+
+	/*
+	 * Image width & height (in pixels), rows written, bytes per pixel & row
+	 * (as written), rows per segment & rows encoded at once
+	 */
+	unsigned long long width, height, rows;
+	size_t depth, stride, segment_rows, batch_rows;
+
+	/*
+	 * Rows waiting to be encoded (RGBA), the rows converted to the color type
+	 * & the last row encoded (converted & unfiltered)
+	 */
+	std::vector<unsigned char> pending, converted, prev;
+	size_t pending_rows;
+
+	/*
+	 * Filtered rows (each led by its filter type), following the tail of the
+	 * filtered data encoded so far (used to prime the first segment)
+	 */
+	std::vector<unsigned char> filtered;
+	size_t tail;
+
+	/*
+	 * Segments of the pending rows, adler-32 checksum of the filtered data
+	 * encoded so far & image data chunk
+	 */
+	std::vector<segment> segments;
+	unsigned long adler;
+	std::vector<unsigned char> idat;
+
+	/*
+	 * Worker thread count, writer open, next segment to claim, segment lock
+	 * & worker error
+	 */
+	unsigned int threads;
+	bool open;
+	size_t next;
+	std::mutex lock;
+	std::string error;
+
+	/*
+	 * Png writer constructor (non-copyable)
+	 */
+	png_writer(const png_writer &other);
+
+	/*
+	 * Png writer assignment operator (non-copyable)
+	 */
+	png_writer &operator=(const png_writer &other);
+
+	/*
+	 * Png writer encoding passes (each pass runs over every segment before the
+	 * next pass starts)
+	 */
+	enum PASS { CONVERT_PASS, FILTER_PASS, DEFLATE_PASS };
+	static const unsigned int PASS_COUNT = 3;
+
+	/*
+	 * Convert a segment's rows to the color type
+	 */
+	void convert_segment(segment &seg);
+
+	/*
+	 * Deflate a segment's filtered rows (primed with the filtered data before it)
+	 */
+	void deflate_segment(segment &seg);
+
+	/*
+	 * Filter & deflate the pending rows, writing each segment's data in order
+	 */
+	void encode_pending(void);
+
+	/*
+	 * Filter a segment's rows
+	 */
+	void filter_segment(segment &seg, std::vector<unsigned char> *candidates);
+
+	/*
+	 * Filter a row against the row above it (with a given byte count per
+	 * pixel), by filter strategy
+	 */
+	static void filter_row(const unsigned char *row, const unsigned char *above, size_t length, size_t depth, unsigned int filter,
+			unsigned char *out, std::vector<unsigned char> *candidates);
+
+	/*
+	 * Returns a filter type's prediction of a byte from its left (a), upper (b)
+	 * & upper-left (c) neighbors
+	 */
+	static int predict(unsigned int filter, int a, int b, int c) {
+		int p = a + b - c, pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+
+		switch(filter) {
+			case SUB_FILTER:
+				return a;
+			case UP_FILTER:
+				return b;
+			case AVERAGE_FILTER:
+				return (a + b) >> 1;
+			case PAETH_FILTER:
+				return (pa <= pb && pa <= pc) ? a : ((pb <= pc) ? b : c);
+		}
+		return 0;
+	}
+
+	/*
+	 * Worker thread entry point (runs a pass over segments)
+	 */
+	void run(unsigned int pass);
+
+	/*
+	 * Write a png chunk
+	 */
+	void write_chunk(const char *type, const unsigned char *data, size_t length);
+
+public:
+
+	/*
+	 * Png writer constructor (writes the signature, header & palette, which
+	 * indexed color requires)
+	 */
+	png_writer(const std::string &path, unsigned long long width, unsigned long long height, const options &opt = options(),
+			const color_palette *palette = NULL);
+
+	/*
+	 * Png writer destructor
+	 */
+	virtual ~png_writer(void) { return; }
+
+	/*
+	 * Finish the image data & write the end chunk (every row must be written)
+	 */
+	void close(void);
+
+	/*
+	 * Returns a png writer's remaining row count
+	 */
+	unsigned long long get_remaining(void) { return height - rows; }
+
+	/*
+	 * Write a series of RGBA rows
+	 */
+	void write_rows(const unsigned char *data, size_t count);
+};
+
+#endif
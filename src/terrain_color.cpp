@@ -0,0 +1,59 @@
+/*
+ * terrain_color.cpp
+ * Copyright (C) 2012 David Jolly
+ * ----------------------
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "biome_color.hpp"
+#include "terrain_color.hpp"
+
+/*
+ * Terrain colors by block id & biome
+ */
+unsigned char terrain_color::COLOR[(block_color::MAX_BLOCK + 1) * COLUMN_COUNT][image_buffer::CHANNELS];
+const bool terrain_color::COLOR_INIT = terrain_color::init_color();
+
+/*
+ * Initializes the terrain color table
+ */
+bool terrain_color::init_color(void) {
+	unsigned int back, fore;
+	unsigned char alpha, c_back, c_fore;
+
+	for(unsigned int id = 0; id <= block_color::MAX_BLOCK; ++id)
+		for(unsigned int biome = 0; biome < COLUMN_COUNT; ++biome) {
+			unsigned char *col = COLOR[id * COLUMN_COUNT + biome];
+			back = block_color::COLOR[id];
+
+			// unknown biomes & the unblended column keep the block color
+			fore = (biome <= biome_color::MAX_BIOME) ? biome_color::BLEND_COLOR[biome] : 0;
+			if(!fore) {
+				for(unsigned int i = 0; i < image_buffer::CHANNELS; ++i)
+					col[i] = (unsigned char) (back >> (24 - (i * 8)));
+				continue;
+			}
+
+			// alpha-blend the biome color over the block color
+			alpha = (unsigned char) fore;
+			for(unsigned int i = 0; i < image_buffer::CHANNELS - 1; ++i) {
+				c_back = (unsigned char) (back >> (24 - (i * 8)));
+				c_fore = (unsigned char) (fore >> (24 - (i * 8)));
+				col[i] = (unsigned int) (c_fore * ((float) alpha / 0xff) + c_back * ((float) (0xff - alpha) / 0xff));
+			}
+			col[image_buffer::ALPHA] = 0xff;
+		}
+	return true;
+}
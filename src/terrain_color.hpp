@@ -0,0 +1,58 @@
+/*
+ * terrain_color.hpp
+ * Copyright (C) 2012 David Jolly
+ * ----------------------
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TERRAIN_COLOR_HPP_
+#define TERRAIN_COLOR_HPP_
+
+#include "block_color.hpp"
+#include "image_buffer.hpp"
+
+class terrain_color {
+private:
+
+	/*
+	 * Initializes the terrain color table
+	 */
+	static bool init_color(void);
+
+public:
+
+	/*
+	 * Biome column count (one per biome byte, plus the unblended column)
+	 */
+	static const unsigned int BIOME_COUNT = 256;
+	static const unsigned int UNBLENDED = BIOME_COUNT;
+	static const unsigned int COLUMN_COUNT = BIOME_COUNT + 1;
+
+	/*
+	 * Terrain colors by block id & biome (stored with byte-order: RGBA)
+	 */
+	static unsigned char COLOR[(block_color::MAX_BLOCK + 1) * COLUMN_COUNT][image_buffer::CHANNELS];
+	static const bool COLOR_INIT;
+
+	/*
+	 * Returns a terrain color's index for a given block id & biome (blocks
+	 * clamped by the render height are left unblended)
+	 */
+	static unsigned int index(unsigned int id, char biome, bool below_ground) {
+		return id * COLUMN_COUNT + (below_ground ? UNBLENDED : (unsigned char) biome);
+	}
+};
+
+#endif
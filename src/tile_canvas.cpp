@@ -0,0 +1,236 @@
+/*
+ * tile_canvas.cpp
+ * Copyright (C) 2012 David Jolly
+ * ----------------------
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "tile_canvas.hpp"
+
+/*
+ * Tile canvas destructor
+ */
+tile_canvas::~tile_canvas(void) {
+
+	// free tile storage
+	if(storage)
+		munmap(storage, storage_size);
+	else
+		for(size_t i = 0; i < tiles.size(); ++i)
+			delete[] tiles.at(i).color;
+}
+
+/*
+ * Acquire a tile's planes, filled with the fill color & zero heights
+ * (the tile reads as missing until acquired)
+ */
+void tile_canvas::acquire_tile(size_t tile) {
+	tile_canvas::tile &t = tiles.at(tile);
+
+	// check allocation state
+	if(!allocated)
+		throw std::runtime_error("Canvas not allocated");
+	if(t.color)
+		return;
+
+	// assign the tile's planes from the spill file, or allocate them in memory
+	t.color = storage ? storage + tile * (COLOR_SIZE + HEIGHT_SIZE) : new unsigned char[COLOR_SIZE + HEIGHT_SIZE];
+	t.height = reinterpret_cast<unsigned short *>(t.color + COLOR_SIZE);
+
+	// clear the tile's planes
+	for(size_t i = 0; i < COLOR_SIZE; i += image_buffer::CHANNELS) {
+		t.color[i] = (unsigned char) (fill >> 24);
+		t.color[i + 1] = (unsigned char) (fill >> 16);
+		t.color[i + 2] = (unsigned char) (fill >> 8);
+		t.color[i + 3] = (unsigned char) fill;
+	}
+	memset(t.height, 0, HEIGHT_SIZE);
+}
+
+/*
+ * Add a tile at a given tile x, z coord (before allocating)
+ */
+void tile_canvas::add_tile(unsigned long long x, unsigned long long z) {
+
+	// check for valid coord & allocation state
+	if(x >= (width + TILE_WIDTH - 1) / TILE_WIDTH
+			|| z >= (height + TILE_WIDTH - 1) / TILE_WIDTH)
+		throw std::out_of_range("tile coordinates out-of-range");
+	if(allocated)
+		throw std::runtime_error("Canvas already allocated");
+	if(index.find(std::make_pair(x, z)) != index.end())
+		return;
+	index.insert(std::make_pair(std::make_pair(x, z), tiles.size()));
+	tiles.push_back(tile(x, z));
+}
+
+/*
+ * Allocate the canvas, in memory or (with a spill directory) in an
+ * unlinked spill file the system can page to disk (tiles are acquired
+ * individually afterwards)
+ */
+void tile_canvas::allocate(const std::string &spill_dir) {
+	int fd;
+	std::string path;
+	std::vector<char> templ;
+
+	// check allocation state
+	if(allocated)
+		throw std::runtime_error("Canvas already allocated");
+	allocated = true;
+
+	// map storage for every tile from an unlinked spill file (only the pages
+	// of acquired tiles are ever touched)
+	if(spill_dir.empty()
+			|| tiles.empty())
+		return;
+	storage_size = tiles.size() * (COLOR_SIZE + HEIGHT_SIZE);
+	path = spill_dir + "/carto_spill_XXXXXX";
+	templ.assign(path.begin(), path.end());
+	templ.push_back('\0');
+	if((fd = mkstemp(templ.data())) < 0)
+		throw std::runtime_error("Failed to create spill file");
+	unlink(templ.data());
+	if(ftruncate(fd, storage_size)) {
+		close(fd);
+		throw std::runtime_error("Failed to size spill file");
+	}
+	storage = (unsigned char *) mmap(NULL, storage_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if(storage == MAP_FAILED) {
+		storage = NULL;
+		throw std::runtime_error("Failed to map spill file");
+	}
+}
+
+/*
+ * Returns a tile's index at a given tile x, z coord, or NO_TILE
+ */
+size_t tile_canvas::find_tile(unsigned long long x, unsigned long long z) const {
+	std::map<std::pair<unsigned long long, unsigned long long>, size_t>::const_iterator iter = index.find(std::make_pair(x, z));
+
+	if(iter == index.end()
+			|| !allocated)
+		return NO_TILE;
+	return iter->second;
+}
+
+/*
+ * Read a row span of colors at a given pixel x, z coord (pixels outside
+ * any tile read as the fill color)
+ */
+void tile_canvas::read_colors(unsigned long long x, unsigned long long z, size_t count, unsigned char *colors) {
+	size_t span, tile;
+	unsigned long long end = x + count;
+
+	// copy each tile's part of the span
+	for(; x < end; x += span, colors += span * image_buffer::CHANNELS) {
+		span = std::min((unsigned long long) TILE_WIDTH - x % TILE_WIDTH, end - x);
+		if((tile = find_tile(x / TILE_WIDTH, z / TILE_WIDTH)) != NO_TILE
+				&& tiles.at(tile).color) {
+			memcpy(colors, get_color_row(tile, z % TILE_WIDTH) + (x % TILE_WIDTH) * image_buffer::CHANNELS, span * image_buffer::CHANNELS);
+			continue;
+		}
+		for(size_t i = 0; i < span * image_buffer::CHANNELS; i += image_buffer::CHANNELS) {
+			colors[i] = (unsigned char) (fill >> 24);
+			colors[i + 1] = (unsigned char) (fill >> 16);
+			colors[i + 2] = (unsigned char) (fill >> 8);
+			colors[i + 3] = (unsigned char) fill;
+		}
+	}
+}
+
+/*
+ * Read a row span of heights at a given pixel x, z coord (pixels outside
+ * any tile read as zero)
+ */
+void tile_canvas::read_heights(unsigned long long x, unsigned long long z, size_t count, unsigned int *heights) {
+	size_t span, tile;
+	const unsigned short *row;
+	unsigned long long end = x + count;
+
+	// copy each tile's part of the span
+	for(; x < end; x += span, heights += span) {
+		span = std::min((unsigned long long) TILE_WIDTH - x % TILE_WIDTH, end - x);
+		if((tile = find_tile(x / TILE_WIDTH, z / TILE_WIDTH)) == NO_TILE
+				|| !tiles.at(tile).color) {
+			memset(heights, 0, span * sizeof(unsigned int));
+			continue;
+		}
+		row = get_height_row(tile, z % TILE_WIDTH) + x % TILE_WIDTH;
+		for(size_t i = 0; i < span; ++i)
+			heights[i] = row[i];
+	}
+}
+
+/*
+ * Release a tile's planes (the tile reads as missing afterwards)
+ */
+void tile_canvas::release_tile(size_t tile) {
+	tile_canvas::tile &t = tiles.at(tile);
+
+	// free in-memory planes & drop spilled pages (the spill file keeps its size)
+	if(!t.color)
+		return;
+	if(storage)
+		madvise(t.color, COLOR_SIZE + HEIGHT_SIZE, MADV_DONTNEED);
+	else
+		delete[] t.color;
+	t.color = NULL;
+	t.height = NULL;
+}
+
+/*
+ * Write a canvas to file as a png (with a palette for indexed color)
+ */
+void tile_canvas::write(const std::string &path, const png_writer::options &opt, const color_palette *palette) {
+	png_writer writer(path, width, height, opt, palette);
+	std::vector<unsigned char> row(width * image_buffer::CHANNELS);
+
+	// stream the canvas to the writer row-by-row
+	for(unsigned long long z = 0; z < height; ++z) {
+		read_colors(0, z, width, row.data());
+		writer.write_rows(row.data(), 1);
+	}
+	writer.close();
+}
+
+/*
+ * Write a tile to a tile image (a tile never acquired is left missing)
+ */
+void tile_canvas::write_tile(tile_image::writer &writer, size_t tile) {
+	const tile_canvas::tile &t = tiles.at(tile);
+
+	if(t.color)
+		writer.write_tile(t.x, t.z, t.color, TILE_WIDTH);
+}
+
+/*
+ * Write a canvas to file as a tile image (missing tiles read as the fill color)
+ */
+void tile_canvas::write_tile_image(const std::string &path, unsigned int encoding) {
+	tile_image::writer writer(path, width, height, fill, encoding, TILE_WIDTH);
+
+	// write every tile & finish the file
+	for(size_t i = 0; i < tiles.size(); ++i)
+		write_tile(writer, i);
+	writer.close();
+}
@@ -0,0 +1,207 @@
+/*
+ * tile_canvas.hpp
+ * Copyright (C) 2012 David Jolly
+ * ----------------------
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TILE_CANVAS_HPP_
+#define TILE_CANVAS_HPP_
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+#include "image_buffer.hpp"
+#include "png_writer.hpp"
+#include "tile_image.hpp"
+
+/*
+ * Sparse canvas of fixed-size tiles, each holding an RGBA color plane &
+ * a 16-bit height plane (only tiles that were added are allocated, in memory
+ * or in a disk-backed spill file, each when first acquired & until released)
+ */
+class tile_canvas {
+private:
+
+	/*
+	 * Canvas tile
+	 */
+	class tile {
+	public:
+
+		/*
+		 * Tile x, z coord
+		 */
+		unsigned long long x, z;
+
+		/*
+		 * Color plane (stored with byte-order: RGBA) & height plane
+		 */
+		unsigned char *color;
+		unsigned short *height;
+
+		/*
+		 * Tile constructor
+		 */
+		tile(unsigned long long x, unsigned long long z) : x(x), z(z), color(NULL), height(NULL) { return; }
+	};
+
+	/*
+	 * Canvas width & height (in pixels)
+	 */
+	unsigned long long width, height;
+
+	/*
+	 * Fill color for pixels outside any tile
+	 */
+	unsigned int fill;
+
+	/*
+	 * Canvas tiles & tile indices by tile x, z coord
+	 */
+	std::vector<tile> tiles;
+	std::map<std::pair<unsigned long long, unsigned long long>, size_t> index;
+
+	/*
+	 * Spill file storage (a single block holding every tile, mapped when
+	 * spilling), its size & canvas allocated
+	 */
+	unsigned char *storage;
+	size_t storage_size;
+	bool allocated;
+
+	/*
+	 * Tile canvas constructor (non-copyable)
+	 */
+	tile_canvas(const tile_canvas &other);
+
+	/*
+	 * Tile canvas assignment operator (non-copyable)
+	 */
+	tile_canvas &operator=(const tile_canvas &other);
+
+public:
+
+	/*
+	 * Tile width & plane sizes
+	 */
+	static const unsigned int TILE_WIDTH = 512;
+	static const size_t COLOR_SIZE = TILE_WIDTH * TILE_WIDTH * image_buffer::CHANNELS;
+	static const size_t HEIGHT_SIZE = TILE_WIDTH * TILE_WIDTH * sizeof(unsigned short);
+
+	/*
+	 * Missing tile index
+	 */
+	static const size_t NO_TILE = (size_t) -1;
+
+	/*
+	 * Tile canvas constructor
+	 */
+	tile_canvas(unsigned long long width, unsigned long long height, unsigned int fill) : width(width), height(height), fill(fill),
+			storage(NULL), storage_size(0), allocated(false) { return; }
+
+	/*
+	 * Tile canvas destructor
+	 */
+	virtual ~tile_canvas(void);
+
+	/*
+	 * Acquire a tile's planes, filled with the fill color & zero heights
+	 * (the tile reads as missing until acquired)
+	 */
+	void acquire_tile(size_t tile);
+
+	/*
+	 * Add a tile at a given tile x, z coord (before allocating)
+	 */
+	void add_tile(unsigned long long x, unsigned long long z);
+
+	/*
+	 * Allocate the canvas, in memory or (with a spill directory) in an
+	 * unlinked spill file the system can page to disk (tiles are acquired
+	 * individually afterwards)
+	 */
+	void allocate(const std::string &spill_dir);
+
+	/*
+	 * Returns a tile's index at a given tile x, z coord, or NO_TILE
+	 */
+	size_t find_tile(unsigned long long x, unsigned long long z) const;
+
+	/*
+	 * Returns a tile's color row at a given tile-relative z coord
+	 */
+	unsigned char *get_color_row(size_t tile, unsigned int z) { return tiles.at(tile).color + (size_t) z * TILE_WIDTH * image_buffer::CHANNELS; }
+
+	/*
+	 * Returns a canvas' height (in pixels)
+	 */
+	unsigned long long get_height(void) { return height; }
+
+	/*
+	 * Returns a tile's height row at a given tile-relative z coord
+	 */
+	unsigned short *get_height_row(size_t tile, unsigned int z) { return tiles.at(tile).height + (size_t) z * TILE_WIDTH; }
+
+	/*
+	 * Returns a canvas' tile count
+	 */
+	size_t get_tile_count(void) { return tiles.size(); }
+
+	/*
+	 * Returns a tile's z coord
+	 */
+	unsigned long long get_tile_z(size_t tile) { return tiles.at(tile).z; }
+
+	/*
+	 * Returns a canvas' width (in pixels)
+	 */
+	unsigned long long get_width(void) { return width; }
+
+	/*
+	 * Read a row span of colors at a given pixel x, z coord (pixels outside
+	 * any tile read as the fill color)
+	 */
+	void read_colors(unsigned long long x, unsigned long long z, size_t count, unsigned char *colors);
+
+	/*
+	 * Read a row span of heights at a given pixel x, z coord (pixels outside
+	 * any tile read as zero)
+	 */
+	void read_heights(unsigned long long x, unsigned long long z, size_t count, unsigned int *heights);
+
+	/*
+	 * Release a tile's planes (the tile reads as missing afterwards)
+	 */
+	void release_tile(size_t tile);
+
+	/*
+	 * Write a canvas to file as a png (with a palette for indexed color)
+	 */
+	void write(const std::string &path, const png_writer::options &opt, const color_palette *palette = NULL);
+
+	/*
+	 * Write a tile to a tile image (a tile never acquired is left missing)
+	 */
+	void write_tile(tile_image::writer &writer, size_t tile);
+
+	/*
+	 * Write a canvas to file as a tile image (missing tiles read as the fill color)
+	 */
+	void write_tile_image(const std::string &path, unsigned int encoding = tile_image::QOI_ENCODING);
+};
+
+#endif
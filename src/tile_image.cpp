@@ -0,0 +1,463 @@
+/*
+ * tile_image.cpp
+ * Copyright (C) 2012 David Jolly
+ * ----------------------
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "tile_image.hpp"
+
+/*
+ * Tile image file extension
+ */
+const std::string tile_image::EXTENSION(".cti");
+
+/*
+ * Tile image magic
+ */
+static const char MAGIC[] = { 'C', 'T', 'I', 'L' };
+
+/*
+ * Reader constructor (maps & validates the file)
+ */
+tile_image::reader::reader(const std::string &path) : data(NULL), size(0), width(0), height(0), tile_width(0), fill(0), entries(0),
+		count(0) {
+	int fd;
+	void *map;
+	struct stat info;
+	const unsigned char *entry;
+	unsigned int x, z;
+	unsigned long long offset, length, tile_w, tile_h;
+
+	// map file
+	if((fd = ::open(path.c_str(), O_RDONLY)) < 0)
+		throw std::runtime_error("Failed to open tile image");
+	if(fstat(fd, &info)
+			|| info.st_size < (off_t) HEADER_SIZE) {
+		::close(fd);
+		throw std::runtime_error("Invalid tile image");
+	}
+	size = info.st_size;
+	map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if(map == MAP_FAILED)
+		throw std::runtime_error("Failed to map tile image");
+	data = (const unsigned char *) map;
+
+	// read header
+	width = get_value(data + 8, 8);
+	height = get_value(data + 16, 8);
+	tile_width = get_value(data + 24, 4);
+	fill = get_value(data + 28, 4);
+	count = get_value(data + 32, 8);
+	entries = get_value(data + 40, 8);
+	if(memcmp(data, MAGIC, sizeof(MAGIC))
+			|| get_value(data + 4, 4) != VERSION
+			|| !width
+			|| !height
+			|| !tile_width
+			|| entries < HEADER_SIZE
+			|| entries > size
+			|| count > (size - entries) / ENTRY_SIZE) {
+		munmap((void *) data, size);
+		throw std::runtime_error("Invalid tile image");
+	}
+
+	// index tiles (each must lie within the image & the file, raw tiles must
+	// hold every pixel)
+	for(size_t i = 0; i < count; ++i) {
+		entry = get_entry(i);
+		x = get_value(entry, 4);
+		z = get_value(entry + 4, 4);
+		offset = get_value(entry + 16, 8);
+		length = get_value(entry + 24, 8);
+		if((unsigned long long) x * tile_width >= width
+				|| (unsigned long long) z * tile_width >= height
+				|| get_value(entry + 8, 4) >= ENCODING_COUNT
+				|| offset > size
+				|| length > size - offset
+				|| !index.insert(std::make_pair(std::make_pair(x, z), i)).second) {
+			munmap((void *) data, size);
+			throw std::runtime_error("Invalid tile image index");
+		}
+		tile_w = std::min((unsigned long long) tile_width, width - (unsigned long long) x * tile_width);
+		tile_h = std::min((unsigned long long) tile_width, height - (unsigned long long) z * tile_width);
+		if(get_value(entry + 8, 4) == RAW_ENCODING
+				&& (offset % CHANNELS
+				|| length != tile_w * tile_h * CHANNELS)) {
+			munmap((void *) data, size);
+			throw std::runtime_error("Invalid tile image index");
+		}
+	}
+}
+
+/*
+ * Reader destructor
+ */
+tile_image::reader::~reader(void) {
+	munmap((void *) data, size);
+}
+
+/*
+ * Returns a tile's index at a given tile x, z coord, or NO_TILE
+ */
+size_t tile_image::reader::find_tile(unsigned int x, unsigned int z) const {
+	std::map<std::pair<unsigned int, unsigned int>, size_t>::const_iterator iter = index.find(std::make_pair(x, z));
+
+	if(iter == index.end())
+		return NO_TILE;
+	return iter->second;
+}
+
+/*
+ * Returns a tile's index entry
+ */
+const unsigned char *tile_image::reader::get_entry(size_t tile) const {
+
+	// check for valid tile
+	if(tile >= count)
+		throw std::out_of_range("Tile out-of-range");
+	return data + entries + tile * ENTRY_SIZE;
+}
+
+/*
+ * Returns a raw tile's pixels within the mapped file, or NULL for coded tiles
+ */
+const unsigned char *tile_image::reader::get_raw_tile(size_t tile) const {
+	const unsigned char *entry = get_entry(tile);
+
+	if(get_value(entry + 8, 4) != RAW_ENCODING)
+		return NULL;
+	return data + get_value(entry + 16, 8);
+}
+
+/*
+ * Read a band (row of tiles) of pixels at a given tile z coord, a tile
+ * width of rows (fewer for the last band) by the image width
+ */
+void tile_image::reader::read_band(unsigned int z, unsigned char *px) const {
+	size_t tile;
+	unsigned char color[CHANNELS];
+	unsigned long long rows, cols, tiles = (width + tile_width - 1) / tile_width;
+
+	// check for valid band
+	if((unsigned long long) z * tile_width >= height)
+		throw std::out_of_range("Band out-of-range");
+	rows = std::min((unsigned long long) tile_width, height - (unsigned long long) z * tile_width);
+	for(unsigned int i = 0; i < CHANNELS; ++i)
+		color[i] = (unsigned char) (fill >> (24 - i * 8));
+
+	// read each tile into place (missing tiles read as the fill color)
+	for(unsigned int x = 0; x < tiles; ++x) {
+		if((tile = find_tile(x, z)) != NO_TILE) {
+			read_tile(tile, px + (size_t) x * tile_width * CHANNELS, width);
+			continue;
+		}
+		cols = std::min((unsigned long long) tile_width, width - (unsigned long long) x * tile_width);
+		for(unsigned long long j = 0; j < rows; ++j)
+			for(unsigned long long i = 0; i < cols; ++i)
+				memcpy(px + ((j * width) + (unsigned long long) x * tile_width + i) * CHANNELS, color, CHANNELS);
+	}
+}
+
+/*
+ * Read a tile's pixels (its width & height clipped by the image, rows
+ * spaced by a given pixel stride)
+ */
+void tile_image::reader::read_tile(size_t tile, unsigned char *px, size_t stride) const {
+	const unsigned char *entry = get_entry(tile), *tile_data;
+	unsigned int tile_w, tile_h;
+
+	// size tile
+	tile_w = std::min((unsigned long long) tile_width, width - get_value(entry, 4) * tile_width);
+	tile_h = std::min((unsigned long long) tile_width, height - get_value(entry + 4, 4) * tile_width);
+	tile_data = data + get_value(entry + 16, 8);
+
+	// copy raw rows or decode coded rows
+	if(get_value(entry + 8, 4) == QOI_ENCODING) {
+		decode(tile_data, get_value(entry + 24, 8), tile_w, tile_h, stride, px);
+		return;
+	}
+	for(unsigned int z = 0; z < tile_h; ++z)
+		memcpy(px + z * stride * CHANNELS, tile_data + (size_t) z * tile_w * CHANNELS, (size_t) tile_w * CHANNELS);
+}
+
+/*
+ * Writer constructor
+ */
+tile_image::writer::writer(const std::string &path, unsigned long long width, unsigned long long height, unsigned int fill,
+		unsigned int encoding, unsigned int tile_width) : position(HEADER_SIZE), width(width), height(height), tile_width(tile_width),
+		fill(fill), encoding(encoding), open(false) {
+	static const char HEADER[HEADER_SIZE] = { 0 };
+
+	// check for valid dimensions & encoding (tiles coords are 32-bit)
+	if(!width
+			|| !height
+			|| !tile_width
+			|| (width - 1) / tile_width > 0xffffffff
+			|| (height - 1) / tile_width > 0xffffffff)
+		throw std::out_of_range("Tile image dimensions out-of-range");
+	if(encoding >= ENCODING_COUNT)
+		throw std::out_of_range("Tile image encoding out-of-range");
+
+	// open file, leaving room for the header
+	file.open(path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	if(!file.is_open())
+		throw std::runtime_error("Failed to open output file");
+	file.write(HEADER, HEADER_SIZE);
+	if(!file.good())
+		throw std::runtime_error("Failed to write tile image");
+	open = true;
+}
+
+/*
+ * Write the tile index & header (tiles never written read as the fill color)
+ */
+void tile_image::writer::close(void) {
+	std::vector<unsigned char> header;
+
+	// check writer state
+	if(!open)
+		throw std::runtime_error("Tile image writer already closed");
+	open = false;
+
+	// write the index after the last tile, then the header
+	file.write((const char *) entries.data(), entries.size());
+	header.insert(header.end(), MAGIC, MAGIC + sizeof(MAGIC));
+	put_value(header, VERSION, 4);
+	put_value(header, width, 8);
+	put_value(header, height, 8);
+	put_value(header, tile_width, 4);
+	put_value(header, fill, 4);
+	put_value(header, written.size(), 8);
+	put_value(header, position, 8);
+	file.seekp(0);
+	file.write((const char *) header.data(), header.size());
+	file.close();
+	if(file.fail())
+		throw std::runtime_error("Failed to write tile image");
+}
+
+/*
+ * Write a tile's pixels at a given tile x, z coord (its width & height
+ * clipped by the image, rows spaced by a given pixel stride)
+ */
+void tile_image::writer::write_tile(unsigned int x, unsigned int z, const unsigned char *px, size_t stride) {
+	size_t length = 0;
+	unsigned int tile_w, tile_h, tile_encoding = encoding;
+	static const char PADDING[TILE_ALIGN] = { 0 };
+
+	// check writer state & tile
+	if(!open)
+		throw std::runtime_error("Tile image writer closed");
+	if((unsigned long long) x * tile_width >= width
+			|| (unsigned long long) z * tile_width >= height)
+		throw std::out_of_range("Tile out-of-range");
+	if(!written.insert(std::make_pair(x, z)).second)
+		throw std::runtime_error("Tile already written");
+	tile_w = std::min((unsigned long long) tile_width, width - (unsigned long long) x * tile_width);
+	tile_h = std::min((unsigned long long) tile_width, height - (unsigned long long) z * tile_width);
+
+	// code the tile (stored raw when coding does not shrink it)
+	if(tile_encoding == QOI_ENCODING
+			&& (length = encode(px, tile_w, tile_h, stride, data)) >= (size_t) tile_w * tile_h * CHANNELS)
+		tile_encoding = RAW_ENCODING;
+	if(tile_encoding == RAW_ENCODING) {
+		length = (size_t) tile_w * tile_h * CHANNELS;
+		data.resize(length);
+		for(unsigned int j = 0; j < tile_h; ++j)
+			memcpy(data.data() + (size_t) j * tile_w * CHANNELS, px + j * stride * CHANNELS, (size_t) tile_w * CHANNELS);
+	}
+
+	// write the tile data (aligned) & its index entry
+	if(position % TILE_ALIGN) {
+		file.write(PADDING, TILE_ALIGN - position % TILE_ALIGN);
+		position += TILE_ALIGN - position % TILE_ALIGN;
+	}
+	file.write((const char *) data.data(), length);
+	if(!file.good())
+		throw std::runtime_error("Failed to write tile image");
+	put_value(entries, x, 4);
+	put_value(entries, z, 4);
+	put_value(entries, tile_encoding, 4);
+	put_value(entries, 0, 4);
+	put_value(entries, position, 8);
+	put_value(entries, length, 8);
+	position += length;
+}
+
+/*
+ * Decode a QOI-style coded tile's pixels (rows spaced by a given pixel stride)
+ */
+void tile_image::decode(const unsigned char *data, size_t length, unsigned int width, unsigned int height, size_t stride, unsigned char *px) {
+	int diff;
+	size_t pos = 0, bytes;
+	unsigned int op, run = 0;
+	unsigned char *out, pixel[CHANNELS] = { 0, 0, 0, 0xff }, recent[RECENT_COUNT][CHANNELS] = { { 0 } };
+
+	for(unsigned int z = 0; z < height; ++z) {
+		out = px + z * stride * CHANNELS;
+		for(unsigned int x = 0; x < width; ++x, out += CHANNELS) {
+
+			// repeat the last pixel through a run
+			if(run) {
+				--run;
+				memcpy(out, pixel, CHANNELS);
+				continue;
+			}
+
+			// decode the next op
+			if(pos >= length)
+				throw std::runtime_error("Tile image data truncated");
+			op = data[pos++];
+			if(op == RGB_OP
+					|| op == RGBA_OP) {
+				bytes = (op == RGB_OP) ? CHANNELS - 1 : CHANNELS;
+				if(length - pos < bytes)
+					throw std::runtime_error("Tile image data truncated");
+				memcpy(pixel, data + pos, bytes);
+				pos += bytes;
+			} else {
+				switch(op & OP_MASK) {
+					case INDEX_OP:
+						memcpy(pixel, recent[op], CHANNELS);
+						break;
+					case DIFF_OP:
+						pixel[0] += ((op >> 4) & 0x3) - 2;
+						pixel[1] += ((op >> 2) & 0x3) - 2;
+						pixel[2] += (op & 0x3) - 2;
+						break;
+					case LUMA_OP:
+						if(pos >= length)
+							throw std::runtime_error("Tile image data truncated");
+						diff = (int) (op & 0x3f) - 32;
+						pixel[0] += diff - 8 + ((data[pos] >> 4) & 0xf);
+						pixel[1] += diff;
+						pixel[2] += diff - 8 + (data[pos] & 0xf);
+						++pos;
+						break;
+					case RUN_OP:
+						run = op & 0x3f;
+						break;
+				}
+			}
+			memcpy(recent[hash(pixel)], pixel, CHANNELS);
+			memcpy(out, pixel, CHANNELS);
+		}
+	}
+}
+
+/*
+ * Encode a tile's pixels with QOI-style ops (rows spaced by a given pixel
+ * stride), returning the coded length
+ */
+size_t tile_image::encode(const unsigned char *px, unsigned int width, unsigned int height, size_t stride, std::vector<unsigned char> &data) {
+	int dr, dg, db;
+	unsigned int run = 0, slot;
+	const unsigned char *in;
+	unsigned char *out, prev[CHANNELS] = { 0, 0, 0, 0xff }, recent[RECENT_COUNT][CHANNELS] = { { 0 } };
+
+	// size for the worst case (every pixel written whole)
+	data.resize((size_t) width * height * (CHANNELS + 1));
+	out = data.data();
+	for(unsigned int z = 0; z < height; ++z) {
+		in = px + z * stride * CHANNELS;
+		for(unsigned int x = 0; x < width; ++x, in += CHANNELS) {
+
+			// extend a run of the last pixel
+			if(!memcmp(in, prev, CHANNELS)) {
+				if(++run == MAX_RUN) {
+					*out++ = RUN_OP | (run - 1);
+					run = 0;
+				}
+				continue;
+			}
+			if(run) {
+				*out++ = RUN_OP | (run - 1);
+				run = 0;
+			}
+
+			// write a recent pixel's slot, a small difference from the last
+			// pixel or the pixel whole
+			slot = hash(in);
+			if(!memcmp(recent[slot], in, CHANNELS))
+				*out++ = INDEX_OP | slot;
+			else {
+				memcpy(recent[slot], in, CHANNELS);
+				if(in[3] == prev[3]) {
+					dr = (signed char) (in[0] - prev[0]);
+					dg = (signed char) (in[1] - prev[1]);
+					db = (signed char) (in[2] - prev[2]);
+					if(dr >= -2 && dr <= 1
+							&& dg >= -2 && dg <= 1
+							&& db >= -2 && db <= 1)
+						*out++ = DIFF_OP | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2);
+					else if(dg >= -32 && dg <= 31
+							&& dr - dg >= -8 && dr - dg <= 7
+							&& db - dg >= -8 && db - dg <= 7) {
+						*out++ = LUMA_OP | (dg + 32);
+						*out++ = ((dr - dg + 8) << 4) | (db - dg + 8);
+					} else {
+						*out++ = RGB_OP;
+						memcpy(out, in, CHANNELS - 1);
+						out += CHANNELS - 1;
+					}
+				} else {
+					*out++ = RGBA_OP;
+					memcpy(out, in, CHANNELS);
+					out += CHANNELS;
+				}
+			}
+			memcpy(prev, in, CHANNELS);
+		}
+	}
+	if(run)
+		*out++ = RUN_OP | (run - 1);
+	return out - data.data();
+}
+
+/*
+ * Returns a little-endian value
+ */
+unsigned long long tile_image::get_value(const unsigned char *data, unsigned int bytes) {
+	unsigned long long value = 0;
+
+	for(unsigned int i = 0; i < bytes; ++i)
+		value |= (unsigned long long) data[i] << (i * 8);
+	return value;
+}
+
+/*
+ * Returns true if a path names a tile image (by extension)
+ */
+bool tile_image::is_tile_image(const std::string &path) {
+	return path.size() > EXTENSION.size()
+			&& !path.compare(path.size() - EXTENSION.size(), EXTENSION.size(), EXTENSION);
+}
+
+/*
+ * Append a little-endian value
+ */
+void tile_image::put_value(std::vector<unsigned char> &data, unsigned long long value, unsigned int bytes) {
+	for(unsigned int i = 0; i < bytes; ++i)
+		data.push_back((unsigned char) (value >> (i * 8)));
+}
@@ -0,0 +1,278 @@
+/*
+ * tile_image.hpp
+ * Copyright (C) 2012 David Jolly
+ * ----------------------
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TILE_IMAGE_HPP_
+#define TILE_IMAGE_HPP_
+
+#include <fstream>
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+/*
+ * Fast lossless tiled RGBA image format for intermediate artifacts (a header,
+ * sparse tiles in any order & a trailing tile index; missing tiles read as
+ * the fill color). Tiles are stored raw (addressable straight from the mapped
+ * file) or coded with QOI-style ops, each tile coded independently.
+ *
+ * Layout (little-endian):
+ *   header: magic "CTIL", version (u32), width (u64), height (u64),
+ *           tile width (u32), fill color (u32, RGBA), tile count (u64),
+ *           index offset (u64)
+ *   tiles:  tile data, each aligned to TILE_ALIGN bytes
+ *   index:  per tile: x (u32), z (u32), encoding (u32), reserved (u32),
+ *           data offset (u64), data length (u64)
+ */
+class tile_image {
+public:
+
+	/*
+	 * Tile encodings
+	 */
+	enum ENCODING { RAW_ENCODING, QOI_ENCODING };
+	static const unsigned int ENCODING_COUNT = 2;
+
+	/*
+	 * Tile image constants
+	 */
+	static const unsigned int CHANNELS = 4;
+	static const unsigned int VERSION = 1;
+	static const unsigned int DEF_TILE_WIDTH = 512;
+	static const size_t HEADER_SIZE = 48;
+	static const size_t ENTRY_SIZE = 32;
+	static const size_t TILE_ALIGN = 16;
+	static const size_t NO_TILE = (size_t) -1;
+	static const std::string EXTENSION;
+
+	/*
+	 * Tile image reader (maps the file, decoding tiles on demand)
+	 */
+	class reader {
+	private:
+
+		/*
+		 * Mapped file & its size
+		 */
+		const unsigned char *data;
+		size_t size;
+
+		/*
+		 * Image width & height (in pixels), tile width & fill color
+		 */
+		unsigned long long width, height;
+		unsigned int tile_width, fill;
+
+		/*
+		 * Tile indices by tile x, z coord
+		 */
+		std::map<std::pair<unsigned int, unsigned int>, size_t> index;
+
+		/*
+		 * Tile index offset & tile count
+		 */
+		size_t entries, count;
+
+		/*
+		 * Returns a tile's index entry
+		 */
+		const unsigned char *get_entry(size_t tile) const;
+
+		/*
+		 * Reader constructor (non-copyable)
+		 */
+		reader(const reader &other);
+
+		/*
+		 * Reader assignment operator (non-copyable)
+		 */
+		reader &operator=(const reader &other);
+
+	public:
+
+		/*
+		 * Reader constructor (maps & validates the file)
+		 */
+		reader(const std::string &path);
+
+		/*
+		 * Reader destructor
+		 */
+		virtual ~reader(void);
+
+		/*
+		 * Returns a tile's index at a given tile x, z coord, or NO_TILE
+		 */
+		size_t find_tile(unsigned int x, unsigned int z) const;
+
+		/*
+		 * Returns an image's fill color (RGBA)
+		 */
+		unsigned int get_fill(void) const { return fill; }
+
+		/*
+		 * Returns an image's height (in pixels)
+		 */
+		unsigned long long get_height(void) const { return height; }
+
+		/*
+		 * Returns a raw tile's pixels within the mapped file, or NULL for coded tiles
+		 */
+		const unsigned char *get_raw_tile(size_t tile) const;
+
+		/*
+		 * Returns an image's tile count
+		 */
+		size_t get_tile_count(void) const { return count; }
+
+		/*
+		 * Returns an image's tile width
+		 */
+		unsigned int get_tile_width(void) const { return tile_width; }
+
+		/*
+		 * Returns an image's width (in pixels)
+		 */
+		unsigned long long get_width(void) const { return width; }
+
+		/*
+		 * Read a band (row of tiles) of pixels at a given tile z coord, a tile
+		 * width of rows (fewer for the last band) by the image width
+		 */
+		void read_band(unsigned int z, unsigned char *px) const;
+
+		/*
+		 * Read a tile's pixels (its width & height clipped by the image, rows
+		 * spaced by a given pixel stride)
+		 */
+		void read_tile(size_t tile, unsigned char *px, size_t stride) const;
+	};
+
+	/*
+	 * Tile image writer (tiles are written as they arrive, in any order)
+	 */
+	class writer {
+	private:
+
+		/*
+		 * Output file & write position
+		 */
+		std::ofstream file;
+		unsigned long long position;
+
+		/*
+		 * Image width & height (in pixels), tile width, fill color & tile encoding
+		 */
+		unsigned long long width, height;
+		unsigned int tile_width, fill, encoding;
+
+		/*
+		 * Tile index, tiles written & tile data
+		 */
+		std::vector<unsigned char> entries, data;
+		std::set<std::pair<unsigned int, unsigned int>> written;
+
+		/*
+		 * Writer open
+		 */
+		bool open;
+
+		/*
+		 * Writer constructor (non-copyable)
+		 */
+		writer(const writer &other);
+
+		/*
+		 * Writer assignment operator (non-copyable)
+		 */
+		writer &operator=(const writer &other);
+
+	public:
+
+		/*
+		 * Writer constructor
+		 */
+		writer(const std::string &path, unsigned long long width, unsigned long long height, unsigned int fill,
+				unsigned int encoding = QOI_ENCODING, unsigned int tile_width = DEF_TILE_WIDTH);
+
+		/*
+		 * Writer destructor
+		 */
+		virtual ~writer(void) { return; }
+
+		/*
+		 * Write the tile index & header (tiles never written read as the fill color)
+		 */
+		void close(void);
+
+		/*
+		 * Write a tile's pixels at a given tile x, z coord (its width & height
+		 * clipped by the image, rows spaced by a given pixel stride)
+		 */
+		void write_tile(unsigned int x, unsigned int z, const unsigned char *px, size_t stride);
+	};
+
+	/*
+	 * Decode a QOI-style coded tile's pixels (rows spaced by a given pixel stride)
+	 */
+	static void decode(const unsigned char *data, size_t length, unsigned int width, unsigned int height, size_t stride, unsigned char *px);
+
+	/*
+	 * Encode a tile's pixels with QOI-style ops (rows spaced by a given pixel
+	 * stride), returning the coded length
+	 */
+	static size_t encode(const unsigned char *px, unsigned int width, unsigned int height, size_t stride, std::vector<unsigned char> &data);
+
+	/*
+	 * Returns true if a path names a tile image (by extension)
+	 */
+	static bool is_tile_image(const std::string &path);
+
+private:
+
+	/*
+	 * QOI-style ops
+	 */
+	enum OP { INDEX_OP = 0x00, DIFF_OP = 0x40, LUMA_OP = 0x80, RUN_OP = 0xc0, RGB_OP = 0xfe, RGBA_OP = 0xff };
+
+	/*
+	 * QOI-style op constants (the 2-bit op mask, longest run & recent pixel count)
+	 */
+	static const unsigned int OP_MASK = 0xc0;
+	static const unsigned int MAX_RUN = 62;
+	static const unsigned int RECENT_COUNT = 64;
+
+	/*
+	 * Returns a little-endian value
+	 */
+	static unsigned long long get_value(const unsigned char *data, unsigned int bytes);
+
+	/*
+	 * Returns a pixel's recent pixel slot
+	 */
+	static unsigned int hash(const unsigned char *px) { return (px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) % RECENT_COUNT; }
+
+	/*
+	 * Append a little-endian value
+	 */
+	static void put_value(std::vector<unsigned char> &data, unsigned long long value, unsigned int bytes);
+};
+
+#endif
@@ -0,0 +1,277 @@
+/*
+ * tile_pyramid.cpp
+ * Copyright (C) 2012 David Jolly
+ * ----------------------
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <boost/filesystem.hpp>
+#include <cstring>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include "tile_pyramid.hpp"
+
+/*
+ * Tile pyramid constructor (tiles are encoded in parallel, each on a
+ * single thread)
+ */
+tile_pyramid::tile_pyramid(const std::string &dir, unsigned long long width, unsigned long long height, unsigned int fill,
+		const png_writer::options &opt) : dir(dir), fill(fill), opt(opt), rows(0), open(false), zoom(0), next(0) {
+	unsigned int max_zoom = 0;
+
+	// check for valid dimensions
+	if(!width
+			|| !height
+			|| width > 0x7fffffff
+			|| height > 0x7fffffff)
+		throw std::out_of_range("Tile pyramid dimensions out-of-range");
+
+	// find the deepest zoom (the shallowest at which one tile covers the image)
+	while(((unsigned long long) TILE_WIDTH << max_zoom) < std::max(width, height))
+		++max_zoom;
+
+	// size each zoom (halving the zoom below it), each holding a row of tiles
+	for(unsigned int i = 0; i <= max_zoom; ++i) {
+		levels.push_back(level((width + (1ull << (max_zoom - i)) - 1) >> (max_zoom - i),
+				(height + (1ull << (max_zoom - i)) - 1) >> (max_zoom - i)));
+		levels.back().px.resize(levels.back().columns * TILE_WIDTH * TILE_WIDTH * CHANNELS);
+		fill_rows(levels.back(), 0, TILE_WIDTH);
+	}
+
+	// encode each tile on a single thread
+	threads = opt.threads ? opt.threads : std::thread::hardware_concurrency();
+	if(!threads)
+		threads = 1;
+	this->opt.threads = 1;
+
+	// create output directory
+	boost::filesystem::create_directories(dir);
+	open = true;
+}
+
+/*
+ * Write the remaining rows of tiles (every row must be written)
+ */
+void tile_pyramid::close(void) {
+
+	// check writer state
+	if(!open)
+		throw std::runtime_error("Tile pyramid already closed");
+	if(rows != levels.back().height)
+		throw std::runtime_error("Tile pyramid rows missing");
+	open = false;
+
+	// pad each zoom's partial row of tiles, deepest first (each write fills
+	// the zoom above it)
+	for(unsigned int i = levels.size(); i > 0; --i)
+		if(levels.at(i - 1).rows) {
+			fill_rows(levels.at(i - 1), levels.at(i - 1).rows, TILE_WIDTH - levels.at(i - 1).rows);
+			levels.at(i - 1).rows = TILE_WIDTH;
+			flush_level(i - 1);
+		}
+}
+
+/*
+ * Box filter a pair of rows into a row of half the width
+ */
+void tile_pyramid::downsample_row(const unsigned char *above, const unsigned char *below, size_t count, unsigned char *out) {
+	for(size_t x = 0; x < count; ++x, above += CHANNELS * 2, below += CHANNELS * 2, out += CHANNELS)
+		for(unsigned int i = 0; i < CHANNELS; ++i)
+			out[i] = (above[i] + above[i + CHANNELS] + below[i] + below[i + CHANNELS] + 2) >> 2;
+}
+
+#ifdef __SSE2__
+/*
+ * Box filter a pair of rows into a row of half the width, four pixels at a time
+ */
+void tile_pyramid::downsample_row_sse2(const unsigned char *above, const unsigned char *below, size_t count, unsigned char *out) {
+	size_t x = 0;
+	__m128i left, right, first, second, zero = _mm_setzero_si128(), two = _mm_set1_epi16(2);
+
+	for(; x + 4 <= count; x += 4) {
+
+		// sum each pixel's rows (16-bit channels), then each pair of pixels
+		// (the low halves hold the even pixels, the high halves the odd ones)
+		left = _mm_loadu_si128(reinterpret_cast<const __m128i *>(above + x * CHANNELS * 2));
+		right = _mm_loadu_si128(reinterpret_cast<const __m128i *>(below + x * CHANNELS * 2));
+		first = _mm_add_epi16(_mm_unpacklo_epi8(left, zero), _mm_unpacklo_epi8(right, zero));
+		second = _mm_add_epi16(_mm_unpackhi_epi8(left, zero), _mm_unpackhi_epi8(right, zero));
+		first = _mm_add_epi16(_mm_unpacklo_epi64(first, second), _mm_unpackhi_epi64(first, second));
+		left = _mm_loadu_si128(reinterpret_cast<const __m128i *>(above + x * CHANNELS * 2 + 16));
+		right = _mm_loadu_si128(reinterpret_cast<const __m128i *>(below + x * CHANNELS * 2 + 16));
+		second = _mm_add_epi16(_mm_unpacklo_epi8(left, zero), _mm_unpacklo_epi8(right, zero));
+		left = _mm_add_epi16(_mm_unpackhi_epi8(left, zero), _mm_unpackhi_epi8(right, zero));
+		second = _mm_add_epi16(_mm_unpacklo_epi64(second, left), _mm_unpackhi_epi64(second, left));
+
+		// average (rounded) & pack
+		first = _mm_srli_epi16(_mm_add_epi16(first, two), 2);
+		second = _mm_srli_epi16(_mm_add_epi16(second, two), 2);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(out + x * CHANNELS), _mm_packus_epi16(first, second));
+	}
+	downsample_row(above + x * CHANNELS * 2, below + x * CHANNELS * 2, count - x, out + x * CHANNELS);
+}
+#endif
+
+/*
+ * Fill a level's rows with the fill color
+ */
+void tile_pyramid::fill_rows(level &lev, size_t first, size_t count) {
+	unsigned char color[CHANNELS];
+	size_t length = count * lev.columns * TILE_WIDTH;
+	unsigned char *out = lev.px.data() + first * lev.columns * TILE_WIDTH * CHANNELS;
+
+	for(unsigned int i = 0; i < CHANNELS; ++i)
+		color[i] = (unsigned char) (fill >> (24 - i * 8));
+	for(size_t i = 0; i < length; ++i)
+		memcpy(out + i * CHANNELS, color, CHANNELS);
+}
+
+/*
+ * Write a zoom's full row of tiles, box filtering it into the zoom above
+ */
+void tile_pyramid::flush_level(unsigned int zoom) {
+	std::stringstream path;
+	std::vector<std::thread> workers;
+	level &lev = levels.at(zoom);
+	size_t stride = lev.columns * TILE_WIDTH * CHANNELS;
+
+	// write the tiles holding data, on the calling thread & workers
+	tiles.clear();
+	for(size_t x = 0; x < lev.columns; ++x)
+		if(lev.present.at(x)) {
+			path.str(std::string());
+			path << dir << "/" << zoom << "/" << x;
+			boost::filesystem::create_directories(path.str());
+			tiles.push_back(x);
+		}
+	this->zoom = zoom;
+	next = 0;
+	for(unsigned int i = 1; i < std::min((size_t) threads, tiles.size()); ++i)
+		workers.push_back(std::thread(&tile_pyramid::run, this));
+	run();
+	for(unsigned int i = 0; i < workers.size(); ++i)
+		workers.at(i).join();
+	if(!error.empty())
+		throw std::runtime_error(error);
+
+	// box filter the row of tiles into the zoom above (its tile columns pair
+	// with this zoom's), writing it once full
+	if(zoom) {
+		level &above = levels.at(zoom - 1);
+		size_t above_stride = above.columns * TILE_WIDTH * CHANNELS;
+		void (*kernel)(const unsigned char *, const unsigned char *, size_t, unsigned char *) = &downsample_row;
+
+#ifdef __SSE2__
+		kernel = &downsample_row_sse2;
+#endif
+		for(size_t z = 0; z < TILE_WIDTH / 2; ++z)
+			kernel(&lev.px[z * 2 * stride], &lev.px[(z * 2 + 1) * stride], lev.columns * TILE_WIDTH / 2,
+					&above.px[(above.rows + z) * above_stride]);
+		for(size_t x = 0; x < lev.columns; ++x)
+			if(lev.present.at(x))
+				above.present.at(x / 2) = true;
+		above.rows += TILE_WIDTH / 2;
+	}
+	lev.rows = 0;
+	++lev.y;
+	lev.present.assign(lev.columns, false);
+	if(zoom
+			&& levels.at(zoom - 1).rows == TILE_WIDTH)
+		flush_level(zoom - 1);
+}
+
+/*
+ * Worker thread entry point (writes claimed tiles)
+ */
+void tile_pyramid::run(void) {
+	size_t index;
+
+	for(;;) {
+
+		// claim the next tile
+		lock.lock();
+		if(next >= tiles.size()
+				|| !error.empty()) {
+			lock.unlock();
+			break;
+		}
+		index = next++;
+		lock.unlock();
+
+		// write the tile (recording the first failure)
+		try {
+			write_tile(zoom, tiles.at(index));
+		} catch(std::exception &exc) {
+			lock.lock();
+			if(error.empty())
+				error = exc.what();
+			lock.unlock();
+		}
+	}
+}
+
+/*
+ * Write a series of native RGBA rows, with the native tile columns they
+ * hold data for
+ */
+void tile_pyramid::write_rows(const unsigned char *data, size_t count, const std::vector<char> &present) {
+	size_t length;
+	level &lev = levels.back();
+	size_t width = lev.width * CHANNELS, stride = lev.columns * TILE_WIDTH * CHANNELS;
+
+	// check writer state & rows
+	if(!open)
+		throw std::runtime_error("Tile pyramid closed");
+	if(count > lev.height - rows)
+		throw std::out_of_range("Tile pyramid rows out-of-range");
+	if(present.size() != lev.columns)
+		throw std::runtime_error("Tile pyramid columns mismatch");
+
+	// fill the row of tiles, writing it once full
+	while(count) {
+		length = std::min(count, TILE_WIDTH - lev.rows);
+		for(size_t z = 0; z < length; ++z)
+			memcpy(&lev.px[(lev.rows + z) * stride], data + z * width, width);
+		for(size_t x = 0; x < lev.columns; ++x)
+			if(present.at(x))
+				lev.present.at(x) = true;
+		lev.rows += length;
+		rows += length;
+		data += length * width;
+		count -= length;
+		if(lev.rows == TILE_WIDTH)
+			flush_level(levels.size() - 1);
+	}
+}
+
+/*
+ * Write a tile of a zoom's row of tiles
+ */
+void tile_pyramid::write_tile(unsigned int zoom, size_t column) {
+	std::stringstream path;
+	const level &lev = levels.at(zoom);
+	size_t stride = lev.columns * TILE_WIDTH * CHANNELS;
+
+	path << dir << "/" << zoom << "/" << column << "/" << lev.y << ".png";
+	png_writer writer(path.str(), TILE_WIDTH, TILE_WIDTH, opt);
+	for(size_t z = 0; z < TILE_WIDTH; ++z)
+		writer.write_rows(&lev.px[z * stride + column * TILE_WIDTH * CHANNELS], 1);
+	writer.close();
+}
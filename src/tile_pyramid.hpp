@@ -0,0 +1,186 @@
+/*
+ * tile_pyramid.hpp
+ * Copyright (C) 2012 David Jolly
+ * ----------------------
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TILE_PYRAMID_HPP_
+#define TILE_PYRAMID_HPP_
+
+#include <mutex>
+#include <string>
+#include <vector>
+#include "png_writer.hpp"
+
+/*
+ * Streaming z/x/y png tile pyramid writer (slippy map layout: DIR/Z/X/Y.png,
+ * the deepest zoom at native resolution & zoom 0 a single tile). Rows arrive
+ * at native resolution; each zoom holds a single row of tiles, written once
+ * full & box filtered into the zoom above it, so an image is never held in
+ * memory whole. Only tiles holding data are written, pixels outside the
+ * image read as the fill color
+ */
+class tile_pyramid {
+public:
+
+	/*
+	 * Tile pyramid constants
+	 */
+	static const unsigned int CHANNELS = 4;
+	static const unsigned int TILE_WIDTH = 256;
+
+private:
+
+	/*
+	 * Zoom level (a row of tiles, filled from the top)
+	 */
+	class level {
+	public:
+
+		/*
+		 * Level width & height (in pixels) & tile column count
+		 */
+		unsigned long long width, height;
+		size_t columns;
+
+		/*
+		 * Row of tiles (padded to whole tiles with the fill color) & tile
+		 * columns holding data
+		 */
+		std::vector<unsigned char> px;
+		std::vector<char> present;
+
+		/*
+		 * Rows filled & tile row
+		 */
+		size_t rows;
+		unsigned long long y;
+
+		/*
+		 * Level constructor
+		 */
+		level(unsigned long long width, unsigned long long height) : width(width), height(height),
+				columns((width + TILE_WIDTH - 1) / TILE_WIDTH), present(columns, false), rows(0), y(0) { return; }
+	};
+
+	/*
+	 * Output directory
+	 */
+	std::string dir;
+
+	/*
+	 * Fill color (RGBA) & tile encoding options
+	 */
+	unsigned int fill;
+	png_writer::options opt;
+
+	/*
+	 * Zoom levels (by zoom) & native rows written
+	 */
+	std::vector<level> levels;
+	unsigned long long rows;
+
+	/*
+	 * Worker thread count, writer open, zoom & tile columns being written,
+	 * next tile to claim, tile lock & worker error
+	 */
+	unsigned int threads;
+	bool open;
+	unsigned int zoom;
+	std::vector<size_t> tiles;
+	size_t next;
+	std::mutex lock;
+	std::string error;
+
+	/*
+	 * Tile pyramid constructor (non-copyable)
+	 */
+	tile_pyramid(const tile_pyramid &other);
+
+	/*
+	 * Tile pyramid assignment operator (non-copyable)
+	 */
+	tile_pyramid &operator=(const tile_pyramid &other);
+
+	/*
+	 * Box filter a pair of rows into a row of half the width
+	 */
+	static void downsample_row(const unsigned char *above, const unsigned char *below, size_t count, unsigned char *out);
+
+#ifdef __SSE2__
+	/*
+	 * Box filter a pair of rows into a row of half the width, four pixels at a time
+	 */
+	static void downsample_row_sse2(const unsigned char *above, const unsigned char *below, size_t count, unsigned char *out);
+#endif
+
+	/*
+	 * Fill a level's rows with the fill color
+	 */
+	void fill_rows(level &lev, size_t first, size_t count);
+
+	/*
+	 * Write a zoom's full row of tiles, box filtering it into the zoom above
+	 */
+	void flush_level(unsigned int zoom);
+
+	/*
+	 * Worker thread entry point (writes claimed tiles)
+	 */
+	void run(void);
+
+	/*
+	 * Write a tile of a zoom's row of tiles
+	 */
+	void write_tile(unsigned int zoom, size_t column);
+
+public:
+
+	/*
+	 * Tile pyramid constructor (tiles are encoded in parallel, each on a
+	 * single thread)
+	 */
+	tile_pyramid(const std::string &dir, unsigned long long width, unsigned long long height, unsigned int fill,
+			const png_writer::options &opt = png_writer::options());
+
+	/*
+	 * Tile pyramid destructor
+	 */
+	virtual ~tile_pyramid(void) { return; }
+
+	/*
+	 * Write the remaining rows of tiles (every row must be written)
+	 */
+	void close(void);
+
+	/*
+	 * Returns a pyramid's native tile column count
+	 */
+	size_t get_columns(void) { return levels.back().columns; }
+
+	/*
+	 * Returns a pyramid's deepest zoom (native resolution)
+	 */
+	unsigned int get_max_zoom(void) { return levels.size() - 1; }
+
+	/*
+	 * Write a series of native RGBA rows, with the native tile columns they
+	 * hold data for
+	 */
+	void write_rows(const unsigned char *data, size_t count, const std::vector<char> &present);
+};
+
+#endif